@@ -7,28 +7,156 @@
 //#define PROJECTOR 11
 //#define CAMERA 9
 
+// Trigger timing, programmable from the host over serial (115200 baud).
+// One command per line, every command is answered with one line:
+//   P <us>   trigger period, projector rising edge to the next one
+//   W <us>   camera pulse width
+//   D <us>   projector to camera delay
+//   B <n>    burst: stop after n cycles, 0 runs until X
+//   S        start (restarts a burst)
+//   X        stop
+//   ?        report the current settings
+// Replies are "OK P<us> W<us> D<us> B<n> R<0|1>" or "ERR <reason>".
+// The defaults reproduce the old fixed 15 Hz timing and run at power up,
+// so the board still works without a host.
+// sketchConsole.cpp runs this sketch on the desktop against a scripted
+// console (consoleScript.txt, expected replies and pin edges in
+// consoleScript.expected).
 
-#define seqA 466 //1470//5 //10 //
-#define seqB 66 //3530//12 //24 //
+#define DEFAULT_PERIOD 66666 // seqB 66 ms low + 466 us high + 200 us delay
+#define DEFAULT_WIDTH 466    // seqA
+#define DEFAULT_DELAY 200
+
+unsigned long period = DEFAULT_PERIOD;
+unsigned long width = DEFAULT_WIDTH;
+unsigned long projectorDelay = DEFAULT_DELAY;
+unsigned long burst = 0;
+
+bool running = true;
+unsigned long cycleStart = 0;
+unsigned long cycleCount = 0;
+bool cameraHigh = false;
+bool pulseDone = false;
+
+char line[32];
+int lineLength = 0;
+
+void startCycle(unsigned long now) {
+  cycleStart = now;
+  cameraHigh = false;
+  pulseDone = false;
+  digitalWrite(CAMERA, LOW);
+  digitalWrite(PROJECTOR, HIGH);
+}
+
+void stopOutputs() {
+  digitalWrite(PROJECTOR, LOW);
+  digitalWrite(CAMERA, LOW);
+  cameraHigh = false;
+}
+
+void report() {
+  Serial.print("OK P");
+  Serial.print(period);
+  Serial.print(" W");
+  Serial.print(width);
+  Serial.print(" D");
+  Serial.print(projectorDelay);
+  Serial.print(" B");
+  Serial.print(burst);
+  Serial.print(" R");
+  Serial.println(running ? 1 : 0);
+}
+
+void handleCommand() {
+  char command = line[0];
+  unsigned long value = strtoul(line + 1, NULL, 10);
+  switch (command) {
+    case 'P':
+      if (value <= projectorDelay + width) { Serial.println("ERR period too short"); return; }
+      period = value;
+      break;
+    case 'W':
+      if (value == 0 || projectorDelay + value >= period) { Serial.println("ERR width out of range"); return; }
+      width = value;
+      break;
+    case 'D':
+      if (value + width >= period) { Serial.println("ERR delay out of range"); return; }
+      projectorDelay = value;
+      break;
+    case 'B':
+      burst = value;
+      break;
+    case 'S':
+      cycleCount = 0;
+      running = true;
+      startCycle(micros());
+      break;
+    case 'X':
+      running = false;
+      stopOutputs();
+      break;
+    case '?':
+      break;
+    default:
+      Serial.println("ERR unknown command");
+      return;
+  }
+  report();
+}
+
+// read whatever arrived without waiting, so the pulse timing keeps running
+void readSerial() {
+  while (Serial.available() > 0) {
+    char c = Serial.read();
+    if (c == '\r') continue;
+    if (c == '\n') {
+      line[lineLength] = 0;
+      if (lineLength > 0) handleCommand();
+      lineLength = 0;
+    } else if (lineLength < (int)sizeof(line) - 1) {
+      line[lineLength++] = c;
+    }
+  }
+}
 
 void setup() {
- 
+
   pinMode(PROJECTOR, OUTPUT);
   pinMode(CAMERA, OUTPUT);
-  
+  Serial.begin(115200);
+  Serial.println("READY");
+  startCycle(micros());
 }
 
 void loop() {
-  
-  digitalWrite(PROJECTOR, HIGH);
-  delayMicroseconds(200);
-  digitalWrite(CAMERA, HIGH);
 
-  delayMicroseconds(seqA);
-  
-  digitalWrite(PROJECTOR, LOW);
-  digitalWrite(CAMERA, LOW);
+  readSerial();
+  if (!running) return;
+
+  // unsigned differences stay correct when micros() wraps
+  unsigned long now = micros();
+  unsigned long elapsed = now - cycleStart;
 
-  delay(seqB);
-  //cnt++;
+  if (!cameraHigh && !pulseDone && elapsed >= projectorDelay) {
+    digitalWrite(CAMERA, HIGH);
+    cameraHigh = true;
+  }
+  if (cameraHigh && elapsed >= projectorDelay + width) {
+    digitalWrite(PROJECTOR, LOW);
+    digitalWrite(CAMERA, LOW);
+    cameraHigh = false;
+    pulseDone = true;
+  }
+  if (elapsed >= period) {
+    cycleCount++;
+    if (burst > 0 && cycleCount >= burst) {
+      running = false;
+      stopOutputs();
+      Serial.println("DONE");
+      return;
+    }
+    // advance by the period rather than to now so the rate does not drift
+    startCycle(cycleStart + period);
+  }
 }
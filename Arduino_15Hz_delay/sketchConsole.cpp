@@ -0,0 +1,85 @@
+// sketchConsole.cpp : runs Arduino_15Hz_delay.ino on the desktop against a
+// scripted serial console, so the command protocol and the pulse timing can
+// be checked without the board.
+//
+//   g++ -o sketchConsole sketchConsole.cpp     (or cl /EHsc sketchConsole.cpp)
+//   sketchConsole < consoleScript.txt > out.txt
+//   fc out.txt consoleScript.expected          (diff on Linux)
+//
+// Script lines:
+//   > <command>   send one command line to the sketch
+//   @ <us>        run the sketch for us simulated microseconds
+//   # ...         comment
+// Output lines:
+//   < <reply>     a line the sketch printed
+//   <us> <pin> <0|1>  a pin edge, us counted from setup()
+// The simulated clock starts shortly before micros() wraps, so every script
+// also runs the timing across the wrap.
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+#define HIGH 1
+#define LOW 0
+#define OUTPUT 1
+
+static const unsigned long c_clockStart = (unsigned long)0 - 50000;
+static unsigned long g_clock = c_clockStart;
+static int g_pinLevel[32];
+
+unsigned long micros() { return g_clock; }
+
+void pinMode(int pin, int mode) {}
+void digitalWrite(int pin, int level);
+
+// serial port: input comes from the script, output lines are prefixed with "< "
+class SerialConsole {
+public:
+  void begin(long baud) {}
+  int available() { return (int)(m_input.size() - m_readPos); }
+  char read() { return m_input[m_readPos++]; }
+  void send(const string& line) { m_input = m_input.substr(m_readPos) + line + "\n"; m_readPos = 0; }
+
+  void print(const char* text) { m_output += text; }
+  void print(unsigned long value) { m_output += to_string(value); }
+  void print(int value) { m_output += to_string(value); }
+  template <typename T> void println(T value) { print(value); cout << "< " << m_output << endl; m_output.clear(); }
+
+private:
+  string m_input;
+  size_t m_readPos = 0;
+  string m_output;
+};
+static SerialConsole Serial;
+
+#include "Arduino_15Hz_delay.ino"
+
+void digitalWrite(int pin, int level) {
+  if (g_pinLevel[pin] == level) return;
+  g_pinLevel[pin] = level;
+  cout << g_clock - c_clockStart << " " << (pin == PROJECTOR ? "PROJECTOR" : "CAMERA") << " " << level << endl;
+}
+
+int main() {
+  setup();
+  string scriptLine;
+  while (getline(cin, scriptLine)) {
+    if (!scriptLine.empty() && scriptLine.back() == '\r') scriptLine.pop_back();
+    if (scriptLine.size() < 2 || scriptLine[0] == '#') continue;
+    if (scriptLine[0] == '>') {
+      Serial.send(scriptLine.substr(2));
+      loop();
+    } else if (scriptLine[0] == '@') {
+      unsigned long duration = strtoul(scriptLine.c_str() + 1, NULL, 10);
+      for (unsigned long k = 0; k < duration; k++) {
+        g_clock++;
+        loop();
+      }
+    }
+  }
+  return 0;
+}
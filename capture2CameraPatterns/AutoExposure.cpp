@@ -0,0 +1,202 @@
+#include "AutoExposure.h"
+#include <cmath>
+#include <cstring>
+
+
+CAutoExposure::CAutoExposure(float minExposureTime, float maxExposureTime)
+	: m_minExposureTime(minExposureTime), m_maxExposureTime(maxExposureTime),
+	m_percentile(0.99f), m_targetLevel(220), m_saturatedFraction(0.001f),
+	m_hysteresisBand(0.1f), m_settleFrames(2), m_sampleStride(4), m_cycleFrames(1),
+	m_framesToSettle(0), m_isConverged(false), m_percentileLevel(0), m_sampleCount(0), m_cycleFrame(0)
+{
+	memset(m_histogram, 0, sizeof(m_histogram));
+}
+
+CAutoExposure::~CAutoExposure(void)
+{
+}
+
+//--------------------------------------------------------------------
+// Input:
+//		percentile			= fraction of samples that must lie at or below targetLevel
+//		targetLevel			= 8-bit level the percentile is driven to
+//		saturatedFraction	= largest allowed fraction of samples at 254 or above
+//--------------------------------------------------------------------
+void CAutoExposure::SetTarget(float percentile, int targetLevel, float saturatedFraction)
+{
+	m_percentile = percentile;
+	m_targetLevel = targetLevel < 1 ? 1 : (targetLevel > 253 ? 253 : targetLevel);
+	m_saturatedFraction = saturatedFraction;
+}
+
+//--------------------------------------------------------------------
+// Input:
+//		band			= relative exposure change below which nothing is written
+//		settleFrames	= frames ignored after a change, they were exposed
+//						  with the previous setting
+//--------------------------------------------------------------------
+void CAutoExposure::SetHysteresis(float band, int settleFrames)
+{
+	m_hysteresisBand = band;
+	m_settleFrames = settleFrames;
+}
+
+// sample every stride-th pixel of every stride-th row
+void CAutoExposure::SetSampleStride(int stride)
+{
+	m_sampleStride = stride < 1 ? 1 : stride;
+}
+
+// frames per projector cycle; the exposure is updated once per cycle
+void CAutoExposure::SetCycleFrames(int cycleFrames)
+{
+	m_cycleFrames = cycleFrames < 1 ? 1 : cycleFrames;
+	m_cycleFrame = 0;
+}
+
+void CAutoExposure::SetExposureRange(float minExposureTime, float maxExposureTime)
+{
+	m_minExposureTime = minExposureTime;
+	m_maxExposureTime = maxExposureTime;
+}
+
+//--------------------------------------------------------------------
+// Analyse a preview frame and propose a new exposure once the frames
+// of a projector cycle are in
+//
+// Input:
+//		frame			= 8-bit frame, or 16-bit MSB aligned frame
+//		exposureTime	= current exposure in ms, updated when a change is due
+// Output:
+//		true when exposureTime was changed and should be written to the camera
+//--------------------------------------------------------------------
+bool CAutoExposure::Update(const unsigned char* frame, int width, int height, float& exposureTime)
+{
+	return _addFrame(frame, width, height, exposureTime);
+}
+
+bool CAutoExposure::Update(const unsigned short* frame, int width, int height, float& exposureTime)
+{
+	return _addFrame(frame, width, height, exposureTime);
+}
+
+template <typename T>
+bool CAutoExposure::_addFrame(const T* frame, int width, int height, float& exposureTime)
+{
+	if (m_framesToSettle > 0)
+	{
+		m_framesToSettle--;
+		return false;
+	}
+	_sampleFrame(frame, width, height);
+	if (++m_cycleFrame < m_cycleFrames)
+	{
+		return false;
+	}
+	m_cycleFrame = 0;
+	_buildHistogram();
+	return _updateExposure(exposureTime);
+}
+
+// keep the brightest level of every stride-th pixel of every stride-th row
+// over the cycle; 16-bit pixels are kept by their high byte
+template <typename T>
+void CAutoExposure::_sampleFrame(const T* frame, int width, int height)
+{
+	const int shift = sizeof(T) == 1 ? 0 : 8;
+	const int stride = m_sampleStride;
+	if (m_cycleFrame == 0)
+	{
+		m_cycleMax.clear();
+	}
+	size_t sample = 0;
+	for (int y = stride / 2; y < height; y += stride)
+	{
+		const T* row = frame + (size_t)y * width;
+		for (int x = 0; x < width; x += stride, sample++)
+		{
+			unsigned char level = (unsigned char)(row[x] >> shift);
+			if (sample == m_cycleMax.size())
+			{
+				m_cycleMax.push_back(level);
+			}
+			else if (level > m_cycleMax[sample])
+			{
+				m_cycleMax[sample] = level;
+			}
+		}
+	}
+}
+
+// four interleaved sub-histograms keep repeated levels from stalling on
+// the same counter
+void CAutoExposure::_buildHistogram(void)
+{
+	int partialHistogram[4][256];
+	memset(partialHistogram, 0, sizeof(partialHistogram));
+
+	const unsigned char* levels = m_cycleMax.data();
+	int sampleCount = (int)m_cycleMax.size();
+	int k = 0;
+	for (; k + 3 < sampleCount; k += 4)
+	{
+		partialHistogram[0][levels[k]]++;
+		partialHistogram[1][levels[k + 1]]++;
+		partialHistogram[2][levels[k + 2]]++;
+		partialHistogram[3][levels[k + 3]]++;
+	}
+	for (; k < sampleCount; k++)
+	{
+		partialHistogram[0][levels[k]]++;
+	}
+	for (int level = 0; level < 256; level++)
+	{
+		m_histogram[level] = partialHistogram[0][level] + partialHistogram[1][level] +
+			partialHistogram[2][level] + partialHistogram[3][level];
+	}
+	m_sampleCount = sampleCount;
+}
+
+bool CAutoExposure::_updateExposure(float& exposureTime)
+{
+	if (m_sampleCount == 0) return false;
+
+	// level reached by the percentile
+	int percentileCount = (int)(m_percentile * m_sampleCount);
+	int cumulative = 0;
+	int level = 0;
+	for (; level < 255; level++)
+	{
+		cumulative += m_histogram[level];
+		if (cumulative >= percentileCount) break;
+	}
+	m_percentileLevel = level;
+	int saturatedCount = m_histogram[254] + m_histogram[255];
+
+	// the sensor response is linear, so scale the exposure by the level ratio;
+	// when clipped the true level is unknown, back off by half
+	float ratio;
+	if (saturatedCount > m_saturatedFraction * m_sampleCount)
+	{
+		ratio = 0.5f;
+	}
+	else
+	{
+		ratio = (float)m_targetLevel / (float)(level > 0 ? level : 1);
+		if (ratio > 4.0f) ratio = 4.0f;
+	}
+
+	float newExposureTime = exposureTime * ratio;
+	if (newExposureTime < m_minExposureTime) newExposureTime = m_minExposureTime;
+	if (newExposureTime > m_maxExposureTime) newExposureTime = m_maxExposureTime;
+
+	if (fabs(newExposureTime - exposureTime) <= m_hysteresisBand * exposureTime)
+	{
+		m_isConverged = true;
+		return false;
+	}
+	m_isConverged = false;
+	exposureTime = newExposureTime;
+	m_framesToSettle = m_settleFrames;
+	return true;
+}
@@ -0,0 +1,54 @@
+/*
+	 Histogram driven auto exposure for the live preview stream.
+	 A sparse sample of each frame is binned into 256 levels; the
+	 exposure is scaled so the chosen percentile lands on the target
+	 level while the saturated fraction stays below a limit.
+	 While the projector cycles through its patterns, the histogram is
+	 taken from the per-sample maximum over one cycle, so the exposure
+	 follows the brightest pattern instead of whichever one is shown.
+*/
+
+#pragma once
+
+#include <vector>
+
+class CAutoExposure
+{
+public:
+	CAutoExposure(float minExposureTime = 0.02f, float maxExposureTime = 60.0f);
+	~CAutoExposure(void);
+
+	void SetTarget(float percentile, int targetLevel, float saturatedFraction);
+	void SetHysteresis(float band, int settleFrames);
+	void SetSampleStride(int stride);
+	void SetCycleFrames(int cycleFrames);
+	void SetExposureRange(float minExposureTime, float maxExposureTime);
+
+	bool Update(const unsigned char* frame, int width, int height, float& exposureTime);
+	bool Update(const unsigned short* frame, int width, int height, float& exposureTime);
+	bool IsConverged(void) const { return m_isConverged; }
+	int GetPercentileLevel(void) const { return m_percentileLevel; }
+
+private:
+	template <typename T> bool _addFrame(const T* frame, int width, int height, float& exposureTime);
+	template <typename T> void _sampleFrame(const T* frame, int width, int height);
+	void _buildHistogram(void);
+	bool _updateExposure(float& exposureTime);
+
+	float m_minExposureTime, m_maxExposureTime;
+	float m_percentile;
+	int m_targetLevel;
+	float m_saturatedFraction;
+	float m_hysteresisBand;
+	int m_settleFrames;
+	int m_sampleStride;
+	int m_cycleFrames;
+
+	int m_framesToSettle;
+	bool m_isConverged;
+	int m_percentileLevel;
+	int m_sampleCount;
+	int m_histogram[256];
+	int m_cycleFrame;
+	std::vector<unsigned char> m_cycleMax;	// brightest level per sample in this cycle
+};
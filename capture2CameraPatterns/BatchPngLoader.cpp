@@ -0,0 +1,290 @@
+#include "BatchPngLoader.h"
+#include "FringeCodec.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+
+CBatchPngLoader::CBatchPngLoader(int nThreads)
+{
+	m_nThreads = nThreads > 0 ? nThreads : (int)thread::hardware_concurrency();
+	if (m_nThreads < 1) m_nThreads = 1;
+}
+
+CBatchPngLoader::~CBatchPngLoader(void)
+{
+	if (m_pendingLoad.valid()) m_pendingLoad.wait();
+}
+
+//--------------------------------------------------------------------
+// Count the frames of a set directory
+// frames are named f0.png, f1.png, ... as written by savePosFringe, or
+// are all in set.fsc when the set was saved with the fringe codec
+//--------------------------------------------------------------------
+int CBatchPngLoader::CountSetFrames(const string& setDir)
+{
+	FringeSetInfo setInfo;
+	if (CFringeCodec::ReadFileInfo(setDir + "/set.fsc", setInfo))
+	{
+		return setInfo.frameCount;
+	}
+	int nFrames = 0;
+	while (true)
+	{
+		string fileName = setDir + "/f" + to_string(nFrames) + ".png";
+		FILE* fp = fopen(fileName.c_str(), "rb");
+		if (!fp) break;
+		fclose(fp);
+		nFrames++;
+	}
+	return nFrames;
+}
+
+//--------------------------------------------------------------------
+// Frame count and geometry of a set without decoding it
+// the geometry comes from the IHDR chunk of f0.png so callers can size
+// storage before LoadSet()
+//--------------------------------------------------------------------
+bool CBatchPngLoader::ProbeSet(const string& setDir, BatchLoadInfo& info)
+{
+	info = BatchLoadInfo();
+	FringeSetInfo setInfo;
+	if (CFringeCodec::ReadFileInfo(setDir + "/set.fsc", setInfo))
+	{
+		info.nFrames = setInfo.frameCount;
+		info.imageWidth = setInfo.imageWidth;
+		info.imageHeight = setInfo.imageHeight;
+		info.nChannels = 1;
+		info.bytesPerPixel = setInfo.bytesPerPixel;
+		info.frameBytes = setInfo.frameBytes;
+		return true;
+	}
+	info.nFrames = CountSetFrames(setDir);
+	if (info.nFrames == 0)
+	{
+		return false;
+	}
+
+	unsigned char header[26];
+	string fileName = setDir + "/f0.png";
+	FILE* fp = fopen(fileName.c_str(), "rb");
+	if (!fp)
+	{
+		return false;
+	}
+	size_t readBytes = fread(header, 1, sizeof(header), fp);
+	fclose(fp);
+	const unsigned char pngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	if (readBytes != sizeof(header) || memcmp(header, pngSignature, 8) != 0 || memcmp(header + 12, "IHDR", 4) != 0)
+	{
+		cout << "not a png file: " << fileName << endl;
+		return false;
+	}
+
+	info.imageWidth = (header[16] << 24) | (header[17] << 16) | (header[18] << 8) | header[19];
+	info.imageHeight = (header[20] << 24) | (header[21] << 16) | (header[22] << 8) | header[23];
+	info.bytesPerPixel = header[24] > 8 ? 2 : 1;
+	switch (header[25])
+	{
+	case 0: info.nChannels = 1; break;	// gray
+	case 2: info.nChannels = 3; break;	// rgb, decoded as bgr
+	case 4: info.nChannels = 2; break;	// gray + alpha
+	case 6: info.nChannels = 4; break;	// rgba
+	default:
+		cout << "unsupported png color type: " << fileName << endl;
+		return false;
+	}
+	info.frameBytes = (size_t)info.imageWidth * info.imageHeight * info.nChannels * info.bytesPerPixel;
+	return true;
+}
+
+bool CBatchPngLoader::ReadFileBytes(const string& fileName, vector<unsigned char>& fileBytes)
+{
+	FILE* fp = fopen(fileName.c_str(), "rb");
+	if (!fp)
+	{
+		return false;
+	}
+	fseek(fp, 0, SEEK_END);
+	long fileSize = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	fileBytes.resize(fileSize > 0 ? fileSize : 0);
+	size_t readBytes = fileBytes.empty() ? 0 : fread(fileBytes.data(), 1, fileBytes.size(), fp);
+	fclose(fp);
+	return readBytes == fileBytes.size() && !fileBytes.empty();
+}
+
+//--------------------------------------------------------------------
+// Load all frames of a set into contiguous storage
+//
+// Input:
+//		setDir		= position directory holding f0.png ... fN-1.png or set.fsc
+//		storage		= preallocated buffer, frame k at storage + k * frameBytes
+//		storageBytes = size of the buffer
+//		info		= frame count, geometry and decode throughput
+//
+// Return: false if a frame is missing, cannot be decoded, does not match
+//		the geometry of the first frame or the storage is too small
+//--------------------------------------------------------------------
+bool CBatchPngLoader::LoadSet(const string& setDir, unsigned char* storage, size_t storageBytes, BatchLoadInfo& info)
+{
+	string fringeSetName = setDir + "/set.fsc";
+	FringeSetInfo setInfo;
+	if (CFringeCodec::ReadFileInfo(fringeSetName, setInfo))
+	{
+		return LoadFringeSet(fringeSetName, storage, storageBytes, info);
+	}
+	auto startTime = chrono::steady_clock::now();
+	info = BatchLoadInfo();
+	info.nFrames = CountSetFrames(setDir);
+	if (info.nFrames == 0)
+	{
+		cout << "no frames found in " << setDir << endl;
+		return false;
+	}
+
+	// the first frame defines the geometry of the set
+	vector<unsigned char> fileBytes;
+	if (!ReadFileBytes(setDir + "/f0.png", fileBytes))
+	{
+		cout << "cannot read file: " << setDir << "/f0.png" << endl;
+		return false;
+	}
+	Mat firstFrame = imdecode(fileBytes, IMREAD_UNCHANGED);
+	if (firstFrame.empty())
+	{
+		cout << "cannot decode file: " << setDir << "/f0.png" << endl;
+		return false;
+	}
+	info.imageWidth = firstFrame.cols;
+	info.imageHeight = firstFrame.rows;
+	info.nChannels = firstFrame.channels();
+	info.bytesPerPixel = (int)firstFrame.elemSize1();
+	info.frameBytes = (size_t)info.imageWidth * info.imageHeight * firstFrame.elemSize();
+	if (info.frameBytes * info.nFrames > storageBytes)
+	{
+		cout << "set storage too small for " << setDir << endl;
+		return false;
+	}
+	Mat firstFrameStorage(firstFrame.size(), firstFrame.type(), storage);
+	firstFrame.copyTo(firstFrameStorage);
+
+	// decode the remaining frames concurrently, each one in place
+	atomic<int> nextFrame(1);
+	atomic<bool> isValid(true);
+	atomic<long long> totalReadBytes((long long)fileBytes.size());
+	int frameType = firstFrame.type();
+	auto decodeFrames = [&]()
+	{
+		vector<unsigned char> buffer;
+		for (int k = nextFrame++; k < info.nFrames && isValid; k = nextFrame++)
+		{
+			string fileName = setDir + "/f" + to_string(k) + ".png";
+			if (!ReadFileBytes(fileName, buffer))
+			{
+				cout << "cannot read file: " << fileName << endl;
+				isValid = false;
+				break;
+			}
+			totalReadBytes += (long long)buffer.size();
+
+			unsigned char* frameStorage = storage + k * info.frameBytes;
+			Mat frame(info.imageHeight, info.imageWidth, frameType, frameStorage);
+			imdecode(buffer, IMREAD_UNCHANGED, &frame);
+			if (frame.data != frameStorage)
+			{
+				cout << "frame does not match the set geometry: " << fileName << endl;
+				isValid = false;
+			}
+		}
+	};
+
+	int nWorkers = std::min(m_nThreads, info.nFrames - 1);
+	vector<thread> workers;
+	for (int t = 1; t < nWorkers; t++)
+	{
+		workers.push_back(thread(decodeFrames));
+	}
+	decodeFrames();
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+	info.readMB = totalReadBytes / (1024.0 * 1024.0);
+	info.decodeMBps = seconds > 0 ? info.frameBytes * info.nFrames / (1024.0 * 1024.0) / seconds : 0;
+	return isValid;
+}
+
+//--------------------------------------------------------------------
+// Load a set saved by the fringe codec, decoded band-parallel into storage
+//--------------------------------------------------------------------
+bool CBatchPngLoader::LoadFringeSet(const string& fileName, unsigned char* storage, size_t storageBytes, BatchLoadInfo& info)
+{
+	auto startTime = chrono::steady_clock::now();
+	info = BatchLoadInfo();
+	vector<unsigned char> fileBytes;
+	FringeSetInfo setInfo;
+	if (!ReadFileBytes(fileName, fileBytes) || !CFringeCodec::ReadInfo(fileBytes, setInfo))
+	{
+		cout << "cannot read file: " << fileName << endl;
+		return false;
+	}
+	info.nFrames = setInfo.frameCount;
+	info.imageWidth = setInfo.imageWidth;
+	info.imageHeight = setInfo.imageHeight;
+	info.nChannels = 1;
+	info.bytesPerPixel = setInfo.bytesPerPixel;
+	info.frameBytes = setInfo.frameBytes;
+	if (info.frameBytes * info.nFrames > storageBytes)
+	{
+		cout << "set storage too small for " << fileName << endl;
+		return false;
+	}
+	if (!CFringeCodec(m_nThreads).DecodeSet(fileBytes, storage, storageBytes))
+	{
+		cout << "cannot decode file: " << fileName << endl;
+		return false;
+	}
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+	info.readMB = fileBytes.size() / (1024.0 * 1024.0);
+	info.decodeMBps = seconds > 0 ? info.frameBytes * info.nFrames / (1024.0 * 1024.0) / seconds : 0;
+	return true;
+}
+
+//--------------------------------------------------------------------
+// Start loading a set in the background
+// the storage must stay valid until EndLoadSet() returns
+//--------------------------------------------------------------------
+bool CBatchPngLoader::BeginLoadSet(const string& setDir, unsigned char* storage, size_t storageBytes)
+{
+	if (m_pendingLoad.valid())
+	{
+		cout << "a set is already being loaded" << endl;
+		return false;
+	}
+	m_pendingLoad = async(launch::async, [this, setDir, storage, storageBytes]()
+	{
+		return LoadSet(setDir, storage, storageBytes, m_pendingInfo);
+	});
+	return true;
+}
+
+//--------------------------------------------------------------------
+// Wait for the background load started by BeginLoadSet()
+//--------------------------------------------------------------------
+bool CBatchPngLoader::EndLoadSet(BatchLoadInfo& info)
+{
+	if (!m_pendingLoad.valid())
+	{
+		return false;
+	}
+	bool isLoaded = m_pendingLoad.get();
+	info = m_pendingInfo;
+	return isLoaded;
+}
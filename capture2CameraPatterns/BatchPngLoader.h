@@ -0,0 +1,50 @@
+/*
+	 Parallel loader for saved position sets (posEval<N>/f<k>.png, or
+	 posEval<N>/set.fsc written by the fringe codec)
+	 All frames of a set are decoded concurrently straight into caller
+	 provided contiguous storage, frame k at storage + k * frameBytes.
+	 BeginLoadSet()/EndLoadSet() run the load in the background so the
+	 next set can be read ahead while the current one is processed.
+*/
+
+#pragma once
+
+#include "opencv2/opencv.hpp"
+#include <future>
+#include <string>
+
+using namespace std;
+using namespace cv;
+
+struct BatchLoadInfo
+{
+	int nFrames = 0;
+	int imageWidth = 0;
+	int imageHeight = 0;
+	int nChannels = 0;
+	int bytesPerPixel = 0;		// per channel, 1 or 2
+	size_t frameBytes = 0;
+	double readMB = 0;			// compressed bytes read from disk
+	double decodeMBps = 0;		// decoded bytes per second
+};
+
+class CBatchPngLoader
+{
+public:
+	CBatchPngLoader(int nThreads = 0);
+	~CBatchPngLoader(void);
+
+	int CountSetFrames(const string& setDir);
+	bool ProbeSet(const string& setDir, BatchLoadInfo& info);
+	bool LoadSet(const string& setDir, unsigned char* storage, size_t storageBytes, BatchLoadInfo& info);
+	bool BeginLoadSet(const string& setDir, unsigned char* storage, size_t storageBytes);
+	bool EndLoadSet(BatchLoadInfo& info);
+
+private:
+	bool ReadFileBytes(const string& fileName, vector<unsigned char>& fileBytes);
+	bool LoadFringeSet(const string& fileName, unsigned char* storage, size_t storageBytes, BatchLoadInfo& info);
+
+	int m_nThreads;
+	future<bool> m_pendingLoad;
+	BatchLoadInfo m_pendingInfo;
+};
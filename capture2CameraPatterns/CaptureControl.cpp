@@ -0,0 +1,122 @@
+#include "CaptureControl.h"
+#include <chrono>
+
+
+CCaptureControl::CCaptureControl(int participants)
+	: m_command(PREVIEW), m_arrived(0), m_generation(0), m_participants(participants), m_releaseTime(0),
+	m_rejections(0), m_isAllAccepted(false)
+{
+}
+
+CCaptureControl::~CCaptureControl(void)
+{
+}
+
+// set the number of camera threads, only while no thread is using the control
+void CCaptureControl::Reset(int participants)
+{
+	m_participants = participants;
+	m_arrived = 0;
+	m_rejections = 0;
+	m_command = PREVIEW;
+}
+
+// end the preview of every camera, a quit request is kept
+void CCaptureControl::RequestCapture(void)
+{
+	InterlockedCompareExchange(&m_command, CAPTURE, PREVIEW);
+}
+
+// also releases the threads waiting in Arm() or Commit(); the command is
+// set before the generation changes, so a thread that read the generation
+// before the change wakes up and one that read it after sees the quit
+void CCaptureControl::RequestQuit(void)
+{
+	InterlockedExchange(&m_command, QUIT);
+	InterlockedIncrement(&m_generation);
+	WakeByAddressAll((PVOID)&m_generation);
+}
+
+//--------------------------------------------------------------------
+// Wait until every camera is armed for the set capture
+// Output:
+//		releaseTime	= system clock seconds since the epoch, the same
+//					  clock as the frame time stamps; frames received
+//					  after it belong to the same trigger cycle on
+//					  every camera
+//		false if the run was quit while waiting
+//--------------------------------------------------------------------
+bool CCaptureControl::Arm(double& releaseTime)
+{
+	bool isReleased = _arriveAndWait(ARM_STAGE);
+	releaseTime = m_releaseTime;
+	return isReleased;
+}
+
+//--------------------------------------------------------------------
+// Wait until every camera has judged its set
+// The result is read before this camera arms again, and no camera can
+// vote again before every camera has armed, so one vote never mixes
+// with the next
+//
+// Input:
+//		isAccepted		= this camera captured a complete set that passed
+//						  its checks
+// Output:
+//		isAllAccepted	= every camera accepted its set
+//		false if the run was quit while waiting
+//--------------------------------------------------------------------
+bool CCaptureControl::Vote(bool isAccepted, bool& isAllAccepted)
+{
+	if (!isAccepted)
+	{
+		InterlockedIncrement(&m_rejections);
+	}
+	bool isReleased = _arriveAndWait(VOTE_STAGE);
+	isAllAccepted = m_isAllAccepted;
+	return isReleased;
+}
+
+// wait until every camera has saved its set, then go back to preview
+// false if the run was quit while waiting
+bool CCaptureControl::Commit(void)
+{
+	return _arriveAndWait(COMMIT_STAGE);
+}
+
+// reusable barrier: the last thread to arrive resets the count, publishes
+// the release state and bumps the generation the others are waiting on
+bool CCaptureControl::_arriveAndWait(Stage stage)
+{
+	LONG generation = m_generation;
+	if (m_command == QUIT)
+	{
+		return false;
+	}
+	if (InterlockedIncrement(&m_arrived) == m_participants)
+	{
+		m_arrived = 0;
+		if (stage == COMMIT_STAGE)
+		{
+			InterlockedCompareExchange(&m_command, PREVIEW, CAPTURE);
+		}
+		else if (stage == VOTE_STAGE)
+		{
+			m_isAllAccepted = m_rejections == 0;
+			m_rejections = 0;
+		}
+		else
+		{
+			auto now = std::chrono::system_clock::now().time_since_epoch();
+			m_releaseTime = std::chrono::duration<double>(now).count();
+		}
+		InterlockedIncrement(&m_generation);
+		WakeByAddressAll((PVOID)&m_generation);
+		return m_command != QUIT;
+	}
+	while (m_generation == generation)
+	{
+		WaitOnAddress(&m_generation, &generation, sizeof(generation), INFINITE);
+	}
+	return m_command != QUIT;
+}
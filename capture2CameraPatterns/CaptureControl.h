@@ -0,0 +1,49 @@
+/*
+	 Start/stop control shared by the camera threads.
+	 A lock-free command word carries preview/capture/quit requests
+	 from whichever thread sees the key press, and a reusable barrier
+	 moves all cameras through arm -> capture -> vote -> commit together
+	 for each position; the vote keeps a set only when every camera
+	 captured its own, so the saved sets always cover the same triggers. Waiting threads sleep in WaitOnAddress and are
+	 woken by the last arrival instead of polling. A quit request, also
+	 made by a camera thread that leaves early, wakes every waiting
+	 thread and fails Arm()/Commit(), so no camera waits for one that
+	 will not arrive.
+*/
+
+#pragma once
+
+#include <Windows.h>
+#pragma comment(lib, "Synchronization.lib")
+
+class CCaptureControl
+{
+public:
+	enum Command { PREVIEW = 0, CAPTURE = 1, QUIT = 2 };
+
+	CCaptureControl(int participants = 1);
+	~CCaptureControl(void);
+
+	void Reset(int participants);
+
+	void RequestCapture(void);
+	void RequestQuit(void);
+	Command GetCommand(void) const { return (Command)m_command; }
+	bool IsPreviewing(void) const { return m_command == PREVIEW; }
+
+	bool Arm(double& releaseTime);
+	bool Vote(bool isAccepted, bool& isAllAccepted);
+	bool Commit(void);
+
+private:
+	enum Stage { ARM_STAGE, VOTE_STAGE, COMMIT_STAGE };
+	bool _arriveAndWait(Stage stage);
+
+	volatile LONG m_command;
+	volatile LONG m_arrived;
+	volatile LONG m_generation;
+	LONG m_participants;
+	double m_releaseTime;
+	volatile LONG m_rejections;		// cameras that rejected their set in this vote
+	bool m_isAllAccepted;
+};
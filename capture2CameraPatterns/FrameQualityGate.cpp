@@ -0,0 +1,159 @@
+#include "FrameQualityGate.h"
+#include "FringeKernels.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+
+CFrameQualityGate::CFrameQualityGate(void)
+	: m_blackLevel(8.0f), m_saturationLevel(250)
+{
+	m_defaultExpectation.minMeanRatio = 0.25f;
+	m_defaultExpectation.maxSaturatedFraction = 0.05f;
+	m_defaultExpectation.minGradient = 0;
+}
+
+CFrameQualityGate::~CFrameQualityGate(void)
+{
+}
+
+//--------------------------------------------------------------------
+// Limits of patterns without a loaded expectation
+// Input:
+//		blackLevel				= lowest median frame mean of a lit set
+//		minMeanRatio			= lowest frame mean over the set's median frame mean
+//		maxSaturatedFraction	= highest fraction of pixels at saturationLevel
+//		saturationLevel			= 8-bit level counted as saturated
+//--------------------------------------------------------------------
+void CFrameQualityGate::SetLimits(float blackLevel, float minMeanRatio, float maxSaturatedFraction, unsigned char saturationLevel)
+{
+	m_blackLevel = blackLevel;
+	m_saturationLevel = saturationLevel;
+	m_defaultExpectation.minMeanRatio = minMeanRatio;
+	m_defaultExpectation.maxSaturatedFraction = maxSaturatedFraction;
+}
+
+bool CFrameQualityGate::LoadExpectations(const string& fileName)
+{
+	ifstream expectationFile(fileName);
+	if (!expectationFile.is_open())
+	{
+		cout << "cannot open quality expectations " << fileName << endl;
+		return false;
+	}
+	m_expectations.clear();
+	PatternExpectation expectation;
+	while (expectationFile >> expectation.minMeanRatio >> expectation.maxSaturatedFraction >> expectation.minGradient)
+	{
+		m_expectations.push_back(expectation);
+	}
+	if (m_expectations.empty())
+	{
+		cout << "quality expectations " << fileName << " has no patterns" << endl;
+		return false;
+	}
+	return true;
+}
+
+void CFrameQualityGate::Reset(int frameCount)
+{
+	m_frames.assign(frameCount, FrameQuality());
+}
+
+//--------------------------------------------------------------------
+// Measure one frame of the set
+// Cheap enough to run on the capture thread as each frame arrives
+//
+// Input:
+//		frameIndex		= position of the frame in capture order
+//		frameData		= width * height pixels, 8-bit or 16-bit
+//--------------------------------------------------------------------
+void CFrameQualityGate::AddFrame(int frameIndex, const unsigned char* frameData, int width, int height, int bytesPerPixel)
+{
+	if (frameIndex < 0 || frameIndex >= (int)m_frames.size() || width <= 0 || height <= 0)
+	{
+		return;
+	}
+	FringeKernels::FrameMeasures measures;
+	if (bytesPerPixel == 2)
+	{
+		FringeKernels::measureFrame((const unsigned short*)frameData, width, height, width, m_saturationLevel, measures);
+	}
+	else
+	{
+		FringeKernels::measureFrame(frameData, width, height, width, m_saturationLevel, measures);
+	}
+	double pixelCount = (double)width * height;
+	FrameQuality& quality = m_frames[frameIndex];
+	quality.isMeasured = true;
+	quality.mean = (float)(measures.pixelSum / pixelCount);
+	quality.saturatedFraction = (float)(measures.saturatedCount / pixelCount);
+	quality.gradient = (float)(measures.gradientSum / pixelCount);
+}
+
+const PatternExpectation& CFrameQualityGate::_expectation(int pattern) const
+{
+	return pattern < (int)m_expectations.size() ? m_expectations[pattern] : m_defaultExpectation;
+}
+
+//--------------------------------------------------------------------
+// Check the measured frames against their patterns
+// Input:
+//		patternOffset		= aligner offset, frame k shows pattern k - offset
+//		isSaturationAllowed	= skip the saturation check, e.g. for the
+//							  longest exposure of an HDR set
+// Output:
+//		problems			= one message per failed check
+//		true if the set passes
+//--------------------------------------------------------------------
+bool CFrameQualityGate::Check(int patternOffset, bool isSaturationAllowed, vector<string>& problems) const
+{
+	size_t problemCount = problems.size();
+	int frameCount = (int)m_frames.size();
+	vector<float> means;
+	for (const FrameQuality& quality : m_frames)
+	{
+		if (quality.isMeasured) means.push_back(quality.mean);
+	}
+	if (means.empty())
+	{
+		return true;
+	}
+	nth_element(means.begin(), means.begin() + means.size() / 2, means.end());
+	float medianMean = means[means.size() / 2];
+	char message[256];
+	if (medianMean < m_blackLevel)
+	{
+		snprintf(message, sizeof(message), "set is dark, median frame mean %.1f", medianMean);
+		problems.push_back(message);
+	}
+
+	for (int k = 0; k < frameCount; k++)
+	{
+		const FrameQuality& quality = m_frames[k];
+		if (!quality.isMeasured)
+		{
+			continue;
+		}
+		int pattern = ((k - patternOffset) % frameCount + frameCount) % frameCount;
+		const PatternExpectation& expectation = _expectation(pattern);
+		if (quality.mean < expectation.minMeanRatio * medianMean)
+		{
+			snprintf(message, sizeof(message), "frame %d (pattern %d) dropped out, mean %.1f of median %.1f", k, pattern, quality.mean, medianMean);
+			problems.push_back(message);
+		}
+		bool isMarker = pattern < (int)m_isFringe.size() && !m_isFringe[pattern];
+		if (!isSaturationAllowed && !isMarker && quality.saturatedFraction > expectation.maxSaturatedFraction)
+		{
+			snprintf(message, sizeof(message), "frame %d (pattern %d) has %.2f%% saturated pixels", k, pattern, quality.saturatedFraction * 100);
+			problems.push_back(message);
+		}
+		if (quality.gradient < expectation.minGradient)
+		{
+			snprintf(message, sizeof(message), "frame %d (pattern %d) is out of focus, gradient %.2f below %.2f", k, pattern, quality.gradient, expectation.minGradient);
+			problems.push_back(message);
+		}
+	}
+	return problems.size() == problemCount;
+}
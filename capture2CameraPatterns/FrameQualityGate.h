@@ -0,0 +1,68 @@
+/*
+	 Quality gate for captured sets. Each frame is measured in one pass as
+	 it arrives (mean, saturated fraction and mean absolute gradient, all
+	 on the 8-bit scale) and the set is checked against the expectation of
+	 the pattern each frame shows before it is written:
+	 - a frame much darker than the set's median frame missed its trigger
+	   or projector pattern (dropout)
+	 - a set whose median frame is below blackLevel has no projector light
+	 - too many pixels at the saturation level clip the fringes
+	 - a gradient below the pattern's minimum means the set is out of focus
+
+	 Expectations are per codebook pattern and may be loaded from a text
+	 file with one line per pattern,
+	 <minMeanRatio> <maxSaturatedFraction> <minGradient>
+	 e.g. 0 for the mean ratio of a projected black pattern, and a minimum
+	 gradient taken from a set known to be in focus. Patterns without a
+	 line use the default limits, which leave the focus check off.
+	 Marker patterns (see CSequenceAligner) are bright by design and are
+	 left out of the saturation check.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct FrameQuality
+{
+	bool isMeasured;
+	float mean;
+	float saturatedFraction;
+	float gradient;				// mean |difference| to the right and lower neighbours
+};
+
+struct PatternExpectation
+{
+	float minMeanRatio;			// of the set's median frame mean
+	float maxSaturatedFraction;
+	float minGradient;			// 0: no focus check
+};
+
+class CFrameQualityGate
+{
+public:
+	CFrameQualityGate(void);
+	~CFrameQualityGate(void);
+
+	void SetLimits(float blackLevel, float minMeanRatio, float maxSaturatedFraction, unsigned char saturationLevel);
+	bool LoadExpectations(const string& fileName);
+	void SetFringePatterns(const vector<bool>& isFringe) { m_isFringe = isFringe; }
+
+	void Reset(int frameCount);
+	void AddFrame(int frameIndex, const unsigned char* frameData, int width, int height, int bytesPerPixel);
+	bool Check(int patternOffset, bool isSaturationAllowed, vector<string>& problems) const;
+	const vector<FrameQuality>& GetFrames(void) const { return m_frames; }
+
+private:
+	const PatternExpectation& _expectation(int pattern) const;
+
+	float m_blackLevel;
+	unsigned char m_saturationLevel;
+	PatternExpectation m_defaultExpectation;
+	vector<PatternExpectation> m_expectations;
+	vector<bool> m_isFringe;		// false for marker patterns, empty: all fringes
+	vector<FrameQuality> m_frames;
+};
@@ -0,0 +1,475 @@
+// WinSock2.h has to come before anything that includes Windows.h
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#include "FrameStreamServer.h"
+#include <iostream>
+#pragma comment(lib, "Ws2_32.lib")
+
+
+CFrameStreamServer::CFrameStreamServer(void)
+	: m_isRunning(false), m_clientCount(0), m_listenSocket(INVALID_SOCKET), m_streamRate(10.0f), m_downsample(4),
+	m_jpegQuality(80), m_clientQueueFrames(4), m_hasNewFrame(false)
+{
+	for (CameraSlot& slot : m_cameras)
+	{
+		slot.cameraSerial = 0;
+		slot.hasFrame = false;
+		slot.previousInfo = StreamFrameInfo();
+		slot.frameRate = 0;
+	}
+}
+
+CFrameStreamServer::~CFrameStreamServer(void)
+{
+	Stop();
+}
+
+//--------------------------------------------------------------------
+// Listen for viewers on port
+// Input:
+//		streamRate			= frames per second and camera sent to viewers
+//		downsample			= the streamed image is 1/downsample of the preview
+//		jpegQuality			= 0..100
+//		clientQueueFrames	= frames a viewer may fall behind before it loses the oldest
+//--------------------------------------------------------------------
+bool CFrameStreamServer::Start(unsigned short port, float streamRate, int downsample, int jpegQuality, int clientQueueFrames)
+{
+	if (m_isRunning)
+	{
+		return true;
+	}
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+	{
+		cout << "Winsock cannot be started" << endl;
+		return false;
+	}
+
+	SOCKET listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	if (listenSocket == INVALID_SOCKET || bind(listenSocket, (const sockaddr*)&address, sizeof(address)) == SOCKET_ERROR ||
+		listen(listenSocket, SOMAXCONN) == SOCKET_ERROR)
+	{
+		cout << "frame stream cannot listen on port " << port << endl;
+		if (listenSocket != INVALID_SOCKET) closesocket(listenSocket);
+		WSACleanup();
+		return false;
+	}
+
+	m_listenSocket = listenSocket;
+	m_streamRate = (std::max)(streamRate, 0.1f);
+	m_downsample = (std::max)(downsample, 1);
+	m_jpegQuality = (std::min)((std::max)(jpegQuality, 0), 100);
+	m_clientQueueFrames = (std::max)(clientQueueFrames, 1);
+	m_hasNewFrame = false;
+	m_isRunning = true;
+	m_acceptThread = thread(&CFrameStreamServer::_acceptLoop, this);
+	m_encodeThread = thread(&CFrameStreamServer::_encodeLoop, this);
+	cout << "frame stream listening on port " << port << endl;
+	return true;
+}
+
+// disconnect all viewers and stop the server threads
+void CFrameStreamServer::Stop(void)
+{
+	if (!m_isRunning)
+	{
+		return;
+	}
+	m_isRunning = false;
+	{
+		lock_guard<mutex> lock(m_frameMtx);
+		m_hasNewFrame = true;
+	}
+	m_frameReady.notify_all();
+	m_acceptThread.join();
+	m_encodeThread.join();
+	closesocket((SOCKET)m_listenSocket);
+	m_listenSocket = INVALID_SOCKET;
+	_pruneClients(true);
+	WSACleanup();
+}
+
+//--------------------------------------------------------------------
+// Offer a preview frame to the stream, from a capture thread
+// The frame is copied only if a viewer is connected, the camera's last
+// streamed frame is older than the stream period and the encoder is not
+// swapping the camera's slot at this moment; it never waits
+// Output:
+//		true if the frame was taken
+//--------------------------------------------------------------------
+bool CFrameStreamServer::PostFrame(const Mat& frame, const StreamFrameInfo& info)
+{
+	if (!m_isRunning || m_clientCount == 0 || frame.empty())
+	{
+		return false;
+	}
+	CameraSlot* slot = _slotFor(info.cameraSerial);
+	if (slot == NULL)
+	{
+		return false;
+	}
+	auto now = chrono::steady_clock::now();
+	if (now - slot->lastPostTime < chrono::duration<double>(1.0 / m_streamRate))
+	{
+		return false;
+	}
+
+	unique_lock<mutex> lock(slot->mtx, try_to_lock);
+	if (!lock.owns_lock())
+	{
+		return false;
+	}
+	// the slot keeps the buffer the encoder swapped back, so this is a plain copy
+	frame.copyTo(slot->pending);
+	slot->info = info;
+	slot->hasFrame = true;
+	lock.unlock();
+	slot->lastPostTime = now;
+
+	{
+		lock_guard<mutex> frameLock(m_frameMtx);
+		m_hasNewFrame = true;
+	}
+	m_frameReady.notify_one();
+	return true;
+}
+
+// the slot of a camera, claimed on its first frame
+CFrameStreamServer::CameraSlot* CFrameStreamServer::_slotFor(unsigned int cameraSerial)
+{
+	for (CameraSlot& slot : m_cameras)
+	{
+		if (slot.cameraSerial == cameraSerial)
+		{
+			return &slot;
+		}
+	}
+	for (CameraSlot& slot : m_cameras)
+	{
+		unsigned int freeSerial = 0;
+		if (slot.cameraSerial.compare_exchange_strong(freeSerial, cameraSerial) || freeSerial == cameraSerial)
+		{
+			return &slot;
+		}
+	}
+	return NULL;
+}
+
+// accept viewers; the timeout lets the loop notice Stop and close finished viewers
+void CFrameStreamServer::_acceptLoop(void)
+{
+	while (m_isRunning)
+	{
+		fd_set readSet;
+		FD_ZERO(&readSet);
+		FD_SET((SOCKET)m_listenSocket, &readSet);
+		timeval timeout = { 0, 200000 };
+		int readyCount = select((int)m_listenSocket + 1, &readSet, NULL, NULL, &timeout);
+		_pruneClients(false);
+		if (readyCount <= 0)
+		{
+			continue;
+		}
+		SOCKET clientSocket = accept((SOCKET)m_listenSocket, NULL, NULL);
+		if (clientSocket == INVALID_SOCKET)
+		{
+			continue;
+		}
+		// a small send buffer keeps a stalled viewer's backlog in its queue,
+		// where old frames are dropped, instead of in the socket
+		int noDelay = 1;
+		int sendBufferSize = 256 * 1024;
+		setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+		setsockopt(clientSocket, SOL_SOCKET, SO_SNDBUF, (const char*)&sendBufferSize, sizeof(sendBufferSize));
+
+		unique_ptr<Client> client(new Client);
+		client->socket = clientSocket;
+		client->droppedFrames = 0;
+		client->isClosed = false;
+		Client* newClient = client.get();
+		lock_guard<mutex> lock(m_clientsMtx);
+		client->sender = thread(&CFrameStreamServer::_sendLoop, this, newClient);
+		m_clients.push_back(move(client));
+		m_clientCount++;
+		cout << "frame stream viewer connected, " << m_clientCount << " watching" << endl;
+	}
+}
+
+// downsample and encode the newest frame of each camera once for all viewers
+void CFrameStreamServer::_encodeLoop(void)
+{
+	Mat workingFrame, smallFrame, streamFrame;
+	vector<int> jpegParams = { IMWRITE_JPEG_QUALITY, m_jpegQuality };
+	while (m_isRunning)
+	{
+		{
+			unique_lock<mutex> lock(m_frameMtx);
+			m_frameReady.wait(lock, [this]() { return m_hasNewFrame; });
+			m_hasNewFrame = false;
+		}
+		for (CameraSlot& slot : m_cameras)
+		{
+			StreamFrameInfo info;
+			{
+				lock_guard<mutex> lock(slot.mtx);
+				if (!slot.hasFrame)
+				{
+					continue;
+				}
+				swap(slot.pending, workingFrame);
+				info = slot.info;
+				slot.hasFrame = false;
+			}
+
+			// preview rate from the frame counters of consecutive streamed frames
+			if (slot.previousInfo.frameCounter != 0 && info.frameTime > slot.previousInfo.frameTime)
+			{
+				slot.frameRate = (float)((info.frameCounter - slot.previousInfo.frameCounter) / (info.frameTime - slot.previousInfo.frameTime));
+			}
+			slot.previousInfo = info;
+
+			resize(workingFrame, smallFrame, Size(), 1.0 / m_downsample, 1.0 / m_downsample, INTER_AREA);
+			if (smallFrame.depth() == CV_16U)
+			{
+				smallFrame.convertTo(streamFrame, CV_8U, 1.0 / 256);
+			}
+			else
+			{
+				streamFrame = smallFrame;
+			}
+			shared_ptr<StreamMessage> message = make_shared<StreamMessage>();
+			if (!imencode(".jpg", streamFrame, message->payload, jpegParams))
+			{
+				continue;
+			}
+			StreamFrameHeader& header = message->header;
+			header.magic = c_streamMagic;
+			header.cameraSerial = info.cameraSerial;
+			header.frameCounter = (unsigned int)info.frameCounter;
+			header.payloadSize = (unsigned int)message->payload.size();
+			header.frameTime = info.frameTime;
+			header.exposureTime_ms = info.exposureTime_ms;
+			header.frameRate = slot.frameRate;
+			header.width = (unsigned short)streamFrame.cols;
+			header.height = (unsigned short)streamFrame.rows;
+			header.sourceWidth = (unsigned short)workingFrame.cols;
+			header.sourceHeight = (unsigned short)workingFrame.rows;
+			header.positionNo = info.positionNo;
+			header.droppedFrames = 0;
+			_broadcast(message);
+		}
+	}
+}
+
+// queue a frame for every viewer; a full queue loses its oldest frame
+void CFrameStreamServer::_broadcast(const shared_ptr<const StreamMessage>& message)
+{
+	lock_guard<mutex> lock(m_clientsMtx);
+	for (unique_ptr<Client>& client : m_clients)
+	{
+		lock_guard<mutex> clientLock(client->mtx);
+		if (client->isClosed)
+		{
+			continue;
+		}
+		if ((int)client->queue.size() >= m_clientQueueFrames)
+		{
+			client->queue.pop_front();
+			client->droppedFrames++;
+		}
+		client->queue.push_back(message);
+		client->queueChanged.notify_one();
+	}
+}
+
+// one thread per viewer, so a viewer on a slow link only delays itself
+void CFrameStreamServer::_sendLoop(Client* client)
+{
+	while (true)
+	{
+		shared_ptr<const StreamMessage> message;
+		unsigned int droppedFrames = 0;
+		{
+			unique_lock<mutex> lock(client->mtx);
+			client->queueChanged.wait(lock, [client]() { return client->isClosed || !client->queue.empty(); });
+			if (client->isClosed)
+			{
+				return;
+			}
+			message = client->queue.front();
+			client->queue.pop_front();
+			droppedFrames = client->droppedFrames;
+		}
+
+		StreamFrameHeader header = message->header;
+		header.droppedFrames = droppedFrames;
+		WSABUF buffers[2];
+		buffers[0].buf = (char*)&header;
+		buffers[0].len = sizeof(header);
+		buffers[1].buf = (char*)message->payload.data();
+		buffers[1].len = (ULONG)message->payload.size();
+		DWORD sentBytes = 0;
+		if (WSASend((SOCKET)client->socket, buffers, 2, &sentBytes, 0, NULL, NULL) == SOCKET_ERROR)
+		{
+			_closeClient(client);
+			return;
+		}
+	}
+}
+
+void CFrameStreamServer::_closeClient(Client* client)
+{
+	lock_guard<mutex> lock(client->mtx);
+	client->isClosed = true;
+	client->queue.clear();
+}
+
+// join and release viewers that left, or all of them when stopping
+void CFrameStreamServer::_pruneClients(bool isStopping)
+{
+	vector<unique_ptr<Client>> closedClients;
+	{
+		lock_guard<mutex> lock(m_clientsMtx);
+		for (auto it = m_clients.begin(); it != m_clients.end();)
+		{
+			bool isClosed = isStopping;
+			{
+				lock_guard<mutex> clientLock((*it)->mtx);
+				isClosed = isClosed || (*it)->isClosed;
+				(*it)->isClosed = isClosed;
+			}
+			if (isClosed)
+			{
+				closedClients.push_back(move(*it));
+				it = m_clients.erase(it);
+				m_clientCount--;
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+	for (unique_ptr<Client>& client : closedClients)
+	{
+		// shutting the socket down ends a send that is stuck on a stalled viewer
+		client->queueChanged.notify_all();
+		shutdown((SOCKET)client->socket, SD_BOTH);
+		client->sender.join();
+		closesocket((SOCKET)client->socket);
+	}
+	if (!closedClients.empty() && !isStopping)
+	{
+		cout << "frame stream viewer left, " << m_clientCount << " watching" << endl;
+	}
+}
+
+
+CFrameStreamClient::CFrameStreamClient(void)
+	: m_socket(c_noSocket)
+{
+}
+
+CFrameStreamClient::~CFrameStreamClient(void)
+{
+	Close();
+}
+
+bool CFrameStreamClient::Connect(const string& host, unsigned short port)
+{
+	Close();
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+	{
+		cout << "Winsock cannot be started" << endl;
+		return false;
+	}
+
+	addrinfo hints = {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	addrinfo* addresses = NULL;
+	if (getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &addresses) != 0)
+	{
+		cout << "cannot resolve " << host << endl;
+		WSACleanup();
+		return false;
+	}
+	for (addrinfo* address = addresses; address != NULL && m_socket == c_noSocket; address = address->ai_next)
+	{
+		SOCKET connection = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+		if (connection == INVALID_SOCKET)
+		{
+			continue;
+		}
+		if (connect(connection, address->ai_addr, (int)address->ai_addrlen) == SOCKET_ERROR)
+		{
+			closesocket(connection);
+			continue;
+		}
+		m_socket = (uintptr_t)connection;
+	}
+	freeaddrinfo(addresses);
+	if (m_socket == c_noSocket)
+	{
+		cout << "cannot connect to " << host << ":" << port << endl;
+		WSACleanup();
+		return false;
+	}
+	return true;
+}
+
+void CFrameStreamClient::Close(void)
+{
+	if (m_socket == c_noSocket)
+	{
+		return;
+	}
+	closesocket((SOCKET)m_socket);
+	m_socket = c_noSocket;
+	WSACleanup();
+}
+
+// wait for the next frame; false once the server is gone
+bool CFrameStreamClient::Receive(StreamFrameHeader& header, Mat& image)
+{
+	if (!IsConnected() || !_receiveAll(&header, sizeof(header)))
+	{
+		return false;
+	}
+	if (header.magic != c_streamMagic)
+	{
+		cout << "frame stream out of sync" << endl;
+		Close();
+		return false;
+	}
+	m_payload.resize(header.payloadSize);
+	if (!_receiveAll(m_payload.data(), m_payload.size()))
+	{
+		return false;
+	}
+	image = imdecode(m_payload, IMREAD_UNCHANGED);
+	return !image.empty();
+}
+
+bool CFrameStreamClient::_receiveAll(void* data, size_t size)
+{
+	size_t receivedSize = 0;
+	while (receivedSize < size)
+	{
+		int chunkSize = (int)(std::min)(size - receivedSize, (size_t)(1 << 20));
+		int result = recv((SOCKET)m_socket, (char*)data + receivedSize, chunkSize, 0);
+		if (result <= 0)
+		{
+			Close();
+			return false;
+		}
+		receivedSize += result;
+	}
+	return true;
+}
@@ -0,0 +1,154 @@
+/*
+	 Live preview for other machines over TCP. The capture threads post
+	 their preview frames; a server thread takes the newest frame of each
+	 camera, downsamples and JPEG encodes it once, and queues it for every
+	 connected client. Each client has its own sender thread and a
+	 bounded queue that drops its oldest frame when the client falls
+	 behind, so a slow viewer never holds up the encoder, the other
+	 viewers or the capture threads. A capture thread only copies a frame
+	 into its camera slot when a client is connected and the stream is
+	 due for a frame, and never waits for the server to do so.
+
+	 Every frame is sent as a StreamFrameHeader followed by payloadSize
+	 bytes of JPEG. CFrameStreamClient is the matching receiver, used by
+	 datasetTool watch.
+*/
+
+#pragma once
+
+#include "opencv2/opencv.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace cv;
+
+static const unsigned int c_streamMagic = 0x52545346;	// "FSTR"
+static const int c_maxStreamCameras = 4;
+static const unsigned short c_defaultStreamPort = 50710;
+
+#pragma pack(push, 1)
+struct StreamFrameHeader
+{
+	unsigned int magic;
+	unsigned int cameraSerial;
+	unsigned int frameCounter;
+	unsigned int payloadSize;		// JPEG bytes following the header
+	double frameTime;				// host time stamp of the frame in seconds
+	float exposureTime_ms;
+	float frameRate;				// preview rate of the camera, from frame counters
+	unsigned short width, height;	// streamed image
+	unsigned short sourceWidth, sourceHeight;
+	int positionNo;					// position being previewed
+	unsigned int droppedFrames;		// frames this client lost to its queue limit
+};
+#pragma pack(pop)
+
+// what a capture thread knows about its preview frame
+struct StreamFrameInfo
+{
+	unsigned int cameraSerial;
+	unsigned long frameCounter;
+	double frameTime;
+	float exposureTime_ms;
+	int positionNo;
+};
+
+class CFrameStreamServer
+{
+public:
+	CFrameStreamServer(void);
+	~CFrameStreamServer(void);
+
+	bool Start(unsigned short port, float streamRate = 10.0f, int downsample = 4, int jpegQuality = 80, int clientQueueFrames = 4);
+	void Stop(void);
+	bool IsRunning(void) const { return m_isRunning; }
+	int GetClientCount(void) const { return m_clientCount; }
+
+	bool PostFrame(const Mat& frame, const StreamFrameInfo& info);
+
+private:
+	struct CameraSlot
+	{
+		atomic<unsigned int> cameraSerial;	// 0 while the slot is free
+		mutex mtx;
+		Mat pending;					// newest posted frame, swapped out by the encoder
+		StreamFrameInfo info;
+		bool hasFrame;
+		chrono::steady_clock::time_point lastPostTime;	// only used by the posting thread
+		StreamFrameInfo previousInfo;	// encoder side, for the frame rate
+		float frameRate;
+	};
+
+	struct StreamMessage
+	{
+		StreamFrameHeader header;
+		vector<uchar> payload;
+	};
+
+	struct Client
+	{
+		uintptr_t socket;
+		mutex mtx;
+		condition_variable queueChanged;
+		deque<shared_ptr<const StreamMessage>> queue;
+		unsigned int droppedFrames;
+		bool isClosed;
+		thread sender;
+	};
+
+	CameraSlot* _slotFor(unsigned int cameraSerial);
+	void _acceptLoop(void);
+	void _encodeLoop(void);
+	void _sendLoop(Client* client);
+	void _broadcast(const shared_ptr<const StreamMessage>& message);
+	void _closeClient(Client* client);
+	void _pruneClients(bool isStopping);
+
+	atomic<bool> m_isRunning;
+	atomic<int> m_clientCount;
+	uintptr_t m_listenSocket;
+	float m_streamRate;
+	int m_downsample;
+	int m_jpegQuality;
+	int m_clientQueueFrames;
+
+	CameraSlot m_cameras[c_maxStreamCameras];
+	mutex m_frameMtx;				// wakes the encoder when a frame was posted
+	condition_variable m_frameReady;
+	bool m_hasNewFrame;
+
+	mutex m_clientsMtx;
+	vector<unique_ptr<Client>> m_clients;
+
+	thread m_acceptThread;
+	thread m_encodeThread;
+};
+
+class CFrameStreamClient
+{
+public:
+	CFrameStreamClient(void);
+	~CFrameStreamClient(void);
+
+	bool Connect(const string& host, unsigned short port);
+	void Close(void);
+	bool IsConnected(void) const { return m_socket != c_noSocket; }
+
+	bool Receive(StreamFrameHeader& header, Mat& image);
+
+private:
+	static const uintptr_t c_noSocket = ~(uintptr_t)0;
+
+	bool _receiveAll(void* data, size_t size);
+
+	uintptr_t m_socket;
+	vector<uchar> m_payload;
+};
@@ -0,0 +1,190 @@
+#include "FrameTrace.h"
+#include <cstdio>
+#include <iostream>
+#include <set>
+
+using namespace std;
+
+static const char* c_stageNames[TRACE_STAGE_COUNT] = { "retrieve", "hand-off", "process", "encode", "write", "skip", "recover" };
+
+// ids of traces started in this process, 0 marks an empty thread cache
+static atomic<unsigned int> s_nextTraceId(1);
+
+
+CFrameTrace::CFrameTrace(void)
+	: m_isEnabled(false), m_traceId(0), m_recordsPerThread(0), m_startTime(chrono::steady_clock::now())
+{
+}
+
+CFrameTrace::~CFrameTrace(void)
+{
+}
+
+// start a new trace; call before the camera threads start recording
+void CFrameTrace::Start(int recordsPerThread)
+{
+	lock_guard<mutex> lock(m_bufferMutex);
+	m_buffers.clear();
+	m_recordsPerThread = recordsPerThread > 0 ? recordsPerThread : 1;
+	m_traceId = s_nextTraceId++;
+	m_startTime = chrono::steady_clock::now();
+	m_isEnabled = true;
+}
+
+// host steady clock in us since Start
+long long CFrameTrace::Now(void) const
+{
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - m_startTime).count();
+}
+
+// the calling thread's buffer; each thread caches the buffer of the trace it
+// recorded last, so only the first record of a thread takes the lock
+CFrameTrace::ThreadBuffer* CFrameTrace::_threadBuffer(void)
+{
+	thread_local unsigned int t_traceId = 0;
+	thread_local ThreadBuffer* t_buffer = nullptr;
+	if (t_traceId != m_traceId)
+	{
+		unique_ptr<ThreadBuffer> buffer(new ThreadBuffer);
+		buffer->records.resize(m_recordsPerThread);
+		buffer->count = 0;
+		buffer->dropped = 0;
+		lock_guard<mutex> lock(m_bufferMutex);
+		t_buffer = buffer.get();
+		t_traceId = m_traceId;
+		m_buffers.push_back(move(buffer));
+	}
+	return t_buffer;
+}
+
+//--------------------------------------------------------------------
+// Record one stage of a frame
+// Input:
+//		cameraTime		= embedded time stamp register of the frame
+//		start_us/end_us	= host times from Now()
+//		frameCount		= frames covered, for stages that run per set
+// a full thread buffer drops the record and counts it
+//--------------------------------------------------------------------
+void CFrameTrace::Record(unsigned int cameraSerial, FrameTraceStage stage, unsigned long frameCounter,
+	unsigned int cameraTime, long long start_us, long long end_us, int frameCount)
+{
+	if (!m_isEnabled)
+	{
+		return;
+	}
+	ThreadBuffer* buffer = _threadBuffer();
+	int index = buffer->count.load(memory_order_relaxed);
+	if (index >= (int)buffer->records.size())
+	{
+		buffer->dropped.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+	FrameTraceRecord& record = buffer->records[index];
+	record.cameraSerial = cameraSerial;
+	record.stage = stage;
+	record.frameCounter = frameCounter;
+	record.frameCount = frameCount;
+	record.cameraTime = cameraTime;
+	record.start_us = start_us;
+	record.end_us = end_us;
+	// the exporter reads up to count, so publish after the record is complete
+	buffer->count.store(index + 1, memory_order_release);
+}
+
+// mark a frame counter jump on the timeline, at the frame after the gap
+void CFrameTrace::RecordSkip(unsigned int cameraSerial, unsigned long frameCounter, int skippedFrames)
+{
+	long long now = Now();
+	Record(cameraSerial, TRACE_SKIP, frameCounter, 0, now, now, skippedFrames);
+}
+
+// embedded time stamp: 7 bits seconds, 13 bits 8 kHz cycles, 12 bits cycle offset
+static double cameraTime_us(unsigned int cameraTime)
+{
+	unsigned int seconds = cameraTime >> 25;
+	unsigned int cycleCount = (cameraTime >> 12) & 0x1FFF;
+	unsigned int cycleOffset = cameraTime & 0xFFF;
+	return seconds * 1e6 + cycleCount * 125.0 + cycleOffset * 125.0 / 3072.0;
+}
+
+//--------------------------------------------------------------------
+// Write the records in Chrome trace-event JSON
+// pid is the camera serial and tid the stage, so both camera pipelines
+// show side by side with one track per stage; may be called while
+// threads still record, it then writes what was published so far
+//--------------------------------------------------------------------
+bool CFrameTrace::WriteChromeTrace(const string& fileName) const
+{
+	FILE* traceFile = fopen(fileName.c_str(), "w");
+	if (!traceFile)
+	{
+		cout << "cannot write trace " << fileName << endl;
+		return false;
+	}
+
+	lock_guard<mutex> lock(m_bufferMutex);
+	fprintf(traceFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	set<unsigned int> cameraSerials;
+	int recordCount = 0;
+	int droppedCount = 0;
+	bool isFirstEvent = true;
+	for (const unique_ptr<ThreadBuffer>& buffer : m_buffers)
+	{
+		int count = buffer->count.load(memory_order_acquire);
+		droppedCount += buffer->dropped.load(memory_order_relaxed);
+		for (int i = 0; i < count; i++)
+		{
+			const FrameTraceRecord& record = buffer->records[i];
+			cameraSerials.insert(record.cameraSerial);
+			fprintf(traceFile, "%s{\"name\":\"%s\",\"cat\":\"frame\",", isFirstEvent ? "" : ",\n", c_stageNames[record.stage]);
+			if (record.stage == TRACE_SKIP)
+			{
+				fprintf(traceFile, "\"ph\":\"i\",\"s\":\"p\",\"pid\":%u,\"tid\":%d,\"ts\":%lld,\"args\":{\"frame\":%lu,\"skipped\":%d}}",
+					record.cameraSerial, record.stage, record.start_us, record.frameCounter, record.frameCount);
+			}
+			else if (record.stage == TRACE_RECOVER)
+			{
+				fprintf(traceFile, "\"ph\":\"X\",\"pid\":%u,\"tid\":%d,\"ts\":%lld,\"dur\":%lld,\"args\":{\"frame\":%lu,\"error\":%d}}",
+					record.cameraSerial, record.stage, record.start_us, record.end_us - record.start_us, record.frameCounter, record.frameCount);
+			}
+			else
+			{
+				fprintf(traceFile, "\"ph\":\"X\",\"pid\":%u,\"tid\":%d,\"ts\":%lld,\"dur\":%lld,\"args\":{\"frame\":%lu,\"frames\":%d",
+					record.cameraSerial, record.stage, record.start_us, record.end_us - record.start_us, record.frameCounter, record.frameCount);
+				if (record.cameraTime != 0)
+				{
+					fprintf(traceFile, ",\"camera_us\":%.1f", cameraTime_us(record.cameraTime));
+				}
+				fprintf(traceFile, "}}");
+			}
+			isFirstEvent = false;
+			recordCount++;
+		}
+	}
+
+	// name the camera processes and the stage tracks
+	for (unsigned int cameraSerial : cameraSerials)
+	{
+		fprintf(traceFile, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"camera %u\"}}",
+			isFirstEvent ? "" : ",\n", cameraSerial, cameraSerial);
+		isFirstEvent = false;
+		for (int stage = 0; stage < TRACE_STAGE_COUNT; stage++)
+		{
+			fprintf(traceFile, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+				cameraSerial, stage, c_stageNames[stage]);
+			fprintf(traceFile, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":%u,\"tid\":%d,\"args\":{\"sort_index\":%d}}",
+				cameraSerial, stage, stage);
+		}
+	}
+	fprintf(traceFile, "\n]}\n");
+	bool isWritten = ferror(traceFile) == 0;
+	fclose(traceFile);
+
+	cout << recordCount << " trace records written to " << fileName;
+	if (droppedCount > 0)
+	{
+		cout << ", " << droppedCount << " dropped on full buffers";
+	}
+	cout << endl;
+	return isWritten;
+}
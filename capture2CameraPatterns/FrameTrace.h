@@ -0,0 +1,81 @@
+/*
+	 Per-frame latency trace from the camera to the disk. Each stage of a
+	 frame (retrieve from the driver, hand-off into the set buffer, set
+	 processing, PNG encode, durable write) is recorded with the camera
+	 serial, the embedded frame counter, the embedded camera time stamp
+	 and host steady clock times. Every thread appends to its own fixed
+	 size buffer, so recording takes no lock; the buffers are exported
+	 as Chrome trace-event JSON (chrome://tracing, Perfetto) with one
+	 process per camera and one track per stage.
+	 Frames of a saved set are keyed by the first frame counter of the
+	 set plus their index in the saved set. Stream recoveries are keyed
+	 by the last frame before the failure.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum FrameTraceStage
+{
+	TRACE_RETRIEVE,
+	TRACE_HANDOFF,
+	TRACE_PROCESS,
+	TRACE_ENCODE,
+	TRACE_WRITE,
+	TRACE_SKIP,			// instant event: the frame counter jumped
+	TRACE_RECOVER,		// a failed stream was restarted, frameCount holds the error type
+	TRACE_STAGE_COUNT
+};
+
+struct FrameTraceRecord
+{
+	unsigned int cameraSerial;
+	int stage;
+	unsigned long frameCounter;
+	int frameCount;			// frames covered by a set stage, frames missed by a skip
+	unsigned int cameraTime;	// embedded time stamp register, 0 when not embedded
+	long long start_us;		// host steady clock since Start
+	long long end_us;
+};
+
+class CFrameTrace
+{
+public:
+	CFrameTrace(void);
+	~CFrameTrace(void);
+
+	void Start(int recordsPerThread = 65536);
+	void Stop(void) { m_isEnabled = false; }
+	bool IsEnabled(void) const { return m_isEnabled; }
+
+	long long Now(void) const;
+	void Record(unsigned int cameraSerial, FrameTraceStage stage, unsigned long frameCounter,
+		unsigned int cameraTime, long long start_us, long long end_us, int frameCount = 1);
+	void RecordSkip(unsigned int cameraSerial, unsigned long frameCounter, int skippedFrames);
+
+	bool WriteChromeTrace(const std::string& fileName) const;
+
+private:
+	struct ThreadBuffer
+	{
+		std::vector<FrameTraceRecord> records;
+		std::atomic<int> count;		// records published to the exporter
+		std::atomic<int> dropped;
+	};
+
+	ThreadBuffer* _threadBuffer(void);
+
+	std::atomic<bool> m_isEnabled;
+	unsigned int m_traceId;		// tells thread caches of different traces apart
+	int m_recordsPerThread;
+	std::chrono::steady_clock::time_point m_startTime;
+
+	mutable std::mutex m_bufferMutex;	// only taken when a thread records its first frame
+	std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;
+};
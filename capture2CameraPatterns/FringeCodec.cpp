@@ -0,0 +1,951 @@
+#include "FringeCodec.h"
+#include "FringeKernels.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+static const char c_fscMagic[4] = { 'F', 'S', 'C', '1' };
+static const unsigned short c_fscVersion = 1;
+
+// residual tokens: values below 16 are coded directly, larger ones by
+// their bit length and second highest bit, followed by the lower bits
+static const int c_directTokens = 16;
+static const int c_tokenCount = 48;
+
+// rANS with 12-bit probabilities, 32-bit state and byte renormalization
+static const int c_probabilityBits = 12;
+static const unsigned int c_probabilityScale = 1 << c_probabilityBits;
+static const unsigned int c_ransLow = 1u << 23;
+
+// residual rows sampled to choose the predictor of a band
+static const int c_sampleRowStep = 8;
+// fixed point of the sinusoid predictor coefficients
+static const int c_coefficientBits = 10;
+
+enum BandPredictor
+{
+	PREDICT_INTRA = 0,
+	PREDICT_PREVIOUS = 1,
+	PREDICT_SINUSOID = 2,
+};
+
+#pragma pack(push, 1)
+struct FscFileHeader
+{
+	char magic[4];
+	unsigned short version;
+	unsigned short bytesPerPixel;
+	unsigned int width;
+	unsigned int height;
+	unsigned int frameCount;
+	unsigned int bandRows;
+	unsigned int keyframeInterval;
+};
+
+struct FscChunkEntry
+{
+	unsigned long long offset;		// from the start of the file
+	unsigned int size;
+};
+
+// followed by tokenCount 16-bit frequencies, the rANS bytes and the raw bits
+struct FscBandHeader
+{
+	unsigned char predictor;
+	unsigned char shift;			// zero low bits dropped from every pixel
+	unsigned short tokenCount;
+	int coefficients[3];			// sinusoid a1, a2 (fixed point) and a0 (fixed point, shifted units)
+	unsigned int ransBytes;
+	unsigned int bitBytes;
+};
+#pragma pack(pop)
+
+
+// bits appended least significant first, 32 at a time into bytes sized
+// for maxBits; Flush trims bytes to what was written
+class CBitWriter
+{
+public:
+	CBitWriter(vector<unsigned char>& bytes, size_t maxBits) : m_bytes(bytes), m_size(0), m_buffer(0), m_bitCount(0)
+	{
+		m_bytes.resize(maxBits / 8 + 8);
+	}
+
+	void Write(unsigned int value, int bitCount)
+	{
+		m_buffer |= (unsigned long long)value << m_bitCount;
+		m_bitCount += bitCount;
+		if (m_bitCount >= 32)
+		{
+			unsigned char* out = m_bytes.data() + m_size;
+			out[0] = (unsigned char)m_buffer;
+			out[1] = (unsigned char)(m_buffer >> 8);
+			out[2] = (unsigned char)(m_buffer >> 16);
+			out[3] = (unsigned char)(m_buffer >> 24);
+			m_size += 4;
+			m_buffer >>= 32;
+			m_bitCount -= 32;
+		}
+	}
+
+	void Flush(void)
+	{
+		for (; m_bitCount > 0; m_bitCount -= 8)
+		{
+			m_bytes[m_size++] = (unsigned char)m_buffer;
+			m_buffer >>= 8;
+		}
+		m_bytes.resize(m_size);
+		m_bitCount = 0;
+	}
+
+private:
+	vector<unsigned char>& m_bytes;
+	size_t m_size;
+	unsigned long long m_buffer;
+	int m_bitCount;
+};
+
+// reads past the end return zero bits, the token count bounds the reads
+class CBitReader
+{
+public:
+	CBitReader(const unsigned char* data, size_t size) : m_data(data), m_end(data + size), m_buffer(0), m_bitCount(0) {}
+
+	unsigned int Read(int bitCount)
+	{
+		if (m_bitCount < bitCount)
+		{
+			while (m_bitCount <= 56)
+			{
+				unsigned long long byte = m_data < m_end ? *m_data++ : 0;
+				m_buffer |= byte << m_bitCount;
+				m_bitCount += 8;
+			}
+		}
+		unsigned int value = (unsigned int)(m_buffer & ((1ull << bitCount) - 1));
+		m_buffer >>= bitCount;
+		m_bitCount -= bitCount;
+		return value;
+	}
+
+private:
+	const unsigned char* m_data;
+	const unsigned char* m_end;
+	unsigned long long m_buffer;
+	int m_bitCount;
+};
+
+static inline int bitLength(unsigned int value)
+{
+	int length = 0;
+	while (value)
+	{
+		length++;
+		value >>= 1;
+	}
+	return length;
+}
+
+static inline unsigned int zigzag(int value)
+{
+	return value >= 0 ? (unsigned int)value << 1 : ((unsigned int)(-value) << 1) - 1;
+}
+
+static inline int unzigzag(unsigned int value)
+{
+	return (value & 1) ? -(int)((value + 1) >> 1) : (int)(value >> 1);
+}
+
+// token, low bit count and bit length of the small values, which are
+// nearly all residuals
+static const unsigned int c_tokenTableSize = 1 << 12;
+struct TokenTable
+{
+	unsigned char token[c_tokenTableSize];
+	unsigned char extraBits[c_tokenTableSize];
+	unsigned char length[c_tokenTableSize];
+
+	TokenTable(void)
+	{
+		for (unsigned int value = 0; value < c_tokenTableSize; value++)
+		{
+			length[value] = (unsigned char)bitLength(value);
+			extraBits[value] = value < c_directTokens ? 0 : (unsigned char)(length[value] - 2);
+			token[value] = value < c_directTokens ? (unsigned char)value :
+				(unsigned char)(c_directTokens + (length[value] - 5) * 2 + ((value >> (length[value] - 2)) & 1));
+		}
+	}
+};
+
+static const TokenTable& tokenTable(void)
+{
+	static const TokenTable table;
+	return table;
+}
+
+static inline int tokenFor(const TokenTable& table, unsigned int value, int& extraBits)
+{
+	if (value < c_tokenTableSize)
+	{
+		extraBits = table.extraBits[value];
+		return table.token[value];
+	}
+	int length = bitLength(value);
+	extraBits = length - 2;
+	return c_directTokens + (length - 5) * 2 + (int)((value >> (length - 2)) & 1);
+}
+
+static inline unsigned int valueFor(int token, unsigned int lowBits)
+{
+	if (token < c_directTokens)
+	{
+		return (unsigned int)token;
+	}
+	int length = (token - c_directTokens) / 2 + 5;
+	unsigned int topBits = 2 | (unsigned int)((token - c_directTokens) & 1);
+	return (topBits << (length - 2)) | lowBits;
+}
+
+// LOCO-I median edge detector on the difference image, written as the
+// planar prediction clamped to its left and upper neighbours
+static inline int medPrediction(int left, int up, int upLeft)
+{
+	int planar = left + up - upLeft;
+	int low = left < up ? left : up;
+	int high = left < up ? up : left;
+	return planar < low ? low : (planar > high ? high : planar);
+}
+
+// prediction of one pixel before the spatial step, in shifted units
+struct BandReference
+{
+	int predictor;
+	int shift;
+	int maxValue;
+	int coefficients[3];
+
+	// one row of predictions, one loop per predictor so each one vectorizes
+	template <typename T>
+	void PredictRow(const T* previous, const T* beforePrevious, int width, int* predicted) const
+	{
+		if (predictor == PREDICT_PREVIOUS)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				predicted[x] = previous[x] >> shift;
+			}
+		}
+		else if (predictor == PREDICT_SINUSOID)
+		{
+			const int rounding = (1 << (c_coefficientBits - 1)) + coefficients[2];
+			for (int x = 0; x < width; x++)
+			{
+				int value = (coefficients[0] * (previous[x] >> shift) + coefficients[1] * (beforePrevious[x] >> shift) + rounding) >> c_coefficientBits;
+				predicted[x] = value < 0 ? 0 : (value > maxValue ? maxValue : value);
+			}
+		}
+		else
+		{
+			memset(predicted, 0, width * sizeof(int));
+		}
+	}
+};
+
+// difference rows of a band; the spatial step needs the row above
+template <typename T>
+static void differenceRow(const T* current, const T* previous, const T* beforePrevious, int width, const BandReference& reference, int* difference)
+{
+	reference.PredictRow(previous, beforePrevious, width, difference);
+	for (int x = 0; x < width; x++)
+	{
+		difference[x] = (current[x] >> reference.shift) - difference[x];
+	}
+}
+
+// zigzag residuals of a difference row after the spatial prediction; the
+// first row is predicted from the left only, the first column from above
+static void residualRow(const int* difference, const int* upDifference, int width, unsigned int* residuals)
+{
+	if (upDifference == NULL)
+	{
+		residuals[0] = zigzag(difference[0]);
+		for (int x = 1; x < width; x++)
+		{
+			residuals[x] = zigzag(difference[x] - difference[x - 1]);
+		}
+		return;
+	}
+	residuals[0] = zigzag(difference[0] - upDifference[0]);
+	FringeKernels::medResidualRow(difference, upDifference, width, residuals);
+}
+
+// rANS encoder symbol with the division replaced by a reciprocal multiply
+// (F. Giesen, ryg_rans)
+struct RansEncoderSymbol
+{
+	unsigned int stateMax;
+	unsigned int reciprocal;
+	unsigned int bias;
+	unsigned int complement;
+	int reciprocalShift;
+
+	void Init(unsigned int start, unsigned int frequency)
+	{
+		stateMax = ((c_ransLow >> c_probabilityBits) << 8) * frequency;
+		complement = c_probabilityScale - frequency;
+		if (frequency < 2)
+		{
+			reciprocal = ~0u;
+			reciprocalShift = 0;
+			bias = start + c_probabilityScale - 1;
+		}
+		else
+		{
+			int shift = 0;
+			while (frequency > (1u << shift)) shift++;
+			reciprocal = (unsigned int)(((1ull << (shift + 31)) + frequency - 1) / frequency);
+			reciprocalShift = shift - 1;
+			bias = start;
+		}
+	}
+
+	inline void Encode(unsigned int& state, unsigned char*& out) const
+	{
+		while (state >= stateMax)
+		{
+			*--out = (unsigned char)state;
+			state >>= 8;
+		}
+		unsigned int quotient = (unsigned int)(((unsigned long long)state * reciprocal) >> 32) >> reciprocalShift;
+		state += bias + quotient * complement;
+	}
+};
+
+// bits a reference would need, estimated from the residual bit lengths of sampled rows
+template <typename T>
+static long long sampleCost(const T* current, const T* previous, const T* beforePrevious, int width, int rows,
+	const BandReference& reference, vector<int>& rowBuffer)
+{
+	const TokenTable& table = tokenTable();
+	rowBuffer.resize((size_t)width * 3);
+	int* upDifference = rowBuffer.data();
+	int* difference = upDifference + width;
+	unsigned int* residuals = (unsigned int*)(difference + width);
+	long long cost = 0;
+	for (int y = 1; y < rows; y += c_sampleRowStep)
+	{
+		size_t rowOffset = (size_t)y * width;
+		differenceRow(current + rowOffset - width, previous ? previous + rowOffset - width : NULL,
+			beforePrevious ? beforePrevious + rowOffset - width : NULL, width, reference, upDifference);
+		differenceRow(current + rowOffset, previous ? previous + rowOffset : NULL,
+			beforePrevious ? beforePrevious + rowOffset : NULL, width, reference, difference);
+		residualRow(difference, upDifference, width, residuals);
+		for (int x = 0; x < width; x++)
+		{
+			cost += residuals[x] < c_tokenTableSize ? table.length[residuals[x]] : bitLength(residuals[x]);
+		}
+	}
+	return cost;
+}
+
+// least squares fit of current ~ a1 * previous + a2 * beforePrevious + a0 on sampled pixels
+template <typename T>
+static bool fitSinusoid(const T* current, const T* previous, const T* beforePrevious, int width, int rows, int shift, int coefficients[3])
+{
+	double s[3][3] = {}, t[3] = {};
+	for (int y = 0; y < rows; y += c_sampleRowStep / 2)
+	{
+		size_t rowOffset = (size_t)y * width;
+		for (int x = 0; x < width; x += 2)
+		{
+			double p1 = previous[rowOffset + x] >> shift;
+			double p2 = beforePrevious[rowOffset + x] >> shift;
+			double v = current[rowOffset + x] >> shift;
+			double basis[3] = { p1, p2, 1.0 };
+			for (int i = 0; i < 3; i++)
+			{
+				for (int j = 0; j < 3; j++) s[i][j] += basis[i] * basis[j];
+				t[i] += basis[i] * v;
+			}
+		}
+	}
+	// Cramer's rule
+	double determinant = s[0][0] * (s[1][1] * s[2][2] - s[1][2] * s[2][1]) - s[0][1] * (s[1][0] * s[2][2] - s[1][2] * s[2][0]) +
+		s[0][2] * (s[1][0] * s[2][1] - s[1][1] * s[2][0]);
+	if (fabs(determinant) < 1e-6 * (s[0][0] * s[1][1] * s[2][2] + 1.0))
+	{
+		return false;
+	}
+	double solution[3];
+	for (int c = 0; c < 3; c++)
+	{
+		double m[3][3];
+		memcpy(m, s, sizeof(m));
+		for (int r = 0; r < 3; r++) m[r][c] = t[r];
+		solution[c] = (m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+			m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0])) / determinant;
+	}
+	// bounded so the fixed point sum stays within 32 bits
+	const double scale = 1 << c_coefficientBits;
+	coefficients[0] = (int)(std::max)(-8192.0, (std::min)(8192.0, floor(solution[0] * scale + 0.5)));
+	coefficients[1] = (int)(std::max)(-8192.0, (std::min)(8192.0, floor(solution[1] * scale + 0.5)));
+	coefficients[2] = (int)(std::max)(-67108864.0, (std::min)(67108864.0, floor(solution[2] * scale + 0.5)));
+	return true;
+}
+
+// scale token counts to frequencies summing to c_probabilityScale, every used token at least 1
+static void normalizeFrequencies(const unsigned int counts[], int tokenCount, unsigned short frequencies[])
+{
+	unsigned long long total = 0;
+	for (int s = 0; s < tokenCount; s++) total += counts[s];
+	int sum = 0;
+	int largest = 0;
+	for (int s = 0; s < tokenCount; s++)
+	{
+		frequencies[s] = counts[s] == 0 ? 0 : (unsigned short)(std::max)(1ull, counts[s] * c_probabilityScale / total);
+		sum += frequencies[s];
+		if (counts[s] > counts[largest]) largest = s;
+	}
+	frequencies[largest] = (unsigned short)(frequencies[largest] + (int)c_probabilityScale - sum);
+}
+
+//--------------------------------------------------------------------
+// Encode one band of a frame
+// Input:
+//		previous/beforePrevious	= the band in the two frames before, NULL
+//								  after a keyframe
+// Output:
+//		chunk					= FscBandHeader, frequencies, rANS bytes, raw bits
+//--------------------------------------------------------------------
+template <typename T>
+static void encodeBand(const T* current, const T* previous, const T* beforePrevious, int width, int rows, vector<unsigned char>& chunk)
+{
+	size_t pixelCount = (size_t)width * rows;
+
+	// zero low bits of the whole band are not coded
+	unsigned int usedBits = 0;
+	for (size_t i = 0; i < pixelCount; i++) usedBits |= current[i];
+	int shift = 0;
+	while (usedBits != 0 && shift < (int)sizeof(T) * 8 - 1 && !(usedBits & (1u << shift))) shift++;
+
+	BandReference reference;
+	reference.predictor = PREDICT_INTRA;
+	reference.shift = shift;
+	reference.maxValue = ((1 << (sizeof(T) * 8)) - 1) >> shift;
+	memset(reference.coefficients, 0, sizeof(reference.coefficients));
+
+	vector<int> rowBuffer;
+	if (previous != NULL)
+	{
+		long long bestCost = sampleCost(current, (const T*)NULL, (const T*)NULL, width, rows, reference, rowBuffer);
+		BandReference candidate = reference;
+		candidate.predictor = PREDICT_PREVIOUS;
+		long long cost = sampleCost(current, previous, (const T*)NULL, width, rows, candidate, rowBuffer);
+		if (cost < bestCost)
+		{
+			bestCost = cost;
+			reference = candidate;
+		}
+		candidate.predictor = PREDICT_SINUSOID;
+		if (beforePrevious != NULL && fitSinusoid(current, previous, beforePrevious, width, rows, shift, candidate.coefficients))
+		{
+			cost = sampleCost(current, previous, beforePrevious, width, rows, candidate, rowBuffer);
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				reference = candidate;
+			}
+		}
+	}
+
+	// residual tokens in pixel order, their low bits go straight to the bit stream
+	vector<unsigned char> tokens(pixelCount);
+	// at most 17 low bits per pixel, for 16-bit residuals
+	vector<unsigned char> bitBytes;
+	CBitWriter bits(bitBytes, pixelCount * 17);
+	const TokenTable& table = tokenTable();
+	unsigned int counts[c_tokenCount] = {};
+	rowBuffer.resize((size_t)width * 3);
+	int* upDifference = NULL;
+	int* difference = rowBuffer.data();
+	unsigned int* residuals = (unsigned int*)(rowBuffer.data() + width * 2);
+	for (int y = 0; y < rows; y++)
+	{
+		size_t rowOffset = (size_t)y * width;
+		differenceRow(current + rowOffset, previous ? previous + rowOffset : NULL,
+			beforePrevious ? beforePrevious + rowOffset : NULL, width, reference, difference);
+		residualRow(difference, upDifference, width, residuals);
+		unsigned char* rowTokens = tokens.data() + rowOffset;
+		for (int x = 0; x < width; x++)
+		{
+			unsigned int value = residuals[x];
+			int extraBits;
+			int token = tokenFor(table, value, extraBits);
+			rowTokens[x] = (unsigned char)token;
+			counts[token]++;
+			if (extraBits > 0)
+			{
+				bits.Write(value & ((1u << extraBits) - 1), extraBits);
+			}
+		}
+		upDifference = difference;
+		difference = rowBuffer.data() + (difference == rowBuffer.data() ? width : 0);
+	}
+	bits.Flush();
+
+	int tokenCount = c_tokenCount;
+	while (tokenCount > 1 && counts[tokenCount - 1] == 0) tokenCount--;
+	unsigned short frequencies[c_tokenCount] = {};
+	normalizeFrequencies(counts, tokenCount, frequencies);
+	RansEncoderSymbol symbols[c_tokenCount];
+	unsigned int start = 0;
+	for (int s = 0; s < tokenCount; s++)
+	{
+		symbols[s].Init(start, (std::max)(frequencies[s], (unsigned short)1));
+		start += frequencies[s];
+	}
+
+	// rANS codes backwards, so the decoder reads the tokens in pixel order
+	vector<unsigned char> ransBytes(pixelCount * 3 + 16);
+	unsigned char* end = ransBytes.data() + ransBytes.size();
+	unsigned char* out = end;
+	unsigned int state = c_ransLow;
+	for (size_t i = pixelCount; i-- > 0;)
+	{
+		symbols[tokens[i]].Encode(state, out);
+	}
+	out -= 4;
+	out[0] = (unsigned char)state;
+	out[1] = (unsigned char)(state >> 8);
+	out[2] = (unsigned char)(state >> 16);
+	out[3] = (unsigned char)(state >> 24);
+
+	FscBandHeader header;
+	header.predictor = (unsigned char)reference.predictor;
+	header.shift = (unsigned char)shift;
+	header.tokenCount = (unsigned short)tokenCount;
+	memcpy(header.coefficients, reference.coefficients, sizeof(header.coefficients));
+	header.ransBytes = (unsigned int)(end - out);
+	header.bitBytes = (unsigned int)bitBytes.size();
+
+	chunk.clear();
+	chunk.reserve(sizeof(header) + tokenCount * sizeof(unsigned short) + header.ransBytes + header.bitBytes);
+	chunk.insert(chunk.end(), (const unsigned char*)&header, (const unsigned char*)(&header + 1));
+	chunk.insert(chunk.end(), (const unsigned char*)frequencies, (const unsigned char*)(frequencies + tokenCount));
+	chunk.insert(chunk.end(), out, end);
+	chunk.insert(chunk.end(), bitBytes.begin(), bitBytes.end());
+}
+
+// decode one band; false if the chunk does not hold a valid band
+template <typename T>
+static bool decodeBand(const unsigned char* chunk, size_t chunkSize, const T* previous, const T* beforePrevious, int width, int rows, T* current)
+{
+	FscBandHeader header;
+	if (chunkSize < sizeof(header))
+	{
+		return false;
+	}
+	memcpy(&header, chunk, sizeof(header));
+	size_t frequencyBytes = header.tokenCount * sizeof(unsigned short);
+	if (header.tokenCount == 0 || header.tokenCount > c_tokenCount || header.shift >= sizeof(T) * 8 || header.predictor > PREDICT_SINUSOID ||
+		header.ransBytes < 4 || sizeof(header) + frequencyBytes + header.ransBytes + (size_t)header.bitBytes > chunkSize ||
+		(header.predictor != PREDICT_INTRA && previous == NULL) || (header.predictor == PREDICT_SINUSOID && beforePrevious == NULL))
+	{
+		return false;
+	}
+
+	unsigned short frequencies[c_tokenCount] = {};
+	unsigned int starts[c_tokenCount] = {};
+	memcpy(frequencies, chunk + sizeof(header), frequencyBytes);
+	unsigned int total = 0;
+	for (int s = 0; s < header.tokenCount; s++)
+	{
+		starts[s] = total;
+		total += frequencies[s];
+	}
+	if (total != c_probabilityScale)
+	{
+		return false;
+	}
+	unsigned char slotTokens[c_probabilityScale];
+	for (int s = 0; s < header.tokenCount; s++)
+	{
+		memset(slotTokens + starts[s], s, frequencies[s]);
+	}
+
+	BandReference reference;
+	reference.predictor = header.predictor;
+	reference.shift = header.shift;
+	reference.maxValue = ((1 << (sizeof(T) * 8)) - 1) >> header.shift;
+	memcpy(reference.coefficients, header.coefficients, sizeof(reference.coefficients));
+
+	const unsigned char* ransData = chunk + sizeof(header) + frequencyBytes;
+	const unsigned char* ransEnd = ransData + header.ransBytes;
+	unsigned int state = ransData[0] | (ransData[1] << 8) | (ransData[2] << 16) | ((unsigned int)ransData[3] << 24);
+	ransData += 4;
+	CBitReader bits(ransEnd, header.bitBytes);
+
+	vector<int> rowBuffer((size_t)width * 3);
+	int* upDifference = NULL;
+	int* difference = rowBuffer.data();
+	int* predicted = rowBuffer.data() + width * 2;
+	for (int y = 0; y < rows; y++)
+	{
+		size_t rowOffset = (size_t)y * width;
+		reference.PredictRow(previous ? previous + rowOffset : NULL, beforePrevious ? beforePrevious + rowOffset : NULL, width, predicted);
+		T* currentRow = current + rowOffset;
+		for (int x = 0; x < width; x++)
+		{
+			unsigned int slot = state & (c_probabilityScale - 1);
+			int token = slotTokens[slot];
+			state = frequencies[token] * (state >> c_probabilityBits) + slot - starts[token];
+			while (state < c_ransLow && ransData < ransEnd)
+			{
+				state = (state << 8) | *ransData++;
+			}
+			int extraBits = token < c_directTokens ? 0 : (token - c_directTokens) / 2 + 3;
+			unsigned int value = valueFor(token, extraBits > 0 ? bits.Read(extraBits) : 0);
+			int spatial = upDifference == NULL ? (x > 0 ? difference[x - 1] : 0) :
+				(x > 0 ? medPrediction(difference[x - 1], upDifference[x], upDifference[x - 1]) : upDifference[0]);
+			difference[x] = unzigzag(value) + spatial;
+			int pixel = difference[x] + predicted[x];
+			if (pixel < 0 || pixel > reference.maxValue)
+			{
+				return false;
+			}
+			currentRow[x] = (T)(pixel << header.shift);
+		}
+		upDifference = difference;
+		difference = rowBuffer.data() + (difference == rowBuffer.data() ? width : 0);
+	}
+	return true;
+}
+
+// run task(0 .. taskCount - 1) on up to nThreads threads
+static void runTasks(int taskCount, int nThreads, const function<void(int)>& task)
+{
+	atomic<int> nextTask(0);
+	auto worker = [&]()
+	{
+		for (int t = nextTask++; t < taskCount; t = nextTask++)
+		{
+			task(t);
+		}
+	};
+	int nWorkers = (std::max)(1, (std::min)(nThreads, taskCount));
+	vector<thread> workers;
+	for (int w = 1; w < nWorkers; w++)
+	{
+		workers.push_back(thread(worker));
+	}
+	worker();
+	for (auto& workerThread : workers)
+	{
+		workerThread.join();
+	}
+}
+
+
+CFringeCodec::CFringeCodec(int nThreads, int bandRows, int keyframeInterval)
+{
+	m_nThreads = nThreads > 0 ? nThreads : (int)thread::hardware_concurrency();
+	if (m_nThreads < 1) m_nThreads = 1;
+	m_bandRows = (std::max)(bandRows, 1);
+	m_keyframeInterval = (std::max)(keyframeInterval, 1);
+}
+
+CFringeCodec::~CFringeCodec(void)
+{
+}
+
+//--------------------------------------------------------------------
+// Encode a set
+// Input:
+//		frames		= frames of one size, CV_8UC1 or CV_16UC1
+// Output:
+//		encodedData	= the set.fsc file
+//		false if the frames cannot be coded
+//--------------------------------------------------------------------
+bool CFringeCodec::EncodeSet(const vector<Mat>& frames, vector<unsigned char>& encodedData) const
+{
+	if (frames.empty() || frames[0].empty() || (frames[0].type() != CV_8UC1 && frames[0].type() != CV_16UC1))
+	{
+		cout << "fringe codec needs 8-bit or 16-bit single channel frames" << endl;
+		return false;
+	}
+	vector<Mat> continuousFrames(frames.size());
+	for (size_t k = 0; k < frames.size(); k++)
+	{
+		if (frames[k].size() != frames[0].size() || frames[k].type() != frames[0].type())
+		{
+			cout << "frame " << k << " does not match the set geometry" << endl;
+			return false;
+		}
+		continuousFrames[k] = frames[k].isContinuous() ? frames[k] : frames[k].clone();
+	}
+
+	int width = frames[0].cols;
+	int height = frames[0].rows;
+	int frameCount = (int)frames.size();
+	int bandCount = (height + m_bandRows - 1) / m_bandRows;
+	bool isHighBitDepth = frames[0].depth() == CV_16U;
+
+	// every band of every frame is independent, the originals serve as references
+	vector<vector<unsigned char>> chunks((size_t)frameCount * bandCount);
+	runTasks((int)chunks.size(), m_nThreads, [&](int task)
+	{
+		int k = task / bandCount;
+		int band = task % bandCount;
+		int firstRow = band * m_bandRows;
+		int rows = (std::min)(m_bandRows, height - firstRow);
+		int framesSinceKey = k % m_keyframeInterval;
+		const Mat& current = continuousFrames[k];
+		const Mat* previous = framesSinceKey >= 1 ? &continuousFrames[k - 1] : NULL;
+		const Mat* beforePrevious = framesSinceKey >= 2 ? &continuousFrames[k - 2] : NULL;
+		if (isHighBitDepth)
+		{
+			encodeBand(current.ptr<unsigned short>(firstRow), previous ? previous->ptr<unsigned short>(firstRow) : NULL,
+				beforePrevious ? beforePrevious->ptr<unsigned short>(firstRow) : NULL, width, rows, chunks[task]);
+		}
+		else
+		{
+			encodeBand(current.ptr<unsigned char>(firstRow), previous ? previous->ptr<unsigned char>(firstRow) : NULL,
+				beforePrevious ? beforePrevious->ptr<unsigned char>(firstRow) : NULL, width, rows, chunks[task]);
+		}
+	});
+
+	FscFileHeader header;
+	memcpy(header.magic, c_fscMagic, sizeof(header.magic));
+	header.version = c_fscVersion;
+	header.bytesPerPixel = isHighBitDepth ? 2 : 1;
+	header.width = width;
+	header.height = height;
+	header.frameCount = frameCount;
+	header.bandRows = m_bandRows;
+	header.keyframeInterval = m_keyframeInterval;
+
+	vector<FscChunkEntry> index(chunks.size());
+	unsigned long long offset = sizeof(header) + index.size() * sizeof(FscChunkEntry);
+	for (size_t c = 0; c < chunks.size(); c++)
+	{
+		index[c].offset = offset;
+		index[c].size = (unsigned int)chunks[c].size();
+		offset += chunks[c].size();
+	}
+	encodedData.clear();
+	encodedData.reserve((size_t)offset);
+	encodedData.insert(encodedData.end(), (const unsigned char*)&header, (const unsigned char*)(&header + 1));
+	encodedData.insert(encodedData.end(), (const unsigned char*)index.data(), (const unsigned char*)(index.data() + index.size()));
+	for (const vector<unsigned char>& chunk : chunks)
+	{
+		encodedData.insert(encodedData.end(), chunk.begin(), chunk.end());
+	}
+	return true;
+}
+
+// geometry of a set from its header; the index has to fit in indexBytes
+static bool infoFromHeader(const FscFileHeader& header, size_t indexBytes, FringeSetInfo& info)
+{
+	info = FringeSetInfo();
+	if (memcmp(header.magic, c_fscMagic, sizeof(header.magic)) != 0 || header.version != c_fscVersion ||
+		(header.bytesPerPixel != 1 && header.bytesPerPixel != 2) || header.width == 0 || header.height == 0 ||
+		header.frameCount == 0 || header.bandRows == 0 || header.keyframeInterval == 0)
+	{
+		return false;
+	}
+	unsigned long long bandCount = (header.height + header.bandRows - 1) / header.bandRows;
+	if ((unsigned long long)header.frameCount * bandCount * sizeof(FscChunkEntry) > indexBytes)
+	{
+		return false;
+	}
+	info.frameCount = header.frameCount;
+	info.imageWidth = header.width;
+	info.imageHeight = header.height;
+	info.bytesPerPixel = header.bytesPerPixel;
+	info.bandRows = header.bandRows;
+	info.keyframeInterval = header.keyframeInterval;
+	info.frameBytes = (size_t)info.imageWidth * info.imageHeight * info.bytesPerPixel;
+	return true;
+}
+
+bool CFringeCodec::ReadInfo(const vector<unsigned char>& encodedData, FringeSetInfo& info)
+{
+	FscFileHeader header;
+	if (encodedData.size() < sizeof(header))
+	{
+		info = FringeSetInfo();
+		return false;
+	}
+	memcpy(&header, encodedData.data(), sizeof(header));
+	return infoFromHeader(header, encodedData.size() - sizeof(header), info);
+}
+
+// only the header is read, to size storage before decoding
+bool CFringeCodec::ReadFileInfo(const string& fileName, FringeSetInfo& info)
+{
+	info = FringeSetInfo();
+	FILE* fp = fopen(fileName.c_str(), "rb");
+	if (!fp)
+	{
+		return false;
+	}
+	FscFileHeader header;
+	size_t readBytes = fread(&header, 1, sizeof(header), fp);
+	fseek(fp, 0, SEEK_END);
+	long fileSize = ftell(fp);
+	fclose(fp);
+	if (readBytes != sizeof(header) || fileSize < (long)sizeof(header))
+	{
+		return false;
+	}
+	return infoFromHeader(header, fileSize - sizeof(header), info);
+}
+
+bool CFringeCodec::ReadFile(const string& fileName, vector<unsigned char>& fileBytes)
+{
+	FILE* fp = fopen(fileName.c_str(), "rb");
+	if (!fp)
+	{
+		return false;
+	}
+	fseek(fp, 0, SEEK_END);
+	long fileSize = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	fileBytes.resize(fileSize > 0 ? fileSize : 0);
+	size_t readBytes = fileBytes.empty() ? 0 : fread(fileBytes.data(), 1, fileBytes.size(), fp);
+	fclose(fp);
+	return readBytes == fileBytes.size() && !fileBytes.empty();
+}
+
+//--------------------------------------------------------------------
+// Decode frames firstFrame .. lastFrame, one task per band
+// Input:
+//		firstFrame		= a keyframe
+//		frameStorage	= storageFrames frame buffers, frame k goes to
+//						  frameStorage[k % storageFrames]; 3 are enough
+//						  for the references
+//--------------------------------------------------------------------
+bool CFringeCodec::_decodeBands(const vector<unsigned char>& encodedData, const FringeSetInfo& info, int firstFrame, int lastFrame,
+	unsigned char* frameStorage[], int storageFrames) const
+{
+	int bandCount = (info.imageHeight + info.bandRows - 1) / info.bandRows;
+	const FscChunkEntry* index = (const FscChunkEntry*)(encodedData.data() + sizeof(FscFileHeader));
+	size_t rowBytes = (size_t)info.imageWidth * info.bytesPerPixel;
+	atomic<bool> isValid(true);
+	runTasks(bandCount, m_nThreads, [&](int band)
+	{
+		int firstRow = band * info.bandRows;
+		int rows = (std::min)(info.bandRows, info.imageHeight - firstRow);
+		for (int k = firstFrame; k <= lastFrame && isValid; k++)
+		{
+			FscChunkEntry entry;
+			memcpy(&entry, index + (size_t)k * bandCount + band, sizeof(entry));
+			if (entry.offset > encodedData.size() || entry.size > encodedData.size() - entry.offset)
+			{
+				isValid = false;
+				break;
+			}
+			int framesSinceKey = k % info.keyframeInterval;
+			unsigned char* current = frameStorage[k % storageFrames] + firstRow * rowBytes;
+			unsigned char* previous = framesSinceKey >= 1 ? frameStorage[(k - 1) % storageFrames] + firstRow * rowBytes : NULL;
+			unsigned char* beforePrevious = framesSinceKey >= 2 ? frameStorage[(k - 2) % storageFrames] + firstRow * rowBytes : NULL;
+			bool isDecoded = info.bytesPerPixel == 2
+				? decodeBand(encodedData.data() + entry.offset, entry.size, (const unsigned short*)previous,
+					(const unsigned short*)beforePrevious, info.imageWidth, rows, (unsigned short*)current)
+				: decodeBand(encodedData.data() + entry.offset, entry.size, (const unsigned char*)previous,
+					(const unsigned char*)beforePrevious, info.imageWidth, rows, current);
+			if (!isDecoded)
+			{
+				isValid = false;
+			}
+		}
+	});
+	return isValid;
+}
+
+//--------------------------------------------------------------------
+// Decode a whole set into contiguous storage, frame k at
+// storage + k * frameBytes (see CBatchPngLoader::LoadSet)
+//--------------------------------------------------------------------
+bool CFringeCodec::DecodeSet(const vector<unsigned char>& encodedData, unsigned char* storage, size_t storageBytes) const
+{
+	FringeSetInfo info;
+	if (!ReadInfo(encodedData, info))
+	{
+		cout << "not a fringe set file" << endl;
+		return false;
+	}
+	if (info.frameBytes * info.frameCount > storageBytes)
+	{
+		cout << "set storage too small for the fringe set" << endl;
+		return false;
+	}
+	vector<unsigned char*> frameStorage(info.frameCount);
+	for (int k = 0; k < info.frameCount; k++)
+	{
+		frameStorage[k] = storage + k * info.frameBytes;
+	}
+	if (!_decodeBands(encodedData, info, 0, info.frameCount - 1, frameStorage.data(), info.frameCount))
+	{
+		cout << "fringe set is damaged" << endl;
+		return false;
+	}
+	return true;
+}
+
+bool CFringeCodec::DecodeSet(const vector<unsigned char>& encodedData, vector<Mat>& frames) const
+{
+	FringeSetInfo info;
+	if (!ReadInfo(encodedData, info))
+	{
+		cout << "not a fringe set file" << endl;
+		return false;
+	}
+	int frameType = info.bytesPerPixel == 2 ? CV_16UC1 : CV_8UC1;
+	vector<unsigned char*> frameStorage(info.frameCount);
+	frames.resize(info.frameCount);
+	for (int k = 0; k < info.frameCount; k++)
+	{
+		frames[k].create(info.imageHeight, info.imageWidth, frameType);
+		frameStorage[k] = frames[k].data;
+	}
+	if (!_decodeBands(encodedData, info, 0, info.frameCount - 1, frameStorage.data(), info.frameCount))
+	{
+		cout << "fringe set is damaged" << endl;
+		return false;
+	}
+	return true;
+}
+
+// one frame, decoded from the keyframe before it
+bool CFringeCodec::DecodeFrame(const vector<unsigned char>& encodedData, int frameIndex, Mat& frame) const
+{
+	FringeSetInfo info;
+	if (!ReadInfo(encodedData, info) || frameIndex < 0 || frameIndex >= info.frameCount)
+	{
+		cout << "frame " << frameIndex << " is not in the fringe set" << endl;
+		return false;
+	}
+	int frameType = info.bytesPerPixel == 2 ? CV_16UC1 : CV_8UC1;
+	Mat references[3];
+	unsigned char* frameStorage[3];
+	for (int r = 0; r < 3; r++)
+	{
+		references[r].create(info.imageHeight, info.imageWidth, frameType);
+		frameStorage[r] = references[r].data;
+	}
+	int keyframe = frameIndex - frameIndex % info.keyframeInterval;
+	if (!_decodeBands(encodedData, info, keyframe, frameIndex, frameStorage, 3))
+	{
+		cout << "fringe set is damaged" << endl;
+		return false;
+	}
+	frame = references[frameIndex % 3];
+	return true;
+}
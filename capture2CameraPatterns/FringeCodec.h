@@ -0,0 +1,69 @@
+/*
+	 Lossless codec for fringe sets, written as one file per set
+	 (<set>/set.fsc) instead of a PNG per frame.
+
+	 Every frame is cut into bands of bandRows rows that are coded on
+	 their own, so bands are encoded and decoded in parallel. A band is
+	 predicted from the same band of the frames before it in the set:
+	 - intra:		nothing, only the spatial predictor below
+	 - previous:	the previous frame
+	 - sinusoid:	a1 * I[k-1] + a2 * I[k-2] + a0, fitted per band; for a
+					phase-shifted sinusoid this is the recurrence
+					I[k] = 2cos(d) I[k-1] - I[k-2] + (2 - 2cos(d)) A
+	 The encoder keeps the one with the smallest residual on sampled rows.
+	 The difference to the prediction is predicted once more from its
+	 left and upper neighbours (LOCO-I median edge detector), and the
+	 remainder is coded as a small token with rANS plus raw low bits.
+	 Every keyframeInterval frames a frame is coded intra, so a single
+	 frame decodes from at most keyframeInterval - 1 frames before it.
+
+	 Frames are 8-bit or 16-bit single channel; low bits that are zero
+	 in a whole band (MSB aligned Mono12) are not stored.
+
+	 File: FscFileHeader, a chunk index (frame-major, one entry per band),
+	 then the band chunks.
+*/
+
+#pragma once
+
+#include "opencv2/opencv.hpp"
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace cv;
+
+struct FringeSetInfo
+{
+	int frameCount = 0;
+	int imageWidth = 0;
+	int imageHeight = 0;
+	int bytesPerPixel = 0;		// 1 or 2
+	int bandRows = 0;
+	int keyframeInterval = 0;
+	size_t frameBytes = 0;
+};
+
+class CFringeCodec
+{
+public:
+	CFringeCodec(int nThreads = 0, int bandRows = 64, int keyframeInterval = 8);
+	~CFringeCodec(void);
+
+	bool EncodeSet(const vector<Mat>& frames, vector<unsigned char>& encodedData) const;
+	bool DecodeSet(const vector<unsigned char>& encodedData, unsigned char* storage, size_t storageBytes) const;
+	bool DecodeSet(const vector<unsigned char>& encodedData, vector<Mat>& frames) const;
+	bool DecodeFrame(const vector<unsigned char>& encodedData, int frameIndex, Mat& frame) const;
+
+	static bool ReadInfo(const vector<unsigned char>& encodedData, FringeSetInfo& info);
+	static bool ReadFileInfo(const string& fileName, FringeSetInfo& info);
+	static bool ReadFile(const string& fileName, vector<unsigned char>& fileBytes);
+
+private:
+	bool _decodeBands(const vector<unsigned char>& encodedData, const FringeSetInfo& info, int firstFrame, int lastFrame,
+		unsigned char* frameStorage[], int storageFrames) const;
+
+	int m_nThreads;
+	int m_bandRows;
+	int m_keyframeInterval;
+};
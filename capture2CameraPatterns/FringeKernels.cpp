@@ -0,0 +1,585 @@
+/*
+	 Vectorized pixel kernels shared by the capture and storage path
+*/
+
+#include "FringeKernels.h"
+#include <cstdlib>
+#include <cstring>
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <nmmintrin.h>
+#include <intrin.h>
+
+namespace FringeKernels
+{
+
+// unpack 12-bit packed pixels into MSB aligned 16-bit pixels
+// every 3 bytes hold 2 pixels; 12 bytes are shuffled into 8 16-bit lanes
+// where even lanes hold (Y0[11:4], Y1Y0[3:0]) and odd lanes (Y1[11:4], Y1Y0[3:0])
+void unpackMono12(const unsigned char* src, unsigned short* dst, int pixelCount)
+{
+	const __m128i shuffle = _mm_setr_epi8(1, 0, 1, 2, 4, 3, 4, 5, 7, 6, 7, 8, 10, 9, 10, 11);
+	const __m128i highMask = _mm_set1_epi16((short)0xFF00);
+	const __m128i evenNibble = _mm_setr_epi16(0x00F0, 0, 0x00F0, 0, 0x00F0, 0, 0x00F0, 0);
+	const __m128i oddNibble = _mm_setr_epi16(0, 0x00F0, 0, 0x00F0, 0, 0x00F0, 0, 0x00F0);
+
+	int i = 0;
+	// 16 byte loads consume 12 bytes, keep 4 bytes of slack at the end
+	for (; i + 10 < pixelCount; i += 8)
+	{
+		__m128i packed = _mm_loadu_si128((const __m128i*)(src + i / 2 * 3));
+		__m128i v = _mm_shuffle_epi8(packed, shuffle);
+		__m128i lowBits = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(v, 4), evenNibble), _mm_and_si128(v, oddNibble));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_and_si128(v, highMask), lowBits));
+	}
+
+	for (; i + 1 < pixelCount; i += 2)
+	{
+		const unsigned char* p = src + i / 2 * 3;
+		dst[i] = (unsigned short)((p[0] << 8) | ((p[1] & 0x0F) << 4));
+		dst[i + 1] = (unsigned short)((p[2] << 8) | (p[1] & 0xF0));
+	}
+	if (i < pixelCount)
+	{
+		const unsigned char* p = src + i / 2 * 3;
+		dst[i] = (unsigned short)((p[0] << 8) | ((p[1] & 0x0F) << 4));
+	}
+}
+
+// copy 16-bit pixels
+void copyMono16(const unsigned char* src, unsigned short* dst, int pixelCount)
+{
+	memcpy(dst, src, sizeof(dst[0]) * pixelCount);
+}
+
+// add an 8-bit frame into 16-bit accumulators, 16 pixels per step
+void accumulateFrame(const unsigned char* src, unsigned short* accumulator, int pixelCount, bool isFirstFrame)
+{
+	const __m128i zero = _mm_setzero_si128();
+	int i = 0;
+	for (; i + 16 <= pixelCount; i += 16)
+	{
+		__m128i pixels = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i low = _mm_unpacklo_epi8(pixels, zero);
+		__m128i high = _mm_unpackhi_epi8(pixels, zero);
+		if (!isFirstFrame)
+		{
+			low = _mm_add_epi16(low, _mm_loadu_si128((const __m128i*)(accumulator + i)));
+			high = _mm_add_epi16(high, _mm_loadu_si128((const __m128i*)(accumulator + i + 8)));
+		}
+		_mm_storeu_si128((__m128i*)(accumulator + i), low);
+		_mm_storeu_si128((__m128i*)(accumulator + i + 8), high);
+	}
+	for (; i < pixelCount; i++)
+	{
+		accumulator[i] = (unsigned short)(isFirstFrame ? src[i] : accumulator[i] + src[i]);
+	}
+}
+
+// add a 16-bit frame into 32-bit accumulators, 8 pixels per step
+void accumulateFrame(const unsigned short* src, unsigned int* accumulator, int pixelCount, bool isFirstFrame)
+{
+	const __m128i zero = _mm_setzero_si128();
+	int i = 0;
+	for (; i + 8 <= pixelCount; i += 8)
+	{
+		__m128i pixels = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i low = _mm_unpacklo_epi16(pixels, zero);
+		__m128i high = _mm_unpackhi_epi16(pixels, zero);
+		if (!isFirstFrame)
+		{
+			low = _mm_add_epi32(low, _mm_loadu_si128((const __m128i*)(accumulator + i)));
+			high = _mm_add_epi32(high, _mm_loadu_si128((const __m128i*)(accumulator + i + 4)));
+		}
+		_mm_storeu_si128((__m128i*)(accumulator + i), low);
+		_mm_storeu_si128((__m128i*)(accumulator + i + 4), high);
+	}
+	for (; i < pixelCount; i++)
+	{
+		accumulator[i] = isFirstFrame ? src[i] : accumulator[i] + src[i];
+	}
+}
+
+// average 16-bit accumulators into 8-bit pixels
+void averageFrame(const unsigned short* accumulator, int frameCount, unsigned char* dst, int pixelCount)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 scale = _mm_set1_ps(1.0f / frameCount);
+	int i = 0;
+	for (; i + 16 <= pixelCount; i += 16)
+	{
+		__m128i sums[2] = { _mm_loadu_si128((const __m128i*)(accumulator + i)), _mm_loadu_si128((const __m128i*)(accumulator + i + 8)) };
+		__m128i words[2];
+		for (int h = 0; h < 2; h++)
+		{
+			__m128i low = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(sums[h], zero)), scale));
+			__m128i high = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(sums[h], zero)), scale));
+			words[h] = _mm_packs_epi32(low, high);
+		}
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(words[0], words[1]));
+	}
+	for (; i < pixelCount; i++)
+	{
+		dst[i] = (unsigned char)((accumulator[i] + frameCount / 2) / frameCount);
+	}
+}
+
+// average 32-bit accumulators into 16-bit pixels
+void averageFrame(const unsigned int* accumulator, int frameCount, unsigned short* dst, int pixelCount)
+{
+	const __m128 scale = _mm_set1_ps(1.0f / frameCount);
+	const __m128i bias = _mm_set1_epi32(32768);
+	const __m128i biasWords = _mm_set1_epi16((short)0x8000);
+	int i = 0;
+	for (; i + 8 <= pixelCount; i += 8)
+	{
+		__m128i low = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(accumulator + i))), scale));
+		__m128i high = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(accumulator + i + 4))), scale));
+		// SSE2 has no unsigned 32 -> 16 pack; shift into the signed range and back
+		__m128i words = _mm_packs_epi32(_mm_sub_epi32(low, bias), _mm_sub_epi32(high, bias));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_add_epi16(words, biasWords));
+	}
+	for (; i < pixelCount; i++)
+	{
+		dst[i] = (unsigned short)(((unsigned long long)accumulator[i] + frameCount / 2) / frameCount);
+	}
+}
+
+// fuse one exposure frame, 16 pixels per step without branches
+void fuseExposureFrame(const unsigned char* src, unsigned short* fused, const unsigned char* exposureMap,
+	unsigned char* saturated, unsigned char exposureIndex, unsigned short gain, unsigned char saturationLevel, int pixelCount)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i index = _mm_set1_epi8((char)exposureIndex);
+	const __m128i level = _mm_set1_epi8((char)saturationLevel);
+	const __m128i gains = _mm_set1_epi16((short)gain);
+	int i = 0;
+	for (; i + 16 <= pixelCount; i += 16)
+	{
+		__m128i pixels = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i selected = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(exposureMap + i)), index);
+		__m128i isSaturated = _mm_cmpeq_epi8(_mm_max_epu8(pixels, level), pixels);
+		__m128i flags = _mm_loadu_si128((const __m128i*)(saturated + i));
+		_mm_storeu_si128((__m128i*)(saturated + i), _mm_or_si128(flags, _mm_and_si128(selected, isSaturated)));
+
+		__m128i scaledLow = _mm_mullo_epi16(_mm_unpacklo_epi8(pixels, zero), gains);
+		__m128i scaledHigh = _mm_mullo_epi16(_mm_unpackhi_epi8(pixels, zero), gains);
+		__m128i selectLow = _mm_unpacklo_epi8(selected, selected);
+		__m128i selectHigh = _mm_unpackhi_epi8(selected, selected);
+		__m128i fusedLow = _mm_loadu_si128((const __m128i*)(fused + i));
+		__m128i fusedHigh = _mm_loadu_si128((const __m128i*)(fused + i + 8));
+		fusedLow = _mm_or_si128(_mm_and_si128(selectLow, scaledLow), _mm_andnot_si128(selectLow, fusedLow));
+		fusedHigh = _mm_or_si128(_mm_and_si128(selectHigh, scaledHigh), _mm_andnot_si128(selectHigh, fusedHigh));
+		_mm_storeu_si128((__m128i*)(fused + i), fusedLow);
+		_mm_storeu_si128((__m128i*)(fused + i + 8), fusedHigh);
+	}
+	for (; i < pixelCount; i++)
+	{
+		if (exposureMap[i] == exposureIndex)
+		{
+			fused[i] = (unsigned short)(src[i] * gain);
+			if (src[i] >= saturationLevel) saturated[i] = 0xFF;
+		}
+	}
+}
+
+// saturated flags are 0xFF, so subtracting them adds one to the exposure index
+void promoteSaturated(unsigned char* exposureMap, unsigned char* saturated, int pixelCount)
+{
+	int i = 0;
+	for (; i + 16 <= pixelCount; i += 16)
+	{
+		__m128i map = _mm_loadu_si128((const __m128i*)(exposureMap + i));
+		__m128i flags = _mm_loadu_si128((const __m128i*)(saturated + i));
+		_mm_storeu_si128((__m128i*)(exposureMap + i), _mm_sub_epi8(map, flags));
+		_mm_storeu_si128((__m128i*)(saturated + i), _mm_setzero_si128());
+	}
+	for (; i < pixelCount; i++)
+	{
+		if (saturated[i]) exposureMap[i]++;
+		saturated[i] = 0;
+	}
+}
+
+// 8x8 block sums, two blocks per step; _mm_sad_epu8 against zero adds
+// 8 bytes into each 64-bit lane, so a block needs one SAD per row
+void thumbnail8x8(const unsigned char* src, int width, int height, int stride, unsigned short* thumb)
+{
+	const __m128i zero = _mm_setzero_si128();
+	int thumbWidth = width / 8;
+	int thumbHeight = height / 8;
+	for (int by = 0; by < thumbHeight; by++)
+	{
+		const unsigned char* block = src + (size_t)by * 8 * stride;
+		unsigned short* t = thumb + (size_t)by * thumbWidth;
+		int bx = 0;
+		for (; bx + 2 <= thumbWidth; bx += 2)
+		{
+			__m128i sum = zero;
+			for (int y = 0; y < 8; y++)
+			{
+				__m128i pixels = _mm_loadu_si128((const __m128i*)(block + (size_t)y * stride + bx * 8));
+				sum = _mm_add_epi64(sum, _mm_sad_epu8(pixels, zero));
+			}
+			t[bx] = (unsigned short)_mm_cvtsi128_si32(sum);
+			t[bx + 1] = (unsigned short)_mm_extract_epi16(sum, 4);
+		}
+		if (bx < thumbWidth)
+		{
+			__m128i sum = zero;
+			for (int y = 0; y < 8; y++)
+			{
+				__m128i pixels = _mm_loadl_epi64((const __m128i*)(block + (size_t)y * stride + bx * 8));
+				sum = _mm_add_epi64(sum, _mm_sad_epu8(pixels, zero));
+			}
+			t[bx] = (unsigned short)_mm_cvtsi128_si32(sum);
+		}
+	}
+}
+
+// 16-bit frames use the high byte of each pixel, so both depths give
+// thumbnails on the same 0..16320 scale
+void thumbnail8x8(const unsigned short* src, int width, int height, int stride, unsigned short* thumb)
+{
+	const __m128i zero = _mm_setzero_si128();
+	int thumbWidth = width / 8;
+	int thumbHeight = height / 8;
+	for (int by = 0; by < thumbHeight; by++)
+	{
+		const unsigned short* block = src + (size_t)by * 8 * stride;
+		unsigned short* t = thumb + (size_t)by * thumbWidth;
+		int bx = 0;
+		for (; bx + 2 <= thumbWidth; bx += 2)
+		{
+			__m128i sum = zero;
+			for (int y = 0; y < 8; y++)
+			{
+				const unsigned short* row = block + (size_t)y * stride + bx * 8;
+				__m128i low = _mm_srli_epi16(_mm_loadu_si128((const __m128i*)row), 8);
+				__m128i high = _mm_srli_epi16(_mm_loadu_si128((const __m128i*)(row + 8)), 8);
+				sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_packus_epi16(low, high), zero));
+			}
+			t[bx] = (unsigned short)_mm_cvtsi128_si32(sum);
+			t[bx + 1] = (unsigned short)_mm_extract_epi16(sum, 4);
+		}
+		if (bx < thumbWidth)
+		{
+			__m128i sum = zero;
+			for (int y = 0; y < 8; y++)
+			{
+				__m128i pixels = _mm_srli_epi16(_mm_loadu_si128((const __m128i*)(block + (size_t)y * stride + bx * 8)), 8);
+				sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_packus_epi16(pixels, zero), zero));
+			}
+			t[bx] = (unsigned short)_mm_cvtsi128_si32(sum);
+		}
+	}
+}
+
+// sum of |a - b| over 16-bit values, 8 per step; the 32-bit lane sums are
+// moved into the 64-bit total before they can overflow
+unsigned long long sumAbsDiff(const unsigned short* a, const unsigned short* b, int count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	unsigned long long total = 0;
+	int i = 0;
+	while (i + 8 <= count)
+	{
+		__m128i sum = zero;
+		for (int step = 0; step < 1024 && i + 8 <= count; step++, i += 8)
+		{
+			__m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+			__m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+			__m128i diff = _mm_or_si128(_mm_subs_epu16(va, vb), _mm_subs_epu16(vb, va));
+			sum = _mm_add_epi32(sum, _mm_add_epi32(_mm_unpacklo_epi16(diff, zero), _mm_unpackhi_epi16(diff, zero)));
+		}
+		unsigned int lanes[4];
+		_mm_storeu_si128((__m128i*)lanes, sum);
+		total += (unsigned long long)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+	for (; i < count; i++)
+	{
+		total += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+	}
+	return total;
+}
+
+// 2x2 block sums, 8 blocks per step; _mm_maddubs_epi16 against ones adds
+// horizontal pixel pairs, the two rows are added in 16 bits
+void accumulateBlocks2x2(const unsigned char* src, int width, int height, int stride, unsigned int* accumulator, bool isFirstFrame)
+{
+	const __m128i ones = _mm_set1_epi8(1);
+	const __m128i zero = _mm_setzero_si128();
+	int outWidth = width / 2;
+	int outHeight = height / 2;
+	for (int y = 0; y < outHeight; y++)
+	{
+		const unsigned char* row0 = src + (size_t)2 * y * stride;
+		const unsigned char* row1 = row0 + stride;
+		unsigned int* acc = accumulator + (size_t)y * outWidth;
+		int x = 0;
+		for (; x + 8 <= outWidth; x += 8)
+		{
+			__m128i sum = _mm_add_epi16(_mm_maddubs_epi16(_mm_loadu_si128((const __m128i*)(row0 + 2 * x)), ones),
+				_mm_maddubs_epi16(_mm_loadu_si128((const __m128i*)(row1 + 2 * x)), ones));
+			__m128i low = _mm_unpacklo_epi16(sum, zero);
+			__m128i high = _mm_unpackhi_epi16(sum, zero);
+			if (!isFirstFrame)
+			{
+				low = _mm_add_epi32(low, _mm_loadu_si128((const __m128i*)(acc + x)));
+				high = _mm_add_epi32(high, _mm_loadu_si128((const __m128i*)(acc + x + 4)));
+			}
+			_mm_storeu_si128((__m128i*)(acc + x), low);
+			_mm_storeu_si128((__m128i*)(acc + x + 4), high);
+		}
+		for (; x < outWidth; x++)
+		{
+			unsigned int sum = row0[2 * x] + row0[2 * x + 1] + row1[2 * x] + row1[2 * x + 1];
+			acc[x] = isFirstFrame ? sum : acc[x] + sum;
+		}
+	}
+}
+
+// 16-bit frames are reduced to their high byte 16 pixels at a time and
+// summed like 8-bit frames
+void accumulateBlocks2x2(const unsigned short* src, int width, int height, int stride, unsigned int* accumulator, bool isFirstFrame)
+{
+	const __m128i ones = _mm_set1_epi8(1);
+	const __m128i zero = _mm_setzero_si128();
+	int outWidth = width / 2;
+	int outHeight = height / 2;
+	for (int y = 0; y < outHeight; y++)
+	{
+		const unsigned short* row0 = src + (size_t)2 * y * stride;
+		const unsigned short* row1 = row0 + stride;
+		unsigned int* acc = accumulator + (size_t)y * outWidth;
+		int x = 0;
+		for (; x + 8 <= outWidth; x += 8)
+		{
+			__m128i top = _mm_packus_epi16(_mm_srli_epi16(_mm_loadu_si128((const __m128i*)(row0 + 2 * x)), 8),
+				_mm_srli_epi16(_mm_loadu_si128((const __m128i*)(row0 + 2 * x + 8)), 8));
+			__m128i bottom = _mm_packus_epi16(_mm_srli_epi16(_mm_loadu_si128((const __m128i*)(row1 + 2 * x)), 8),
+				_mm_srli_epi16(_mm_loadu_si128((const __m128i*)(row1 + 2 * x + 8)), 8));
+			__m128i sum = _mm_add_epi16(_mm_maddubs_epi16(top, ones), _mm_maddubs_epi16(bottom, ones));
+			__m128i low = _mm_unpacklo_epi16(sum, zero);
+			__m128i high = _mm_unpackhi_epi16(sum, zero);
+			if (!isFirstFrame)
+			{
+				low = _mm_add_epi32(low, _mm_loadu_si128((const __m128i*)(acc + x)));
+				high = _mm_add_epi32(high, _mm_loadu_si128((const __m128i*)(acc + x + 4)));
+			}
+			_mm_storeu_si128((__m128i*)(acc + x), low);
+			_mm_storeu_si128((__m128i*)(acc + x + 4), high);
+		}
+		for (; x < outWidth; x++)
+		{
+			unsigned int sum = (row0[2 * x] >> 8) + (row0[2 * x + 1] >> 8) + (row1[2 * x] >> 8) + (row1[2 * x + 1] >> 8);
+			acc[x] = isFirstFrame ? sum : acc[x] + sum;
+		}
+	}
+}
+
+// 16 pixels of the measure pass: _mm_sad_epu8 against zero adds the
+// pixels, against the shifted and the next row it adds the gradients, and
+// against zero on the 0/1 saturation mask it counts saturated pixels
+static inline void measurePixels(__m128i pixels, __m128i right, __m128i below, __m128i level,
+	__m128i& pixelSum, __m128i& gradientSum, __m128i& saturatedCount)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi8(1);
+	pixelSum = _mm_add_epi64(pixelSum, _mm_sad_epu8(pixels, zero));
+	gradientSum = _mm_add_epi64(gradientSum, _mm_add_epi64(_mm_sad_epu8(pixels, right), _mm_sad_epu8(pixels, below)));
+	__m128i saturated = _mm_cmpeq_epi8(_mm_max_epu8(pixels, level), pixels);
+	saturatedCount = _mm_add_epi64(saturatedCount, _mm_sad_epu8(_mm_and_si128(saturated, one), zero));
+}
+
+static inline unsigned long long sumLanes(__m128i sum)
+{
+	unsigned long long lanes[2];
+	_mm_storeu_si128((__m128i*)lanes, sum);
+	return lanes[0] + lanes[1];
+}
+
+// the last row has no lower neighbour, it is measured against itself;
+// the scalar tail covers the last column, which has no right neighbour
+void measureFrame(const unsigned char* src, int width, int height, int stride, unsigned char saturationLevel, FrameMeasures& measures)
+{
+	const __m128i level = _mm_set1_epi8((char)saturationLevel);
+	__m128i pixelSum = _mm_setzero_si128();
+	__m128i gradientSum = pixelSum;
+	__m128i saturatedCount = pixelSum;
+	unsigned long long tailPixelSum = 0, tailGradientSum = 0, tailSaturatedCount = 0;
+	for (int y = 0; y < height; y++)
+	{
+		const unsigned char* row = src + (size_t)y * stride;
+		const unsigned char* nextRow = y + 1 < height ? row + stride : row;
+		int x = 0;
+		for (; x + 17 <= width; x += 16)
+		{
+			measurePixels(_mm_loadu_si128((const __m128i*)(row + x)), _mm_loadu_si128((const __m128i*)(row + x + 1)),
+				_mm_loadu_si128((const __m128i*)(nextRow + x)), level, pixelSum, gradientSum, saturatedCount);
+		}
+		for (; x < width; x++)
+		{
+			int pixel = row[x];
+			int right = x + 1 < width ? row[x + 1] : pixel;
+			tailPixelSum += pixel;
+			tailGradientSum += abs(pixel - right) + abs(pixel - nextRow[x]);
+			tailSaturatedCount += pixel >= saturationLevel;
+		}
+	}
+	measures.pixelSum = sumLanes(pixelSum) + tailPixelSum;
+	measures.gradientSum = sumLanes(gradientSum) + tailGradientSum;
+	measures.saturatedCount = sumLanes(saturatedCount) + tailSaturatedCount;
+}
+
+static inline __m128i highBytes(const unsigned short* pixels)
+{
+	return _mm_packus_epi16(_mm_srli_epi16(_mm_loadu_si128((const __m128i*)pixels), 8),
+		_mm_srli_epi16(_mm_loadu_si128((const __m128i*)(pixels + 8)), 8));
+}
+
+// 16-bit frames are reduced to their high byte 16 pixels at a time, so
+// the measures and the limits share the 8-bit scale
+void measureFrame(const unsigned short* src, int width, int height, int stride, unsigned char saturationLevel, FrameMeasures& measures)
+{
+	const __m128i level = _mm_set1_epi8((char)saturationLevel);
+	__m128i pixelSum = _mm_setzero_si128();
+	__m128i gradientSum = pixelSum;
+	__m128i saturatedCount = pixelSum;
+	unsigned long long tailPixelSum = 0, tailGradientSum = 0, tailSaturatedCount = 0;
+	for (int y = 0; y < height; y++)
+	{
+		const unsigned short* row = src + (size_t)y * stride;
+		const unsigned short* nextRow = y + 1 < height ? row + stride : row;
+		int x = 0;
+		for (; x + 17 <= width; x += 16)
+		{
+			measurePixels(highBytes(row + x), highBytes(row + x + 1), highBytes(nextRow + x), level,
+				pixelSum, gradientSum, saturatedCount);
+		}
+		for (; x < width; x++)
+		{
+			int pixel = row[x] >> 8;
+			int right = x + 1 < width ? row[x + 1] >> 8 : pixel;
+			tailPixelSum += pixel;
+			tailGradientSum += abs(pixel - right) + abs(pixel - (nextRow[x] >> 8));
+			tailSaturatedCount += pixel >= saturationLevel;
+		}
+	}
+	measures.pixelSum = sumLanes(pixelSum) + tailPixelSum;
+	measures.gradientSum = sumLanes(gradientSum) + tailGradientSum;
+	measures.saturatedCount = sumLanes(saturatedCount) + tailSaturatedCount;
+}
+
+// SSE2 has no 32-bit min/max, so they select through a compare mask
+static inline __m128i select32(__m128i mask, __m128i ifSet, __m128i ifClear)
+{
+	return _mm_or_si128(_mm_and_si128(mask, ifSet), _mm_andnot_si128(mask, ifClear));
+}
+
+// the median edge predictor is the planar prediction left + up - upLeft
+// clamped to [min(left, up), max(left, up)]; 4 pixels per step
+void medResidualRow(const int* row, const int* upRow, int width, unsigned int* residuals)
+{
+	int x = 1;
+	for (; x + 4 <= width; x += 4)
+	{
+		__m128i left = _mm_loadu_si128((const __m128i*)(row + x - 1));
+		__m128i up = _mm_loadu_si128((const __m128i*)(upRow + x));
+		__m128i upLeft = _mm_loadu_si128((const __m128i*)(upRow + x - 1));
+		__m128i isLeftGreater = _mm_cmpgt_epi32(left, up);
+		__m128i low = select32(isLeftGreater, up, left);
+		__m128i high = select32(isLeftGreater, left, up);
+		__m128i prediction = _mm_sub_epi32(_mm_add_epi32(left, up), upLeft);
+		prediction = select32(_mm_cmpgt_epi32(low, prediction), low, prediction);
+		prediction = select32(_mm_cmpgt_epi32(prediction, high), high, prediction);
+		__m128i residual = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(row + x)), prediction);
+		__m128i zigzag = _mm_xor_si128(_mm_slli_epi32(residual, 1), _mm_srai_epi32(residual, 31));
+		_mm_storeu_si128((__m128i*)(residuals + x), zigzag);
+	}
+	for (; x < width; x++)
+	{
+		int left = row[x - 1];
+		int up = upRow[x];
+		int low = left < up ? left : up;
+		int high = left < up ? up : left;
+		int prediction = left + up - upRow[x - 1];
+		prediction = prediction < low ? low : (prediction > high ? high : prediction);
+		int residual = row[x] - prediction;
+		residuals[x] = ((unsigned int)residual << 1) ^ (unsigned int)(residual >> 31);
+	}
+}
+
+// reflected CRC32C polynomial, the one the SSE4.2 CRC instruction uses
+static const unsigned int c_crc32cPolynomial = 0x82F63B78;
+
+static bool hasCrc32Instruction(void)
+{
+	int cpuInfo[4];
+	__cpuid(cpuInfo, 1);
+	return (cpuInfo[2] & (1 << 20)) != 0;
+}
+
+struct Crc32cTable
+{
+	unsigned int entries[256];
+
+	Crc32cTable(void)
+	{
+		for (unsigned int i = 0; i < 256; i++)
+		{
+			unsigned int crc = i;
+			for (int bit = 0; bit < 8; bit++)
+			{
+				crc = (crc >> 1) ^ (c_crc32cPolynomial & (0u - (crc & 1)));
+			}
+			entries[i] = crc;
+		}
+	}
+};
+
+// 8 bytes per instruction on x64, 4 on 32-bit builds, bytes for the tail
+unsigned int crc32c(const void* data, size_t size, unsigned int crc)
+{
+	static const bool isHardware = hasCrc32Instruction();
+	const unsigned char* p = (const unsigned char*)data;
+	crc = ~crc;
+	if (!isHardware)
+	{
+		static const Crc32cTable table;
+		for (size_t i = 0; i < size; i++)
+		{
+			crc = (crc >> 8) ^ table.entries[(crc ^ p[i]) & 0xFF];
+		}
+		return ~crc;
+	}
+
+	size_t i = 0;
+#if defined(_M_X64) || defined(__x86_64__)
+	unsigned long long crc64 = crc;
+	for (; i + 32 <= size; i += 32)
+	{
+		crc64 = _mm_crc32_u64(crc64, *(const unsigned long long*)(p + i));
+		crc64 = _mm_crc32_u64(crc64, *(const unsigned long long*)(p + i + 8));
+		crc64 = _mm_crc32_u64(crc64, *(const unsigned long long*)(p + i + 16));
+		crc64 = _mm_crc32_u64(crc64, *(const unsigned long long*)(p + i + 24));
+	}
+	for (; i + 8 <= size; i += 8)
+	{
+		crc64 = _mm_crc32_u64(crc64, *(const unsigned long long*)(p + i));
+	}
+	crc = (unsigned int)crc64;
+#else
+	for (; i + 4 <= size; i += 4)
+	{
+		crc = _mm_crc32_u32(crc, *(const unsigned int*)(p + i));
+	}
+#endif
+	for (; i < size; i++)
+	{
+		crc = _mm_crc32_u8(crc, p[i]);
+	}
+	return ~crc;
+}
+
+}
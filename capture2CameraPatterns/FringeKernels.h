@@ -0,0 +1,72 @@
+/*
+	 Vectorized pixel kernels shared by the capture and storage path
+	 The kernels use SSE2/SSSE3 intrinsics which are available on every
+	 x64 target we build for; each one has a scalar tail for the
+	 remaining pixels. crc32c uses the SSE4.2 CRC instruction when the
+	 CPU has it and a table otherwise.
+*/
+
+#pragma once
+
+#include <cstddef>
+
+namespace FringeKernels
+{
+	// unpack 12-bit packed pixels (Y0[11:4] | Y1[3:0]Y0[3:0] | Y1[11:4])
+	// into 16-bit pixels, MSB aligned so Mono12 and Mono16 share one scale
+	void unpackMono12(const unsigned char* src, unsigned short* dst, int pixelCount);
+
+	// copy 16-bit pixels
+	void copyMono16(const unsigned char* src, unsigned short* dst, int pixelCount);
+
+	// add a frame into an accumulator, or initialize the accumulator with it
+	void accumulateFrame(const unsigned char* src, unsigned short* accumulator, int pixelCount, bool isFirstFrame);
+	void accumulateFrame(const unsigned short* src, unsigned int* accumulator, int pixelCount, bool isFirstFrame);
+
+	// divide an accumulator by the number of accumulated frames, rounded to nearest
+	void averageFrame(const unsigned short* accumulator, int frameCount, unsigned char* dst, int pixelCount);
+	void averageFrame(const unsigned int* accumulator, int frameCount, unsigned short* dst, int pixelCount);
+
+	// fuse one frame of an exposure cycle into a 16-bit HDR frame
+	// pixels whose exposure map selects this exposure take src * gain, and
+	// are flagged in saturated if src reaches the saturation level
+	void fuseExposureFrame(const unsigned char* src, unsigned short* fused, const unsigned char* exposureMap,
+		unsigned char* saturated, unsigned char exposureIndex, unsigned short gain, unsigned char saturationLevel, int pixelCount);
+
+	// hand pixels flagged as saturated over to the next exposure and clear the flags
+	void promoteSaturated(unsigned char* exposureMap, unsigned char* saturated, int pixelCount);
+
+	// sum every 8x8 block into one thumbnail pixel, (width / 8) x (height / 8)
+	// stride is in pixels; 16-bit frames are summed on their high byte
+	void thumbnail8x8(const unsigned char* src, int width, int height, int stride, unsigned short* thumb);
+	void thumbnail8x8(const unsigned short* src, int width, int height, int stride, unsigned short* thumb);
+
+	// sum of absolute differences of two 16-bit buffers, e.g. two thumbnails
+	unsigned long long sumAbsDiff(const unsigned short* a, const unsigned short* b, int count);
+
+	// add the 2x2 block sums of a frame into (width / 2) x (height / 2)
+	// accumulators, or initialize them; 16-bit frames are summed on their high byte
+	void accumulateBlocks2x2(const unsigned char* src, int width, int height, int stride, unsigned int* accumulator, bool isFirstFrame);
+	void accumulateBlocks2x2(const unsigned short* src, int width, int height, int stride, unsigned int* accumulator, bool isFirstFrame);
+
+	// one pass over a frame for the set quality gate: the pixel sum, the
+	// count of pixels at or above saturationLevel and the sum of absolute
+	// differences to the right and lower neighbours (focus); stride is in
+	// pixels, 16-bit frames are measured on their high byte
+	struct FrameMeasures
+	{
+		unsigned long long pixelSum;
+		unsigned long long gradientSum;
+		unsigned long long saturatedCount;
+	};
+	void measureFrame(const unsigned char* src, int width, int height, int stride, unsigned char saturationLevel, FrameMeasures& measures);
+	void measureFrame(const unsigned short* src, int width, int height, int stride, unsigned char saturationLevel, FrameMeasures& measures);
+
+	// zigzag coded residuals of the LOCO-I median edge predictor for
+	// pixels 1 .. width - 1 of a row, from the row and the row above
+	void medResidualRow(const int* row, const int* upRow, int width, unsigned int* residuals);
+
+	// CRC32C (Castagnoli) of a buffer; pass the previous result as crc to
+	// continue a checksum over several buffers, 0 to start one
+	unsigned int crc32c(const void* data, size_t size, unsigned int crc = 0);
+}
@@ -0,0 +1,162 @@
+#include "FringeProcessing.h"
+#include "FringeTypes.h"
+#include <cmath>
+#include <iostream>
+
+
+CFringeProcessor::CFringeProcessor(void)
+{
+}
+
+CFringeProcessor::~CFringeProcessor(void)
+{
+}
+
+// pattern sequence used by rectSequence instead of the default two
+// bright frames followed by fringes
+bool CFringeProcessor::loadCodebook(const string& fileName)
+{
+	return m_aligner.LoadCodebook(fileName);
+}
+
+//--------------------------------------------------------------------
+// Rotate a captured cycle into projection order and drop the marker
+// frames, using the codebook alignment of CSequenceAligner
+//
+// Input:
+//		rawFringeMat	= one full pattern cycle in capture order
+//		outputFringeMat = fringe frames in projection order
+//--------------------------------------------------------------------
+bool CFringeProcessor::rectSequence(const vector<Mat>& rawFringeMat, vector<Mat>& outputFringeMat)
+{
+	CSequenceAligner aligner = m_aligner;
+	float confidence = 0;
+	return aligner.AlignSequence(rawFringeMat, outputFringeMat, confidence);
+}
+
+// run the kernel specialized for the common pattern counts; 62 is a
+// default set once its two marker frames are dropped
+template <typename T>
+static void dispatchWrappedPhase(const FringeSetView<const T>& set, ImageView<float> phase, ImageView<float> modulation)
+{
+	switch (set.count())
+	{
+	case 3: computeWrappedPhase<3, T>(FringeSetView<const T, 3>(set.frames, 3, set.width, set.height, set.stride), phase, modulation); break;
+	case 4: computeWrappedPhase<4, T>(FringeSetView<const T, 4>(set.frames, 4, set.width, set.height, set.stride), phase, modulation); break;
+	case 8: computeWrappedPhase<8, T>(FringeSetView<const T, 8>(set.frames, 8, set.width, set.height, set.stride), phase, modulation); break;
+	case 16: computeWrappedPhase<16, T>(FringeSetView<const T, 16>(set.frames, 16, set.width, set.height, set.stride), phase, modulation); break;
+	case 62: computeWrappedPhase<62, T>(FringeSetView<const T, 62>(set.frames, 62, set.width, set.height, set.stride), phase, modulation); break;
+	case 64: computeWrappedPhase<64, T>(FringeSetView<const T, 64>(set.frames, 64, set.width, set.height, set.stride), phase, modulation); break;
+	default: computeWrappedPhase<T>(set, phase, modulation); break;
+	}
+}
+
+//--------------------------------------------------------------------
+// N-step phase shifting
+// phase = atan2(-sum I_k sin(2 pi k / N), sum I_k cos(2 pi k / N))
+// modulation = 2 / N * sqrt(S^2 + C^2)
+// 8-bit and 16-bit single channel sets of one size go through the typed
+// kernels of FringeTypes.h, anything else through the generic version
+//
+// Input:
+//		fringeMat	= fringe frames, 8-bit or 16-bit
+//		firstFrame	= index of the first frame of the N-step sequence
+//		phaseSteps	= N
+//		phase		= wrapped phase in (-pi, pi], CV_32FC1
+//		modulation	= fringe modulation in input intensity units, CV_32FC1
+//--------------------------------------------------------------------
+bool CFringeProcessor::computeWrappedPhase(const vector<Mat>& fringeMat, int firstFrame, int phaseSteps, Mat& phase, Mat& modulation)
+{
+	if (phaseSteps < 3 || firstFrame < 0 || firstFrame + phaseSteps > (int)fringeMat.size())
+	{
+		cout << "invalid phase shifting sequence" << endl;
+		return false;
+	}
+
+	const Mat& first = fringeMat[firstFrame];
+	bool isTyped = first.type() == CV_8UC1 || first.type() == CV_16UC1;
+	for (int k = 1; k < phaseSteps && isTyped; k++)
+	{
+		const Mat& frame = fringeMat[firstFrame + k];
+		isTyped = frame.type() == first.type() && frame.size() == first.size() && frame.step == first.step;
+	}
+	if (!isTyped)
+	{
+		return computeWrappedPhaseGeneric(fringeMat, firstFrame, phaseSteps, phase, modulation);
+	}
+
+	phase.create(first.rows, first.cols, CV_32FC1);
+	modulation.create(first.rows, first.cols, CV_32FC1);
+	ImageView<float> phaseView(phase.ptr<float>(), phase.cols, phase.rows, (ptrdiff_t)(phase.step / sizeof(float)));
+	ImageView<float> modulationView(modulation.ptr<float>(), modulation.cols, modulation.rows, (ptrdiff_t)(modulation.step / sizeof(float)));
+	if (first.depth() == CV_16U)
+	{
+		vector<const unsigned short*> frames;
+		for (int k = 0; k < phaseSteps; k++)
+		{
+			frames.push_back(fringeMat[firstFrame + k].ptr<unsigned short>());
+		}
+		FringeSetView<const unsigned short> set(frames.data(), phaseSteps, first.cols, first.rows, (ptrdiff_t)(first.step / sizeof(unsigned short)));
+		dispatchWrappedPhase(set, phaseView, modulationView);
+	}
+	else
+	{
+		vector<const unsigned char*> frames;
+		for (int k = 0; k < phaseSteps; k++)
+		{
+			frames.push_back(fringeMat[firstFrame + k].ptr<unsigned char>());
+		}
+		FringeSetView<const unsigned char> set(frames.data(), phaseSteps, first.cols, first.rows, (ptrdiff_t)first.step);
+		dispatchWrappedPhase(set, phaseView, modulationView);
+	}
+	return true;
+}
+
+// the per-frame Mat arithmetic version, for other pixel types and as the
+// reference the typed kernels are benchmarked against
+bool CFringeProcessor::computeWrappedPhaseGeneric(const vector<Mat>& fringeMat, int firstFrame, int phaseSteps, Mat& phase, Mat& modulation)
+{
+	if (phaseSteps < 3 || firstFrame < 0 || firstFrame + phaseSteps > (int)fringeMat.size())
+	{
+		cout << "invalid phase shifting sequence" << endl;
+		return false;
+	}
+
+	int rows = fringeMat[firstFrame].rows;
+	int cols = fringeMat[firstFrame].cols;
+	Mat sinSum = Mat::zeros(rows, cols, CV_32FC1);
+	Mat cosSum = Mat::zeros(rows, cols, CV_32FC1);
+	Mat fringeFloat;
+	for (int k = 0; k < phaseSteps; k++)
+	{
+		fringeMat[firstFrame + k].convertTo(fringeFloat, CV_32F);
+		double delta = 2.0 * CV_PI * k / phaseSteps;
+		sinSum += fringeFloat * sin(delta);
+		cosSum += fringeFloat * cos(delta);
+	}
+
+	phase.create(rows, cols, CV_32FC1);
+	modulation.create(rows, cols, CV_32FC1);
+	float modulationScale = 2.0f / phaseSteps;
+	for (int y = 0; y < rows; y++)
+	{
+		const float* s = sinSum.ptr<float>(y);
+		const float* c = cosSum.ptr<float>(y);
+		float* p = phase.ptr<float>(y);
+		float* m = modulation.ptr<float>(y);
+		for (int x = 0; x < cols; x++)
+		{
+			p[x] = atan2f(-s[x], c[x]);
+			m[x] = modulationScale * sqrtf(s[x] * s[x] + c[x] * c[x]);
+		}
+	}
+	return true;
+}
+
+//--------------------------------------------------------------------
+// Valid pixel mask from modulation, 255 for valid pixels
+//--------------------------------------------------------------------
+void CFringeProcessor::computeMask(const Mat& modulation, float modulationThreshold, Mat& mask)
+{
+	mask = modulation > modulationThreshold;
+}
@@ -0,0 +1,29 @@
+/*
+	 Fringe set processing shared by the capture program and the
+	 offline dataset tool: sequence alignment, N-step phase shifting
+	 and modulation based masking.
+*/
+
+#pragma once
+
+#include "opencv2/opencv.hpp"
+#include "SequenceAligner.h"
+
+using namespace std;
+using namespace cv;
+
+class CFringeProcessor
+{
+public:
+	CFringeProcessor(void);
+	~CFringeProcessor(void);
+
+	bool loadCodebook(const string& fileName);
+	bool rectSequence(const vector<Mat>& rawFringeMat, vector<Mat>& outputFringeMat);
+	bool computeWrappedPhase(const vector<Mat>& fringeMat, int firstFrame, int phaseSteps, Mat& phase, Mat& modulation);
+	bool computeWrappedPhaseGeneric(const vector<Mat>& fringeMat, int firstFrame, int phaseSteps, Mat& phase, Mat& modulation);
+	void computeMask(const Mat& modulation, float modulationThreshold, Mat& mask);
+
+private:
+	CSequenceAligner m_aligner;	// codebook only, copied per call so sets can be aligned in parallel
+};
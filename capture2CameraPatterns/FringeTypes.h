@@ -0,0 +1,232 @@
+/*
+	 Typed, non-owning views of frames and fringe sets, and N-step phase
+	 shifting kernels specialized on pixel type and pattern count.
+	 The phase step coefficients are generated at compile time; sets of
+	 up to c_unrolledPatterns frames are summed per pixel with the
+	 pattern loop unrolled, larger sets row by row. Pattern counts that
+	 are not instantiated use the runtime version with the same layout.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// frames per projected cycle: 2 bright marker frames followed by 62 fringe frames
+static const int c_setPatternCount = 64;
+// pattern count of views and kernels whose size is only known at run time
+static const int c_dynamicPatterns = 0;
+// largest pattern count summed per pixel with the pattern loop unrolled
+static const int c_unrolledPatterns = 16;
+
+template <typename T, int Channels = 1>
+struct ImageView
+{
+	static const int channels = Channels;
+
+	T* data;
+	int width, height;
+	ptrdiff_t stride;	// elements per row
+
+	ImageView(void) : data(nullptr), width(0), height(0), stride(0) {}
+	ImageView(T* data, int width, int height, ptrdiff_t stride = 0)
+		: data(data), width(width), height(height), stride(stride > 0 ? stride : (ptrdiff_t)width * Channels) {}
+
+	T* row(int y) const { return data + y * stride; }
+	bool empty(void) const { return data == nullptr || width <= 0 || height <= 0; }
+};
+
+// frames of one set share size and stride; Patterns is the frame count,
+// or c_dynamicPatterns with the count given at run time
+template <typename T, int Patterns = c_dynamicPatterns>
+struct FringeSetView
+{
+	T* const* frames;
+	int patternCount;
+	int width, height;
+	ptrdiff_t stride;
+
+	FringeSetView(T* const* frames, int patternCount, int width, int height, ptrdiff_t stride)
+		: frames(frames), patternCount(Patterns > 0 ? Patterns : patternCount), width(width), height(height), stride(stride) {}
+
+	int count(void) const { return Patterns > 0 ? Patterns : patternCount; }
+	ImageView<T> frame(int k) const { return ImageView<T>(frames[k], width, height, stride); }
+};
+
+namespace PhaseTables
+{
+	constexpr double c_pi = 3.14159265358979323846;
+
+	// Taylor series after reducing to [-pi, pi]; 12 terms are exact to
+	// double rounding there, so the tables match sin() and cos()
+	constexpr double constSin(double x)
+	{
+		while (x > c_pi) x -= 2 * c_pi;
+		while (x < -c_pi) x += 2 * c_pi;
+		double term = x;
+		double sum = x;
+		for (int n = 1; n < 12; n++)
+		{
+			term *= -x * x / ((2 * n) * (2 * n + 1));
+			sum += term;
+		}
+		return sum;
+	}
+
+	constexpr double constCos(double x)
+	{
+		return constSin(x + c_pi / 2);
+	}
+
+	// sin and cos of the N phase steps 2 pi k / N
+	template <int N>
+	struct PhaseStepTable
+	{
+		float sinTable[N];
+		float cosTable[N];
+
+		constexpr PhaseStepTable(void) : sinTable(), cosTable()
+		{
+			for (int k = 0; k < N; k++)
+			{
+				sinTable[k] = (float)constSin(2 * c_pi * k / N);
+				cosTable[k] = (float)constCos(2 * c_pi * k / N);
+			}
+		}
+	};
+
+	// sum_k I_k sin(delta_k) and sum_k I_k cos(delta_k) of one pixel, unrolled over k
+	template <int N, int K, typename T>
+	struct UnrolledPhaseSum
+	{
+		static void add(const T* const* rows, int x, const PhaseStepTable<N>& table, float& sinSum, float& cosSum)
+		{
+			float value = (float)rows[K][x];
+			sinSum += value * table.sinTable[K];
+			cosSum += value * table.cosTable[K];
+			UnrolledPhaseSum<N, K + 1, T>::add(rows, x, table, sinSum, cosSum);
+		}
+	};
+
+	template <int N, typename T>
+	struct UnrolledPhaseSum<N, N, T>
+	{
+		static void add(const T* const* rows, int x, const PhaseStepTable<N>& table, float& sinSum, float& cosSum) {}
+	};
+}
+
+// phase and modulation of one pixel from its sums
+inline void phaseFromSums(float sinSum, float cosSum, float modulationScale, float& phase, float& modulation)
+{
+	phase = atan2f(-sinSum, cosSum);
+	modulation = modulationScale * sqrtf(sinSum * sinSum + cosSum * cosSum);
+}
+
+//--------------------------------------------------------------------
+// N-step phase shifting with compile-time pattern count
+// phase = atan2(-sum I_k sin(2 pi k / N), sum I_k cos(2 pi k / N))
+// modulation = 2 / N * sqrt(S^2 + C^2)
+//--------------------------------------------------------------------
+template <int N, typename T>
+void computeWrappedPhase(const FringeSetView<const T, N>& set, ImageView<float> phase, ImageView<float> modulation)
+{
+	static_assert(N >= 3, "phase shifting needs at least 3 patterns");
+	static constexpr PhaseTables::PhaseStepTable<N> table;
+	const float modulationScale = 2.0f / N;
+
+	const T* rows[N];
+	std::vector<float> sinSum, cosSum;
+	if (N > c_unrolledPatterns)
+	{
+		sinSum.resize(set.width);
+		cosSum.resize(set.width);
+	}
+	for (int y = 0; y < set.height; y++)
+	{
+		for (int k = 0; k < N; k++)
+		{
+			rows[k] = set.frames[k] + y * set.stride;
+		}
+		float* p = phase.row(y);
+		float* m = modulation.row(y);
+		if (N <= c_unrolledPatterns)
+		{
+			for (int x = 0; x < set.width; x++)
+			{
+				float s = 0, c = 0;
+				PhaseTables::UnrolledPhaseSum<N, 0, T>::add(rows, x, table, s, c);
+				phaseFromSums(s, c, modulationScale, p[x], m[x]);
+			}
+			continue;
+		}
+
+		// many patterns: stream each frame row through the row sums
+		float* s = sinSum.data();
+		float* c = cosSum.data();
+		for (int x = 0; x < set.width; x++)
+		{
+			s[x] = 0;
+			c[x] = 0;
+		}
+		for (int k = 0; k < N; k++)
+		{
+			const T* src = rows[k];
+			const float sinK = table.sinTable[k];
+			const float cosK = table.cosTable[k];
+			for (int x = 0; x < set.width; x++)
+			{
+				float value = (float)src[x];
+				s[x] += value * sinK;
+				c[x] += value * cosK;
+			}
+		}
+		for (int x = 0; x < set.width; x++)
+		{
+			phaseFromSums(s[x], c[x], modulationScale, p[x], m[x]);
+		}
+	}
+}
+
+// runtime pattern count: same row layout, coefficients computed per call
+template <typename T>
+void computeWrappedPhase(const FringeSetView<const T, c_dynamicPatterns>& set, ImageView<float> phase, ImageView<float> modulation)
+{
+	int patternCount = set.count();
+	std::vector<float> sinTable(patternCount), cosTable(patternCount);
+	for (int k = 0; k < patternCount; k++)
+	{
+		double delta = 2.0 * PhaseTables::c_pi * k / patternCount;
+		sinTable[k] = (float)sin(delta);
+		cosTable[k] = (float)cos(delta);
+	}
+	const float modulationScale = 2.0f / patternCount;
+
+	std::vector<float> sinSum(set.width), cosSum(set.width);
+	for (int y = 0; y < set.height; y++)
+	{
+		float* s = sinSum.data();
+		float* c = cosSum.data();
+		for (int x = 0; x < set.width; x++)
+		{
+			s[x] = 0;
+			c[x] = 0;
+		}
+		for (int k = 0; k < patternCount; k++)
+		{
+			const T* src = set.frames[k] + y * set.stride;
+			for (int x = 0; x < set.width; x++)
+			{
+				float value = (float)src[x];
+				s[x] += value * sinTable[k];
+				c[x] += value * cosTable[k];
+			}
+		}
+		float* p = phase.row(y);
+		float* m = modulation.row(y);
+		for (int x = 0; x < set.width; x++)
+		{
+			phaseFromSums(s[x], c[x], modulationScale, p[x], m[x]);
+		}
+	}
+}
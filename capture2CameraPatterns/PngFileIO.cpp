@@ -1,5 +1,6 @@
 //#include "stdafx.h"
 #include "PngFileIO.h"
+#include "FringeCodec.h"
 #include <iostream>
 
 
@@ -80,6 +81,71 @@ bool CPngFileIO::WritePngFile(const char* fileName, unsigned char* imageData, in
 	return imwrite(fileName, img);
 }
 
+//--------------------------------------------------------------------
+// Read 16-bit png image
+// 8-bit files are promoted to 16 bits (MSB aligned)
+//
+// Input:
+//		fileName	= name of files to store the data in ASCII format
+//		imageData	= 16-bit image data
+//		imageWidth	= number of cols
+//		imageHeight = number of rows
+//		nChannels	= number of channels
+//
+// Return:		
+//--------------------------------------------------------------------
+bool CPngFileIO::ReadPngFile(const char* fileName, unsigned short*& imageData, int& imageWidth, int& imageHeight, int& nChannels)
+{
+	Mat img = imread(fileName, IMREAD_ANYDEPTH | IMREAD_ANYCOLOR);
+
+	if (img.empty())
+	{
+		cout << "cannot read file: " << fileName;
+		return false;
+	}
+	if (img.depth() != CV_16U)
+	{
+		img.convertTo(img, CV_16U, 256.0);
+	}
+
+	imageWidth = img.cols;
+	imageHeight = img.rows;
+	nChannels = img.channels();
+
+	int imageSize = imageWidth * imageHeight;
+	if (imageData) delete[] imageData;
+	imageData = new unsigned short[imageSize * nChannels];
+	memcpy(imageData, img.data, sizeof(imageData[0]) * imageSize * nChannels);
+
+	return true;
+}
+
+//--------------------------------------------------------------------
+// Write 16-bit png image
+//
+// Input:
+//		fileName	= name of files to store the data in ASCII format
+//		imageData	= 16-bit image data
+//		imageWidth	= number of cols
+//		imageHeight = number of rows
+//		nChannels	= number of channels
+//
+// Return:		
+//--------------------------------------------------------------------
+bool CPngFileIO::WritePngFile(const char* fileName, unsigned short* imageData, int imageWidth, int imageHeight, int nChannels)
+{
+	Mat img;
+	if (nChannels == 1)
+	{
+		img = Mat(Size(imageWidth, imageHeight), CV_16UC1, imageData);
+	}
+	else
+	{
+		img = Mat(Size(imageWidth, imageHeight), CV_16UC3, imageData);
+	}
+	return imwrite(fileName, img);
+}
+
 //--------------------------------------------------------------------
 // Write png floating image
 // normalize floating data based on valid data points,
@@ -189,3 +255,78 @@ bool CPngFileIO::WritePngFilePhase(const char* fileName, float* imageData, int i
 
 	return rValue;
 }
+
+//--------------------------------------------------------------------
+// Read one frame of a fringe set file (set.fsc)
+// only the frames from the keyframe before frameIndex are decoded
+//
+// Input:
+//		fileName	= fringe set file written by WriteFringeSet
+//		frameIndex	= frame in capture order
+//		imageData	= image data, reallocated
+//		imageWidth	= number of cols
+//		imageHeight = number of rows
+//
+// Return: false if the file cannot be read, the frame is not in the set
+//		or its pixel size does not match imageData
+//--------------------------------------------------------------------
+template <typename T>
+static bool readFringeSetFrame(const char* fileName, int frameIndex, T*& imageData, int& imageWidth, int& imageHeight)
+{
+	vector<unsigned char> fileBytes;
+	FringeSetInfo info;
+	if (!CFringeCodec::ReadFile(fileName, fileBytes) || !CFringeCodec::ReadInfo(fileBytes, info))
+	{
+		cout << "cannot read file: " << fileName << endl;
+		return false;
+	}
+	if (info.bytesPerPixel != sizeof(T))
+	{
+		cout << "fringe set " << fileName << " has " << info.bytesPerPixel * 8 << "-bit frames" << endl;
+		return false;
+	}
+	Mat frame;
+	if (!CFringeCodec(1).DecodeFrame(fileBytes, frameIndex, frame))
+	{
+		return false;
+	}
+
+	imageWidth = frame.cols;
+	imageHeight = frame.rows;
+	int imageSize = imageWidth * imageHeight;
+	if (imageData) delete[] imageData;
+	imageData = new T[imageSize];
+	memcpy(imageData, frame.data, sizeof(imageData[0]) * imageSize);
+	return true;
+}
+
+bool CPngFileIO::ReadFringeSetFrame(const char* fileName, int frameIndex, unsigned char*& imageData, int& imageWidth, int& imageHeight)
+{
+	return readFringeSetFrame(fileName, frameIndex, imageData, imageWidth, imageHeight);
+}
+
+bool CPngFileIO::ReadFringeSetFrame(const char* fileName, int frameIndex, unsigned short*& imageData, int& imageWidth, int& imageHeight)
+{
+	return readFringeSetFrame(fileName, frameIndex, imageData, imageWidth, imageHeight);
+}
+
+//--------------------------------------------------------------------
+// Write a set of single channel 8-bit or 16-bit frames as one
+// losslessly coded fringe set file
+//--------------------------------------------------------------------
+bool CPngFileIO::WriteFringeSet(const char* fileName, const vector<Mat>& frames)
+{
+	vector<unsigned char> encodedData;
+	if (!CFringeCodec().EncodeSet(frames, encodedData))
+	{
+		return false;
+	}
+	FILE* file = fopen(fileName, "wb");
+	if (!file)
+	{
+		cout << "cannot write file: " << fileName << endl;
+		return false;
+	}
+	bool isWritten = fwrite(encodedData.data(), 1, encodedData.size(), file) == encodedData.size();
+	return fclose(file) == 0 && isWritten;
+}
@@ -16,7 +16,12 @@ public:
 
 	bool ReadPngFile(const char* fileName, unsigned char*& imageData, int& imageWidth, int& imageHeight, int& nChannels);
 	bool WritePngFile(const char* fileName, unsigned char* imageData, int imageWidth, int imageHeight, int nChannels);
+	bool ReadPngFile(const char* fileName, unsigned short*& imageData, int& imageWidth, int& imageHeight, int& nChannels);
+	bool WritePngFile(const char* fileName, unsigned short* imageData, int imageWidth, int imageHeight, int nChannels);
 	bool WritePngFileFT(const char* fileName, float* imageData, int imageWidth, int imageHeight, unsigned char* mask = NULL);
 	bool WritePngFilePhase(const char* fileName, float* imageData, int imageWidth, int imageHeight);
+	bool ReadFringeSetFrame(const char* fileName, int frameIndex, unsigned char*& imageData, int& imageWidth, int& imageHeight);
+	bool ReadFringeSetFrame(const char* fileName, int frameIndex, unsigned short*& imageData, int& imageWidth, int& imageHeight);
+	bool WriteFringeSet(const char* fileName, const vector<Mat>& frames);
 };
 
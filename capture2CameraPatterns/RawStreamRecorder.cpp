@@ -0,0 +1,292 @@
+#include "RawStreamRecorder.h"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+
+// unbuffered writes must start and end on sector boundaries; 4 KiB covers
+// 512 byte and 4K native sectors
+static const size_t c_sectorBytes = 4096;
+
+
+CRawStreamRecorder::CRawStreamRecorder(void)
+	: m_file(INVALID_HANDLE_VALUE)
+	, m_isUnbuffered(false)
+	, m_policy(BLOCK)
+	, m_width(0), m_height(0), m_bytesPerPixel(0)
+	, m_frameBytes(0)
+	, m_slotBytes(0)
+	, m_maxFrames(0)
+	, m_slotMemory(NULL)
+	, m_dropBuffer(NULL)
+	, m_nextSlot(0)
+	, m_isDropping(false)
+	, m_droppedFrames(0)
+	, m_failedWrites(0)
+{
+}
+
+CRawStreamRecorder::~CRawStreamRecorder(void)
+{
+	Close();
+}
+
+//--------------------------------------------------------------------
+// Create the stream file, preallocated for maxFrames frames
+// The file is opened for overlapped, unbuffered writes; volumes that
+// refuse unbuffered access fall back to cached overlapped writes
+//
+// Input:
+//		fileName		= raw stream file, the index is <name>_index.txt
+//		width, height	= frame size in pixels
+//		bytesPerPixel	= 1 for 8-bit, 2 for 16-bit frames
+//		maxFrames		= most frames the file will hold
+//		slotCount		= frames that may be in flight to the disk
+//		policy			= BLOCK waits for the oldest write when all slots
+//						  are busy, DROP_NEWEST discards the new frame
+//--------------------------------------------------------------------
+bool CRawStreamRecorder::Open(const string& fileName, int width, int height, int bytesPerPixel, int maxFrames,
+	int slotCount, Backpressure policy)
+{
+	Close();
+	if (width <= 0 || height <= 0 || maxFrames <= 0 || slotCount <= 0)
+	{
+		return false;
+	}
+
+	m_fileName = fileName;
+	m_width = width;
+	m_height = height;
+	m_bytesPerPixel = bytesPerPixel;
+	m_frameBytes = (size_t)width * height * bytesPerPixel;
+	m_slotBytes = (m_frameBytes + c_sectorBytes - 1) / c_sectorBytes * c_sectorBytes;
+	m_maxFrames = maxFrames;
+	m_policy = policy;
+
+	m_isUnbuffered = true;
+	m_file = CreateFileA(fileName.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED | FILE_FLAG_NO_BUFFERING, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		m_isUnbuffered = false;
+		m_file = CreateFileA(fileName.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (m_file == INVALID_HANDLE_VALUE)
+		{
+			cout << "cannot create stream file " << fileName << endl;
+			return false;
+		}
+		cout << "unbuffered writes not supported for " << fileName << ", using the file cache" << endl;
+	}
+
+	// reserve the whole file up front so writes never extend it; marking the
+	// data valid needs SE_MANAGE_VOLUME_NAME, without it NTFS zero fills ahead
+	// of the writes and serializes every write past the valid data length,
+	// which still works but may drop frames at high rates
+	LARGE_INTEGER fileSize;
+	fileSize.QuadPart = (LONGLONG)(m_slotBytes * maxFrames);
+	if (!SetFilePointerEx(m_file, fileSize, NULL, FILE_BEGIN) || !SetEndOfFile(m_file))
+	{
+		cout << "cannot preallocate " << fileSize.QuadPart / (1024 * 1024) << " MB for " << fileName << endl;
+		Close();
+		return false;
+	}
+	if (!SetFileValidData(m_file, fileSize.QuadPart))
+	{
+		cout << "cannot mark " << fileName << " as valid data (error " << GetLastError()
+			<< "), writes are serialized by the file system and frames may be dropped" << endl;
+	}
+
+	// one extra slot takes frames that are dropped
+	m_slotMemory = (unsigned char*)VirtualAlloc(NULL, m_slotBytes * (slotCount + 1), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	if (m_slotMemory == NULL)
+	{
+		cout << "cannot allocate " << slotCount << " stream slots" << endl;
+		Close();
+		return false;
+	}
+	m_slots.resize(slotCount);
+	for (int k = 0; k < slotCount; k++)
+	{
+		Slot& slot = m_slots[k];
+		slot.data = m_slotMemory + m_slotBytes * k;
+		ZeroMemory(&slot.overlapped, sizeof(OVERLAPPED));
+		slot.overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+		slot.isPending = false;
+	}
+	m_dropBuffer = m_slotMemory + m_slotBytes * slotCount;
+	m_nextSlot = 0;
+	m_isDropping = false;
+	m_droppedFrames = 0;
+	m_failedWrites = 0;
+	m_index.clear();
+	m_index.reserve(maxFrames);
+	return true;
+}
+
+//--------------------------------------------------------------------
+// Wait for the writes in flight, trim the file to the recorded frames
+// and write the index
+//--------------------------------------------------------------------
+bool CRawStreamRecorder::Close(void)
+{
+	if (!IsOpen())
+	{
+		return false;
+	}
+
+	bool isWritten = true;
+	for (int k = 0; k < m_slots.size(); k++)
+	{
+		if (m_slots[k].isPending)
+		{
+			isWritten = _waitSlot(m_slots[k]) && isWritten;
+		}
+		CloseHandle(m_slots[k].overlapped.hEvent);
+	}
+	m_slots.clear();
+
+	// the recorded size is a multiple of the slot size, so the unbuffered
+	// handle can set it
+	LARGE_INTEGER fileSize;
+	fileSize.QuadPart = (LONGLONG)(m_slotBytes * m_index.size());
+	SetFilePointerEx(m_file, fileSize, NULL, FILE_BEGIN);
+	SetEndOfFile(m_file);
+	CloseHandle(m_file);
+	m_file = INVALID_HANDLE_VALUE;
+
+	if (m_slotMemory != NULL)
+	{
+		VirtualFree(m_slotMemory, 0, MEM_RELEASE);
+		m_slotMemory = NULL;
+		m_dropBuffer = NULL;
+	}
+
+	isWritten = _saveIndex() && isWritten;
+	cout << "recorded " << m_index.size() << " frames to " << m_fileName;
+	if (m_droppedFrames > 0)
+	{
+		cout << ", dropped " << m_droppedFrames;
+	}
+	if (m_failedWrites > 0)
+	{
+		cout << ", " << m_failedWrites << " of them not written";
+	}
+	cout << endl;
+	return isWritten;
+}
+
+//--------------------------------------------------------------------
+// Buffer to capture the next frame into
+// With BLOCK this waits until the oldest write has finished; with
+// DROP_NEWEST, when the file is full or when the oldest write failed,
+// a scratch buffer is returned and the frame is counted as dropped by
+// Submit(), so the stream goes on
+//
+// Output:
+//		NULL only if the recorder is not open
+//--------------------------------------------------------------------
+unsigned char* CRawStreamRecorder::AcquireSlot(void)
+{
+	if (!IsOpen())
+	{
+		return NULL;
+	}
+	m_isDropping = true;
+	if (m_index.size() >= m_maxFrames)
+	{
+		return m_dropBuffer;
+	}
+
+	Slot& slot = m_slots[m_nextSlot];
+	if (slot.isPending)
+	{
+		if (m_policy == DROP_NEWEST && !HasOverlappedIoCompleted(&slot.overlapped))
+		{
+			return m_dropBuffer;
+		}
+		if (!_waitSlot(slot))
+		{
+			m_failedWrites++;
+			return m_dropBuffer;
+		}
+	}
+	m_isDropping = false;
+	return slot.data;
+}
+
+//--------------------------------------------------------------------
+// Queue the frame captured into the last acquired slot
+// A write that cannot be queued counts the frame as dropped
+//
+// Input:
+//		frameCounter	= embedded frame counter of the frame
+//		timeStamp		= host time of the frame in seconds
+//--------------------------------------------------------------------
+bool CRawStreamRecorder::Submit(unsigned long frameCounter, double timeStamp)
+{
+	if (!IsOpen())
+	{
+		return false;
+	}
+	if (m_isDropping)
+	{
+		m_isDropping = false;
+		m_droppedFrames++;
+		return true;
+	}
+
+	Slot& slot = m_slots[m_nextSlot];
+	RawStreamIndexEntry entry;
+	entry.frameCounter = frameCounter;
+	entry.timeStamp = timeStamp;
+	entry.offset = (unsigned long long)m_slotBytes * m_index.size();
+
+	slot.overlapped.Offset = (DWORD)(entry.offset & 0xFFFFFFFF);
+	slot.overlapped.OffsetHigh = (DWORD)(entry.offset >> 32);
+	ResetEvent(slot.overlapped.hEvent);
+	if (!WriteFile(m_file, slot.data, (DWORD)m_slotBytes, NULL, &slot.overlapped) && GetLastError() != ERROR_IO_PENDING)
+	{
+		cout << "stream write failed at frame " << frameCounter << " (error " << GetLastError() << ")" << endl;
+		m_droppedFrames++;
+		return true;
+	}
+	slot.isPending = true;
+	m_index.push_back(entry);
+	m_nextSlot = (m_nextSlot + 1) % (int)m_slots.size();
+	return true;
+}
+
+bool CRawStreamRecorder::_waitSlot(Slot& slot)
+{
+	DWORD written = 0;
+	BOOL isDone = GetOverlappedResult(m_file, &slot.overlapped, &written, TRUE);
+	slot.isPending = false;
+	if (!isDone || written != m_slotBytes)
+	{
+		cout << "stream write did not complete (error " << GetLastError() << ")" << endl;
+		return false;
+	}
+	return true;
+}
+
+// header: width height bytesPerPixel slotBytes frames, then one line per
+// frame: frame counter, time stamp in s, byte offset in the stream file
+bool CRawStreamRecorder::_saveIndex(void) const
+{
+	string indexName = m_fileName.substr(0, m_fileName.rfind('.')) + "_index.txt";
+	ofstream indexFile(indexName);
+	if (!indexFile.is_open())
+	{
+		cout << "cannot write stream index " << indexName << endl;
+		return false;
+	}
+	indexFile << m_width << " " << m_height << " " << m_bytesPerPixel << " " << m_slotBytes << " " << m_index.size() << endl;
+	indexFile << fixed << setprecision(6);
+	for (int k = 0; k < m_index.size(); k++)
+	{
+		indexFile << m_index[k].frameCounter << " " << m_index[k].timeStamp << " " << m_index[k].offset << endl;
+	}
+	return true;
+}
@@ -0,0 +1,75 @@
+/*
+	 Continuous recording of raw camera frames to one preallocated file.
+	 Frames are captured straight into sector aligned slots of a ring and
+	 written with overlapped, unbuffered WriteFile calls, so the capture
+	 thread never waits for the disk unless the ring is full. A text
+	 index next to the file lists frame counter, time stamp and offset
+	 of every recorded frame.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <Windows.h>
+
+struct RawStreamIndexEntry
+{
+	unsigned long frameCounter;
+	double timeStamp;	// host time of the frame in seconds
+	unsigned long long offset;
+};
+
+class CRawStreamRecorder
+{
+public:
+	// what to do with a new frame when every slot is still being written
+	enum Backpressure { BLOCK = 0, DROP_NEWEST = 1 };
+
+	CRawStreamRecorder(void);
+	~CRawStreamRecorder(void);
+
+	bool Open(const std::string& fileName, int width, int height, int bytesPerPixel, int maxFrames,
+		int slotCount = 32, Backpressure policy = BLOCK);
+	bool Close(void);
+	bool IsOpen(void) const { return m_file != INVALID_HANDLE_VALUE; }
+
+	unsigned char* AcquireSlot(void);
+	bool Submit(unsigned long frameCounter, double timeStamp);
+
+	int GetRecordedFrames(void) const { return (int)m_index.size(); }
+	int GetDroppedFrames(void) const { return m_droppedFrames; }
+	int GetFailedWrites(void) const { return m_failedWrites; }
+	bool IsUnbuffered(void) const { return m_isUnbuffered; }
+
+private:
+	struct Slot
+	{
+		unsigned char* data;
+		OVERLAPPED overlapped;
+		bool isPending;
+	};
+
+	bool _waitSlot(Slot& slot);
+	bool _saveIndex(void) const;
+
+	HANDLE m_file;
+	std::string m_fileName;
+	bool m_isUnbuffered;
+	Backpressure m_policy;
+
+	int m_width, m_height, m_bytesPerPixel;
+	size_t m_frameBytes;
+	size_t m_slotBytes;		// frame size rounded up to the sector size
+	int m_maxFrames;
+
+	std::vector<Slot> m_slots;
+	unsigned char* m_slotMemory;
+	unsigned char* m_dropBuffer;	// captures a frame that cannot be queued
+	int m_nextSlot;
+	bool m_isDropping;
+	int m_droppedFrames;
+	int m_failedWrites;		// frames in the index whose write failed
+
+	std::vector<RawStreamIndexEntry> m_index;
+};
@@ -0,0 +1,269 @@
+#include "RectifyRemap.h"
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+
+CRectifyRemap::CRectifyRemap(void)
+{
+}
+
+CRectifyRemap::~CRectifyRemap(void)
+{
+}
+
+//--------------------------------------------------------------------
+// Load a camera calibration and build its maps
+// The file holds K, D, R, P and imageSize as written by FileStorage;
+// R and P come from stereoRectify, without them the frame is only
+// undistorted
+//--------------------------------------------------------------------
+bool CRectifyRemap::LoadCalibration(const string& fileName)
+{
+	FileStorage fs(fileName, FileStorage::READ);
+	if (!fs.isOpened())
+	{
+		cout << "cannot open calibration " << fileName << endl;
+		return false;
+	}
+	Mat cameraMatrix, distCoeffs, rectification, projection;
+	Size imageSize;
+	fs["K"] >> cameraMatrix;
+	fs["D"] >> distCoeffs;
+	fs["R"] >> rectification;
+	fs["P"] >> projection;
+	fs["imageSize"] >> imageSize;
+	if (cameraMatrix.empty() || imageSize.area() == 0)
+	{
+		cout << "calibration " << fileName << " needs K and imageSize" << endl;
+		return false;
+	}
+	if (projection.empty())
+	{
+		projection = cameraMatrix;
+	}
+	return BuildMaps(cameraMatrix, distCoeffs, rectification, projection, imageSize);
+}
+
+//--------------------------------------------------------------------
+// Precompute the fixed-point map
+//
+// Input:
+//		imageSize	= size of the full camera frame, which is also the
+//					  size of the rectified output
+//--------------------------------------------------------------------
+bool CRectifyRemap::BuildMaps(const Mat& cameraMatrix, const Mat& distCoeffs, const Mat& rectification, const Mat& projection, Size imageSize)
+{
+	initUndistortRectifyMap(cameraMatrix, distCoeffs, rectification, projection, imageSize, CV_16SC2, m_mapXY, m_mapWeights);
+	m_imageSize = imageSize;
+
+	// bilinear weights in Q14 for each of the INTER_TAB_SIZE^2 sub-pixel
+	// positions; the last weight takes the rounding so they sum to one
+	const int tableSize = INTER_TAB_SIZE * INTER_TAB_SIZE;
+	const int one = 1 << c_weightBits;
+	m_weightTable.resize(tableSize * 4);
+	for (int i = 0; i < tableSize; i++)
+	{
+		float fx = (float)(i % INTER_TAB_SIZE) / INTER_TAB_SIZE;
+		float fy = (float)(i / INTER_TAB_SIZE) / INTER_TAB_SIZE;
+		int* w = &m_weightTable[i * 4];
+		w[0] = cvRound((1.0f - fx) * (1.0f - fy) * one);
+		w[1] = cvRound(fx * (1.0f - fy) * one);
+		w[2] = cvRound((1.0f - fx) * fy * one);
+		w[3] = one - w[0] - w[1] - w[2];
+	}
+	return true;
+}
+
+//--------------------------------------------------------------------
+// Rectify every frame of a set
+//
+// Input:
+//		srcFringeMat	= 8-bit or 16-bit frames, possibly a ROI of the camera frame
+//		dstFringeMat	= rectified frames at the calibration image size
+//		srcOffset		= position of the ROI in the calibrated camera frame
+//--------------------------------------------------------------------
+bool CRectifyRemap::RemapSet(const vector<Mat>& srcFringeMat, vector<Mat>& dstFringeMat, Point srcOffset) const
+{
+	if (!_checkSet(srcFringeMat, 0, (int)srcFringeMat.size()))
+	{
+		return false;
+	}
+	dstFringeMat.resize(srcFringeMat.size());
+	for (int k = 0; k < srcFringeMat.size(); k++)
+	{
+		dstFringeMat[k].create(m_imageSize, srcFringeMat[k].type());
+	}
+
+	bool isHighBitDepth = srcFringeMat[0].depth() == CV_16U;
+	parallel_for_(Range(0, _tileCount()), [&](const Range& range)
+	{
+		for (int t = range.start; t < range.end; t++)
+		{
+			if (isHighBitDepth) _remapTile<unsigned short>(srcFringeMat, dstFringeMat, _tileRect(t), srcOffset);
+			else _remapTile<unsigned char>(srcFringeMat, dstFringeMat, _tileRect(t), srcOffset);
+		}
+	});
+	return true;
+}
+
+//--------------------------------------------------------------------
+// N-step phase shifting on rectified frames without storing them
+// Same output as CFringeProcessor::computeWrappedPhase applied to the
+// result of RemapSet; the interpolated intensities only live in
+// registers while they are added into the per-tile sums
+//--------------------------------------------------------------------
+bool CRectifyRemap::RemapPhase(const vector<Mat>& srcFringeMat, int firstFrame, int phaseSteps, Mat& phase, Mat& modulation, Point srcOffset) const
+{
+	if (phaseSteps < 3 || !_checkSet(srcFringeMat, firstFrame, phaseSteps))
+	{
+		return false;
+	}
+	phase.create(m_imageSize, CV_32FC1);
+	modulation.create(m_imageSize, CV_32FC1);
+
+	bool isHighBitDepth = srcFringeMat[firstFrame].depth() == CV_16U;
+	parallel_for_(Range(0, _tileCount()), [&](const Range& range)
+	{
+		for (int t = range.start; t < range.end; t++)
+		{
+			if (isHighBitDepth) _remapPhaseTile<unsigned short>(srcFringeMat, firstFrame, phaseSteps, phase, modulation, _tileRect(t), srcOffset);
+			else _remapPhaseTile<unsigned char>(srcFringeMat, firstFrame, phaseSteps, phase, modulation, _tileRect(t), srcOffset);
+		}
+	});
+	return true;
+}
+
+bool CRectifyRemap::_checkSet(const vector<Mat>& srcFringeMat, int firstFrame, int frameNo) const
+{
+	if (!IsLoaded())
+	{
+		cout << "rectification maps are not built" << endl;
+		return false;
+	}
+	if (firstFrame < 0 || frameNo < 1 || firstFrame + frameNo > (int)srcFringeMat.size())
+	{
+		cout << "invalid frame range for rectification" << endl;
+		return false;
+	}
+	for (int k = firstFrame; k < firstFrame + frameNo; k++)
+	{
+		const Mat& frame = srcFringeMat[k];
+		if (frame.channels() != 1 || (frame.depth() != CV_8U && frame.depth() != CV_16U) || frame.size() != srcFringeMat[firstFrame].size())
+		{
+			cout << "rectification needs single channel 8-bit or 16-bit frames of one size" << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+int CRectifyRemap::_tileCount(void) const
+{
+	int tilesX = (m_imageSize.width + c_tileWidth - 1) / c_tileWidth;
+	int tilesY = (m_imageSize.height + c_tileHeight - 1) / c_tileHeight;
+	return tilesX * tilesY;
+}
+
+Rect CRectifyRemap::_tileRect(int tileIndex) const
+{
+	int tilesX = (m_imageSize.width + c_tileWidth - 1) / c_tileWidth;
+	Rect tile((tileIndex % tilesX) * c_tileWidth, (tileIndex / tilesX) * c_tileHeight, c_tileWidth, c_tileHeight);
+	return tile & Rect(0, 0, m_imageSize.width, m_imageSize.height);
+}
+
+// bilinear interpolation in Q14; pixels whose 2x2 neighbourhood leaves the
+// source frame are set to zero
+template <typename T>
+void CRectifyRemap::_remapTile(const vector<Mat>& srcFringeMat, vector<Mat>& dstFringeMat, Rect tile, Point srcOffset) const
+{
+	const int srcWidth = srcFringeMat[0].cols;
+	const int srcHeight = srcFringeMat[0].rows;
+	const int* weightTable = m_weightTable.data();
+	const int half = 1 << (c_weightBits - 1);
+
+	// frames in the outer loop: the map tile stays in cache for the whole set
+	for (int k = 0; k < srcFringeMat.size(); k++)
+	{
+		const Mat& src = srcFringeMat[k];
+		const size_t srcStep = src.step1();
+		for (int y = tile.y; y < tile.y + tile.height; y++)
+		{
+			const short* xy = m_mapXY.ptr<short>(y) + 2 * tile.x;
+			const unsigned short* weightIndex = m_mapWeights.ptr<unsigned short>(y) + tile.x;
+			T* dst = dstFringeMat[k].ptr<T>(y) + tile.x;
+			for (int x = 0; x < tile.width; x++)
+			{
+				int sx = xy[2 * x] - srcOffset.x;
+				int sy = xy[2 * x + 1] - srcOffset.y;
+				if ((unsigned)sx >= (unsigned)(srcWidth - 1) || (unsigned)sy >= (unsigned)(srcHeight - 1))
+				{
+					dst[x] = 0;
+					continue;
+				}
+				const T* p = src.ptr<T>(sy) + sx;
+				const int* w = weightTable + 4 * weightIndex[x];
+				dst[x] = (T)((p[0] * w[0] + p[1] * w[1] + p[srcStep] * w[2] + p[srcStep + 1] * w[3] + half) >> c_weightBits);
+			}
+		}
+	}
+}
+
+template <typename T>
+void CRectifyRemap::_remapPhaseTile(const vector<Mat>& srcFringeMat, int firstFrame, int phaseSteps,
+	Mat& phase, Mat& modulation, Rect tile, Point srcOffset) const
+{
+	const int srcWidth = srcFringeMat[firstFrame].cols;
+	const int srcHeight = srcFringeMat[firstFrame].rows;
+	const int* weightTable = m_weightTable.data();
+	const float weightScale = 1.0f / (1 << c_weightBits);
+
+	float sinSum[c_tileWidth * c_tileHeight];
+	float cosSum[c_tileWidth * c_tileHeight];
+	memset(sinSum, 0, sizeof(sinSum));
+	memset(cosSum, 0, sizeof(cosSum));
+
+	for (int k = 0; k < phaseSteps; k++)
+	{
+		const Mat& src = srcFringeMat[firstFrame + k];
+		const size_t srcStep = src.step1();
+		double delta = 2.0 * CV_PI * k / phaseSteps;
+		float sinDelta = (float)sin(delta) * weightScale;
+		float cosDelta = (float)cos(delta) * weightScale;
+		for (int y = 0; y < tile.height; y++)
+		{
+			const short* xy = m_mapXY.ptr<short>(tile.y + y) + 2 * tile.x;
+			const unsigned short* weightIndex = m_mapWeights.ptr<unsigned short>(tile.y + y) + tile.x;
+			float* s = sinSum + y * c_tileWidth;
+			float* c = cosSum + y * c_tileWidth;
+			for (int x = 0; x < tile.width; x++)
+			{
+				int sx = xy[2 * x] - srcOffset.x;
+				int sy = xy[2 * x + 1] - srcOffset.y;
+				if ((unsigned)sx >= (unsigned)(srcWidth - 1) || (unsigned)sy >= (unsigned)(srcHeight - 1))
+				{
+					continue;
+				}
+				const T* p = src.ptr<T>(sy) + sx;
+				const int* w = weightTable + 4 * weightIndex[x];
+				float intensity = (float)(p[0] * w[0] + p[1] * w[1] + p[srcStep] * w[2] + p[srcStep + 1] * w[3]);
+				s[x] += intensity * sinDelta;
+				c[x] += intensity * cosDelta;
+			}
+		}
+	}
+
+	float modulationScale = 2.0f / phaseSteps;
+	for (int y = 0; y < tile.height; y++)
+	{
+		const float* s = sinSum + y * c_tileWidth;
+		const float* c = cosSum + y * c_tileWidth;
+		float* p = phase.ptr<float>(tile.y + y) + tile.x;
+		float* m = modulation.ptr<float>(tile.y + y) + tile.x;
+		for (int x = 0; x < tile.width; x++)
+		{
+			p[x] = atan2f(-s[x], c[x]);
+			m[x] = modulationScale * sqrtf(s[x] * s[x] + c[x] * c[x]);
+		}
+	}
+}
@@ -0,0 +1,47 @@
+/*
+	 Lens undistortion and epipolar rectification of fringe sets.
+	 The calibration is turned once into a fixed-point map (int16
+	 source coordinates plus a 5-bit sub-pixel weight index) that is
+	 applied tile by tile to all frames of a set, so each map tile is
+	 read from memory once per set instead of once per frame.
+*/
+
+#pragma once
+
+#include "opencv2/opencv.hpp"
+
+using namespace std;
+using namespace cv;
+
+class CRectifyRemap
+{
+public:
+	CRectifyRemap(void);
+	~CRectifyRemap(void);
+
+	bool LoadCalibration(const string& fileName);
+	bool BuildMaps(const Mat& cameraMatrix, const Mat& distCoeffs, const Mat& rectification, const Mat& projection, Size imageSize);
+	bool IsLoaded(void) const { return !m_mapXY.empty(); }
+	Size GetImageSize(void) const { return m_imageSize; }
+
+	bool RemapSet(const vector<Mat>& srcFringeMat, vector<Mat>& dstFringeMat, Point srcOffset = Point(0, 0)) const;
+	bool RemapPhase(const vector<Mat>& srcFringeMat, int firstFrame, int phaseSteps, Mat& phase, Mat& modulation,
+		Point srcOffset = Point(0, 0)) const;
+
+private:
+	bool _checkSet(const vector<Mat>& srcFringeMat, int firstFrame, int frameNo) const;
+	template <typename T> void _remapTile(const vector<Mat>& srcFringeMat, vector<Mat>& dstFringeMat, Rect tile, Point srcOffset) const;
+	template <typename T> void _remapPhaseTile(const vector<Mat>& srcFringeMat, int firstFrame, int phaseSteps,
+		Mat& phase, Mat& modulation, Rect tile, Point srcOffset) const;
+	Rect _tileRect(int tileIndex) const;
+	int _tileCount(void) const;
+
+	static const int c_tileWidth = 64;
+	static const int c_tileHeight = 16;
+	static const int c_weightBits = 14;
+
+	Size m_imageSize;
+	Mat m_mapXY;				// CV_16SC2 integer source coordinates
+	Mat m_mapWeights;			// CV_16UC1 index into the weight table
+	vector<int> m_weightTable;	// four bilinear weights per sub-pixel position
+};
@@ -0,0 +1,130 @@
+#include "ReviewPyramid.h"
+#include "FringeKernels.h"
+#include <cmath>
+#include <iostream>
+#include <direct.h>
+
+
+CReviewPyramid::CReviewPyramid(void)
+	: m_frameCount(0), m_addedFrames(0), m_columns(1)
+{
+}
+
+CReviewPyramid::~CReviewPyramid(void)
+{
+}
+
+// start a set of frameCount frames; the contact sheet is close to square
+void CReviewPyramid::Begin(int frameCount)
+{
+	m_frameCount = frameCount;
+	m_addedFrames = 0;
+	m_columns = (std::max)(1, (int)ceil(sqrt((double)frameCount)));
+	m_frameSize = Size(0, 0);
+	m_contactSheet.release();
+}
+
+//--------------------------------------------------------------------
+// Reduce one frame into the contact sheet and the mean accumulators
+// Input:
+//		frameIndex	= position of the frame in the set
+//		frame		= CV_8UC1 or CV_16UC1, all frames of a set the same size
+//--------------------------------------------------------------------
+void CReviewPyramid::AddFrame(int frameIndex, const Mat& frame)
+{
+	if (frameIndex < 0 || frameIndex >= m_frameCount || frame.channels() != 1)
+	{
+		return;
+	}
+	bool isFirstFrame = m_addedFrames == 0;
+	if (isFirstFrame)
+	{
+		m_frameSize = frame.size();
+		int tileWidth = frame.cols / 8;
+		int tileHeight = frame.rows / 8;
+		int rows = (m_frameCount + m_columns - 1) / m_columns;
+		m_contactSheet = Mat::zeros(tileHeight * rows, tileWidth * m_columns, CV_8UC1);
+		m_halfSum.resize((size_t)(frame.cols / 2) * (frame.rows / 2));
+		m_thumb.resize((size_t)tileWidth * tileHeight);
+	}
+	else if (frame.size() != m_frameSize)
+	{
+		cout << "review frame " << frameIndex << " differs in size, skipped" << endl;
+		return;
+	}
+
+	int tileWidth = m_frameSize.width / 8;
+	int tileHeight = m_frameSize.height / 8;
+	if (frame.depth() == CV_16U)
+	{
+		int stride = (int)(frame.step / sizeof(unsigned short));
+		FringeKernels::thumbnail8x8(frame.ptr<unsigned short>(), frame.cols, frame.rows, stride, m_thumb.data());
+		FringeKernels::accumulateBlocks2x2(frame.ptr<unsigned short>(), frame.cols, frame.rows, stride, m_halfSum.data(), isFirstFrame);
+	}
+	else
+	{
+		int stride = (int)frame.step;
+		FringeKernels::thumbnail8x8(frame.ptr<unsigned char>(), frame.cols, frame.rows, stride, m_thumb.data());
+		FringeKernels::accumulateBlocks2x2(frame.ptr<unsigned char>(), frame.cols, frame.rows, stride, m_halfSum.data(), isFirstFrame);
+	}
+	m_addedFrames++;
+
+	// 8x8 block sums to the block mean, rounded
+	int tileX = (frameIndex % m_columns) * tileWidth;
+	int tileY = (frameIndex / m_columns) * tileHeight;
+	for (int y = 0; y < tileHeight; y++)
+	{
+		const unsigned short* t = m_thumb.data() + (size_t)y * tileWidth;
+		unsigned char* dst = m_contactSheet.ptr<unsigned char>(tileY + y) + tileX;
+		for (int x = 0; x < tileWidth; x++)
+		{
+			dst[x] = (unsigned char)((t[x] + 32) >> 6);
+		}
+	}
+}
+
+// write contact.png, mean2.png and mean4.png into reviewDir
+bool CReviewPyramid::Save(const string& reviewDir)
+{
+	if (m_addedFrames == 0)
+	{
+		return false;
+	}
+	_mkdir(reviewDir.c_str());
+
+	int halfWidth = m_frameSize.width / 2;
+	int halfHeight = m_frameSize.height / 2;
+	Mat meanHalf(halfHeight, halfWidth, CV_8UC1);
+	unsigned int halfCount = 4 * m_addedFrames;
+	for (int y = 0; y < halfHeight; y++)
+	{
+		const unsigned int* sum = m_halfSum.data() + (size_t)y * halfWidth;
+		unsigned char* dst = meanHalf.ptr<unsigned char>(y);
+		for (int x = 0; x < halfWidth; x++)
+		{
+			dst[x] = (unsigned char)((sum[x] + halfCount / 2) / halfCount);
+		}
+	}
+
+	// the quarter scale mean comes from the same sums, not from the rounded half
+	int quarterWidth = halfWidth / 2;
+	int quarterHeight = halfHeight / 2;
+	Mat meanQuarter(quarterHeight, quarterWidth, CV_8UC1);
+	unsigned int quarterCount = 4 * halfCount;
+	for (int y = 0; y < quarterHeight; y++)
+	{
+		const unsigned int* sum0 = m_halfSum.data() + (size_t)2 * y * halfWidth;
+		const unsigned int* sum1 = sum0 + halfWidth;
+		unsigned char* dst = meanQuarter.ptr<unsigned char>(y);
+		for (int x = 0; x < quarterWidth; x++)
+		{
+			unsigned int sum = sum0[2 * x] + sum0[2 * x + 1] + sum1[2 * x] + sum1[2 * x + 1];
+			dst[x] = (unsigned char)((sum + quarterCount / 2) / quarterCount);
+		}
+	}
+
+	bool isSaved = imwrite(reviewDir + "/contact.png", m_contactSheet);
+	isSaved = imwrite(reviewDir + "/mean2.png", meanHalf) && isSaved;
+	isSaved = imwrite(reviewDir + "/mean4.png", meanQuarter) && isSaved;
+	return isSaved;
+}
@@ -0,0 +1,35 @@
+/*
+	 Small review images of a fringe set, built while the set is saved:
+	 a contact sheet of every frame at 1/8 scale and the mean texture
+	 at 1/2 and 1/4 scale. Each frame is reduced once, right after it
+	 was written, so QA tools can browse positions without reading the
+	 full resolution frames. Review images are 8-bit.
+*/
+
+#pragma once
+
+#include "opencv2/opencv.hpp"
+
+using namespace std;
+using namespace cv;
+
+class CReviewPyramid
+{
+public:
+	CReviewPyramid(void);
+	~CReviewPyramid(void);
+
+	void Begin(int frameCount);
+	void AddFrame(int frameIndex, const Mat& frame);
+	bool Save(const string& reviewDir);
+
+private:
+	int m_frameCount;
+	int m_addedFrames;
+	int m_columns;
+	Size m_frameSize;
+
+	Mat m_contactSheet;			// CV_8UC1, frames at 1/8 in rows of m_columns
+	vector<unsigned int> m_halfSum;	// 2x2 block sums over all frames
+	vector<unsigned short> m_thumb;
+};
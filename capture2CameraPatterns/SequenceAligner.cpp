@@ -0,0 +1,285 @@
+#include "SequenceAligner.h"
+#include "FringeKernels.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+
+CSequenceAligner::CSequenceAligner(void)
+	: m_modulationThreshold(20.0f), m_thumbWidth(0), m_thumbHeight(0)
+{
+}
+
+CSequenceAligner::~CSequenceAligner(void)
+{
+}
+
+// the pattern set the projector runs by default: brightFrames white
+// frames followed by the fringe frames
+void CSequenceAligner::SetDefaultCodebook(int frameCount, int brightFrames)
+{
+	m_levels.assign(frameCount, 0.5f);
+	m_isFringe.assign(frameCount, true);
+	for (int k = 0; k < brightFrames && k < frameCount; k++)
+	{
+		m_levels[k] = 1.0f;
+		m_isFringe[k] = false;
+	}
+}
+
+void CSequenceAligner::SetCodebook(const vector<float>& levels, const vector<bool>& isFringe)
+{
+	m_levels = levels;
+	m_isFringe = isFringe;
+	m_isFringe.resize(m_levels.size(), true);
+}
+
+//--------------------------------------------------------------------
+// Read a codebook, one line per projected pattern in projection order:
+// "<level> <isFringe>", level is the expected mean brightness relative
+// to white (0 black, 0.5 sinusoid, 1 white) and isFringe 0 for marker
+// patterns that are only used for alignment
+//--------------------------------------------------------------------
+bool CSequenceAligner::LoadCodebook(const string& fileName)
+{
+	ifstream codebookFile(fileName);
+	if (!codebookFile.is_open())
+	{
+		cout << "cannot open codebook " << fileName << endl;
+		return false;
+	}
+	vector<float> levels;
+	vector<bool> isFringe;
+	float level;
+	int fringe;
+	while (codebookFile >> level >> fringe)
+	{
+		levels.push_back(level);
+		isFringe.push_back(fringe != 0);
+	}
+	if (levels.size() < 2)
+	{
+		cout << "codebook " << fileName << " needs at least two patterns" << endl;
+		return false;
+	}
+	SetCodebook(levels, isFringe);
+	return true;
+}
+
+void CSequenceAligner::Reset(void)
+{
+	m_thumbnails.clear();
+	m_hasFrame.clear();
+}
+
+//--------------------------------------------------------------------
+// Reduce one frame of the cycle to its thumbnail
+// Cheap enough to run on the capture thread as each frame arrives
+//
+// Input:
+//		frameIndex		= position of the frame in capture order
+//		frameData		= width * height pixels, 8-bit or 16-bit
+//--------------------------------------------------------------------
+void CSequenceAligner::AddFrame(int frameIndex, const unsigned char* frameData, int width, int height, int bytesPerPixel)
+{
+	if (frameIndex < 0)
+	{
+		return;
+	}
+	int thumbWidth = width / 8;
+	int thumbHeight = height / 8;
+	if (thumbWidth != m_thumbWidth || thumbHeight != m_thumbHeight)
+	{
+		Reset();
+		m_thumbWidth = thumbWidth;
+		m_thumbHeight = thumbHeight;
+	}
+	if (frameIndex >= (int)m_thumbnails.size())
+	{
+		m_thumbnails.resize(frameIndex + 1);
+		m_hasFrame.resize(frameIndex + 1, false);
+	}
+
+	vector<unsigned short>& thumb = m_thumbnails[frameIndex];
+	thumb.resize((size_t)thumbWidth * thumbHeight);
+	if (bytesPerPixel == 2)
+	{
+		FringeKernels::thumbnail8x8((const unsigned short*)frameData, width, height, width, thumb.data());
+	}
+	else
+	{
+		FringeKernels::thumbnail8x8(frameData, width, height, width, thumb.data());
+	}
+	m_hasFrame[frameIndex] = true;
+}
+
+void CSequenceAligner::AddFrame(int frameIndex, const Mat& frame)
+{
+	Mat continuousFrame = frame.isContinuous() ? frame : frame.clone();
+	AddFrame(frameIndex, continuousFrame.data, continuousFrame.cols, continuousFrame.rows, (int)continuousFrame.elemSize());
+}
+
+// true when a thumbnail exists for every pattern of the codebook
+bool CSequenceAligner::HasAllFrames(void) const
+{
+	if (m_levels.empty() || m_hasFrame.size() != m_levels.size())
+	{
+		return false;
+	}
+	for (int k = 0; k < m_hasFrame.size(); k++)
+	{
+		if (!m_hasFrame[k]) return false;
+	}
+	return true;
+}
+
+//--------------------------------------------------------------------
+// Cyclic offset of the captured frames against the codebook
+// Output:
+//		offset		= capture index of codebook pattern 0
+//		confidence	= peak correlation minus the runner-up; near 0 the
+//					  sequence is ambiguous, ~1 and above is a clear match
+//--------------------------------------------------------------------
+bool CSequenceAligner::Align(int& offset, float& confidence) const
+{
+	offset = 0;
+	confidence = 0;
+	if (!HasAllFrames())
+	{
+		cout << "sequence alignment needs " << m_levels.size() << " frames, got " << m_thumbnails.size() << endl;
+		return false;
+	}
+	int frameCount = (int)m_levels.size();
+	size_t cellCount = (size_t)m_thumbWidth * m_thumbHeight;
+
+	// cells whose brightness follows the projector; dark background and
+	// saturated cells only dilute the signatures
+	vector<unsigned short> maxThumb(m_thumbnails[0]), minThumb(m_thumbnails[0]);
+	for (int k = 1; k < frameCount; k++)
+	{
+		const unsigned short* t = m_thumbnails[k].data();
+		for (size_t c = 0; c < cellCount; c++)
+		{
+			maxThumb[c] = (std::max)(maxThumb[c], t[c]);
+			minThumb[c] = (std::min)(minThumb[c], t[c]);
+		}
+	}
+	const int cellThreshold = (int)(m_modulationThreshold * 64);
+	vector<unsigned char> cellMask(cellCount);
+	size_t maskedCells = 0;
+	for (size_t c = 0; c < cellCount; c++)
+	{
+		cellMask[c] = maxThumb[c] - minThumb[c] > cellThreshold;
+		maskedCells += cellMask[c];
+	}
+	if (maskedCells == 0)
+	{
+		cellMask.assign(cellCount, 1);
+	}
+
+	// zero mean, unit norm signatures and codebook, so the correlation is
+	// independent of object reflectivity and exposure
+	vector<double> signature(frameCount), codebook(m_levels.begin(), m_levels.end());
+	for (int k = 0; k < frameCount; k++)
+	{
+		const unsigned short* t = m_thumbnails[k].data();
+		double sum = 0;
+		for (size_t c = 0; c < cellCount; c++)
+		{
+			if (cellMask[c]) sum += t[c];
+		}
+		signature[k] = sum;
+	}
+	for (vector<double>* values : { &signature, &codebook })
+	{
+		double mean = 0, norm = 0;
+		for (double v : *values) mean += v;
+		mean /= frameCount;
+		for (double& v : *values) { v -= mean; norm += v * v; }
+		norm = sqrt(norm);
+		if (norm > 0)
+		{
+			for (double& v : *values) v /= norm;
+		}
+	}
+
+	double bestCorrelation = -2, secondCorrelation = -2;
+	for (int shift = 0; shift < frameCount; shift++)
+	{
+		double correlation = 0;
+		for (int k = 0; k < frameCount; k++)
+		{
+			correlation += signature[(k + shift) % frameCount] * codebook[k];
+		}
+		if (correlation > bestCorrelation)
+		{
+			secondCorrelation = bestCorrelation;
+			bestCorrelation = correlation;
+			offset = shift;
+		}
+		else if (correlation > secondCorrelation)
+		{
+			secondCorrelation = correlation;
+		}
+	}
+	confidence = (float)(bestCorrelation - secondCorrelation);
+	return true;
+}
+
+//--------------------------------------------------------------------
+// Align a captured cycle and keep only its fringe frames, in projection
+// order; thumbnails added while capturing are used if complete,
+// otherwise they are built from rawFringeMat; a codebook of another
+// length than the cycle fails and leaves outputFringeMat untouched
+// captureIndex, if given, receives the capture position of each output frame
+//--------------------------------------------------------------------
+bool CSequenceAligner::AlignSequence(const vector<Mat>& rawFringeMat, vector<Mat>& outputFringeMat, float& confidence, vector<int>* captureIndex)
+{
+	if (m_levels.empty())
+	{
+		SetDefaultCodebook((int)rawFringeMat.size());
+	}
+	else if (m_levels.size() != rawFringeMat.size())
+	{
+		cout << "codebook has " << m_levels.size() << " patterns, the cycle has " << rawFringeMat.size() << " frames" << endl;
+		confidence = 0;
+		return false;
+	}
+	if (!HasAllFrames())
+	{
+		Reset();
+		for (int k = 0; k < rawFringeMat.size(); k++)
+		{
+			AddFrame(k, rawFringeMat[k]);
+		}
+	}
+
+	int offset = 0;
+	bool isAligned = Align(offset, confidence);
+	if (isAligned && confidence < 0.1f)
+	{
+		cout << "sequence alignment is ambiguous (confidence " << confidence << ")" << endl;
+	}
+	ApplyOffset(rawFringeMat, offset, outputFringeMat, captureIndex);
+	Reset();
+	return isAligned;
+}
+
+// output frame j is codebook pattern j, skipping the marker patterns
+void CSequenceAligner::ApplyOffset(const vector<Mat>& rawFringeMat, int offset, vector<Mat>& outputFringeMat, vector<int>* captureIndex) const
+{
+	int frameCount = (int)rawFringeMat.size();
+	for (int k = 0; k < frameCount; k++)
+	{
+		if (k < m_isFringe.size() && !m_isFringe[k])
+		{
+			continue;
+		}
+		outputFringeMat.push_back(rawFringeMat[(k + offset) % frameCount].clone());
+		if (captureIndex)
+		{
+			captureIndex->push_back((k + offset) % frameCount);
+		}
+	}
+}
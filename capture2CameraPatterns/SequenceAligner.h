@@ -0,0 +1,47 @@
+/*
+	 Finds where a captured pattern cycle starts by matching the frame
+	 brightness sequence against a codebook of the projected patterns.
+	 Each frame is reduced to an 8x8 block-sum thumbnail as it arrives;
+	 the signature of a frame is its mean over the thumbnail cells that
+	 respond to the projector, and the cyclic offset is the peak of the
+	 normalized cross-correlation of signatures and codebook levels.
+*/
+
+#pragma once
+
+#include "opencv2/opencv.hpp"
+
+using namespace std;
+using namespace cv;
+
+class CSequenceAligner
+{
+public:
+	CSequenceAligner(void);
+	~CSequenceAligner(void);
+
+	void SetDefaultCodebook(int frameCount, int brightFrames = 2);
+	void SetCodebook(const vector<float>& levels, const vector<bool>& isFringe);
+	bool LoadCodebook(const string& fileName);
+	int GetCodebookSize(void) const { return (int)m_levels.size(); }
+	const vector<bool>& GetFringePatterns(void) const { return m_isFringe; }
+	void SetModulationThreshold(float threshold) { m_modulationThreshold = threshold; }
+
+	void Reset(void);
+	void AddFrame(int frameIndex, const unsigned char* frameData, int width, int height, int bytesPerPixel);
+	void AddFrame(int frameIndex, const Mat& frame);
+	bool HasAllFrames(void) const;
+
+	bool Align(int& offset, float& confidence) const;
+	bool AlignSequence(const vector<Mat>& rawFringeMat, vector<Mat>& outputFringeMat, float& confidence, vector<int>* captureIndex = NULL);
+	void ApplyOffset(const vector<Mat>& rawFringeMat, int offset, vector<Mat>& outputFringeMat, vector<int>* captureIndex = NULL) const;
+
+private:
+	vector<float> m_levels;		// expected relative brightness per pattern
+	vector<bool> m_isFringe;	// false for marker patterns dropped after alignment
+	float m_modulationThreshold;
+
+	int m_thumbWidth, m_thumbHeight;
+	vector<vector<unsigned short>> m_thumbnails;
+	vector<bool> m_hasFrame;
+};
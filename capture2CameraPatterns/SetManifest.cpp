@@ -0,0 +1,213 @@
+#include "SetManifest.h"
+#include "FringeCodec.h"
+#include "FringeKernels.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+static const char* c_manifestName = "/manifest.crc";
+static const char* c_manifestHeader = "# crc32c manifest v1\n";
+static const size_t c_readChunkSize = 1 << 20;
+
+static bool isFringeSetFile(const string& fileName)
+{
+	return fileName.size() > 4 && fileName.compare(fileName.size() - 4, 4, ".fsc") == 0;
+}
+
+
+CSetManifest::CSetManifest(void)
+{
+}
+
+CSetManifest::~CSetManifest(void)
+{
+}
+
+void CSetManifest::AddFile(const string& fileName, unsigned long long fileSize, unsigned int fileCrc, unsigned int pixelCrc)
+{
+	ManifestEntry entry;
+	entry.fileName = fileName;
+	entry.fileSize = fileSize;
+	entry.fileCrc = fileCrc;
+	entry.pixelCrc = pixelCrc;
+	m_entries.push_back(entry);
+}
+
+// the manifest is written in binary mode so its checksum covers the exact bytes
+bool CSetManifest::Write(const string& setDir) const
+{
+	string text = c_manifestHeader;
+	char line[512];
+	for (const ManifestEntry& entry : m_entries)
+	{
+		snprintf(line, sizeof(line), "%s %llu %08x %08x\n", entry.fileName.c_str(), entry.fileSize, entry.fileCrc, entry.pixelCrc);
+		text += line;
+	}
+	snprintf(line, sizeof(line), "manifest %08x\n", FringeKernels::crc32c(text.data(), text.size()));
+	text += line;
+
+	string fileName = setDir + c_manifestName;
+	FILE* manifestFile = fopen(fileName.c_str(), "wb");
+	if (!manifestFile)
+	{
+		cout << "cannot write " << fileName << endl;
+		return false;
+	}
+	bool isWritten = fwrite(text.data(), 1, text.size(), manifestFile) == text.size();
+	isWritten = fclose(manifestFile) == 0 && isWritten;
+	return isWritten;
+}
+
+// read and check the manifest of a set; a manifest that does not match its
+// own checksum is rejected
+bool CSetManifest::Read(const string& setDir)
+{
+	m_entries.clear();
+	string fileName = setDir + c_manifestName;
+	FILE* manifestFile = fopen(fileName.c_str(), "rb");
+	if (!manifestFile)
+	{
+		return false;
+	}
+	string text;
+	char chunk[4096];
+	size_t readSize;
+	while ((readSize = fread(chunk, 1, sizeof(chunk), manifestFile)) > 0)
+	{
+		text.append(chunk, readSize);
+	}
+	fclose(manifestFile);
+
+	size_t checksumLine = text.rfind("manifest ");
+	unsigned int manifestCrc = 0;
+	if (checksumLine == string::npos || sscanf(text.c_str() + checksumLine, "manifest %x", &manifestCrc) != 1 ||
+		FringeKernels::crc32c(text.data(), checksumLine) != manifestCrc)
+	{
+		cout << fileName << " is damaged" << endl;
+		return false;
+	}
+
+	size_t lineStart = 0;
+	while (lineStart < checksumLine)
+	{
+		size_t lineEnd = text.find('\n', lineStart);
+		string line = text.substr(lineStart, lineEnd - lineStart);
+		lineStart = lineEnd + 1;
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+		char name[260];
+		ManifestEntry entry;
+		if (sscanf(line.c_str(), "%259s %llu %x %x", name, &entry.fileSize, &entry.fileCrc, &entry.pixelCrc) != 4)
+		{
+			cout << fileName << " has an invalid line: " << line << endl;
+			return false;
+		}
+		entry.fileName = name;
+		m_entries.push_back(entry);
+	}
+	return true;
+}
+
+//--------------------------------------------------------------------
+// Check the files of a set against the manifest
+// Input:
+//		isDecoded	= also decode every frame and check its pixels
+// Output:
+//		errors		= one message per missing or changed file
+//		bytesRead	= file bytes read for the check
+//		true if every file matches
+//--------------------------------------------------------------------
+bool CSetManifest::Verify(const string& setDir, bool isDecoded, vector<string>& errors, unsigned long long& bytesRead) const
+{
+	vector<unsigned char> buffer;
+	size_t errorCount = errors.size();
+	for (const ManifestEntry& entry : m_entries)
+	{
+		string fileName = setDir + "/" + entry.fileName;
+		unsigned int fileCrc = 0;
+		unsigned long long fileSize = 0;
+		if (!FileChecksum(fileName, fileCrc, fileSize, buffer))
+		{
+			errors.push_back(fileName + ": cannot be read");
+			continue;
+		}
+		bytesRead += fileSize;
+		if (fileSize != entry.fileSize)
+		{
+			errors.push_back(fileName + ": size " + to_string(fileSize) + ", expected " + to_string(entry.fileSize));
+			continue;
+		}
+		if (fileCrc != entry.fileCrc)
+		{
+			errors.push_back(fileName + ": checksum mismatch");
+			continue;
+		}
+		if (isDecoded && isFringeSetFile(entry.fileName))
+		{
+			vector<unsigned char> setBytes;
+			vector<Mat> frames;
+			unsigned int pixelCrc = 0;
+			bool isDecodedSet = CFringeCodec::ReadFile(fileName, setBytes) && CFringeCodec().DecodeSet(setBytes, frames);
+			for (const Mat& frame : frames)
+			{
+				pixelCrc = PixelChecksum(frame, pixelCrc);
+			}
+			if (!isDecodedSet || pixelCrc != entry.pixelCrc)
+			{
+				errors.push_back(fileName + ": pixel checksum mismatch");
+			}
+		}
+		else if (isDecoded)
+		{
+			Mat frame = imread(fileName, IMREAD_UNCHANGED);
+			if (frame.empty() || PixelChecksum(frame) != entry.pixelCrc)
+			{
+				errors.push_back(fileName + ": pixel checksum mismatch");
+			}
+		}
+	}
+	return errors.size() == errorCount;
+}
+
+// CRC32C of the pixel rows without row padding, continued from crc
+unsigned int CSetManifest::PixelChecksum(const Mat& frame, unsigned int crc)
+{
+	size_t rowSize = frame.cols * frame.elemSize();
+	if (frame.isContinuous())
+	{
+		return FringeKernels::crc32c(frame.data, rowSize * frame.rows, crc);
+	}
+	for (int y = 0; y < frame.rows; y++)
+	{
+		crc = FringeKernels::crc32c(frame.ptr(y), rowSize, crc);
+	}
+	return crc;
+}
+
+// stream a file through the checksum in 1 MiB reads; buffer is reused between calls
+bool CSetManifest::FileChecksum(const string& fileName, unsigned int& crc, unsigned long long& fileSize, vector<unsigned char>& buffer)
+{
+	FILE* file = fopen(fileName.c_str(), "rb");
+	if (!file)
+	{
+		return false;
+	}
+	setvbuf(file, NULL, _IONBF, 0);
+	if (buffer.size() < c_readChunkSize)
+	{
+		buffer.resize(c_readChunkSize);
+	}
+	crc = 0;
+	fileSize = 0;
+	size_t readSize;
+	while ((readSize = fread(buffer.data(), 1, buffer.size(), file)) > 0)
+	{
+		crc = FringeKernels::crc32c(buffer.data(), readSize, crc);
+		fileSize += readSize;
+	}
+	bool isRead = ferror(file) == 0;
+	fclose(file);
+	return isRead;
+}
@@ -0,0 +1,54 @@
+/*
+	 CRC32C manifest of a saved set, <set>/manifest.crc. Each frame file
+	 has a line with its size, the CRC32C of the file bytes and the
+	 CRC32C of the frame pixels (rows without padding); the last line is
+	 the CRC32C of the manifest text above it. The file checksum is
+	 taken from the encoded frame while it is in memory, so an archive
+	 is verified by reading the files without decoding them; the pixel
+	 checksum checks the decoded frame when that is wanted. A fringe set
+	 file (set.fsc) holds all frames, its pixel checksum runs over the
+	 frames in order.
+
+	 # crc32c manifest v1
+	 f0.png 1843921 5b8a6f0c 09d1e2a7
+	 ...
+	 manifest 3c41e9d2
+*/
+
+#pragma once
+
+#include "opencv2/opencv.hpp"
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace cv;
+
+struct ManifestEntry
+{
+	string fileName;			// relative to the set directory
+	unsigned long long fileSize;
+	unsigned int fileCrc;
+	unsigned int pixelCrc;
+};
+
+class CSetManifest
+{
+public:
+	CSetManifest(void);
+	~CSetManifest(void);
+
+	void Clear(void) { m_entries.clear(); }
+	void AddFile(const string& fileName, unsigned long long fileSize, unsigned int fileCrc, unsigned int pixelCrc);
+	const vector<ManifestEntry>& GetEntries(void) const { return m_entries; }
+
+	bool Write(const string& setDir) const;
+	bool Read(const string& setDir);
+	bool Verify(const string& setDir, bool isDecoded, vector<string>& errors, unsigned long long& bytesRead) const;
+
+	static unsigned int PixelChecksum(const Mat& frame, unsigned int crc = 0);
+	static bool FileChecksum(const string& fileName, unsigned int& crc, unsigned long long& fileSize, vector<unsigned char>& buffer);
+
+private:
+	vector<ManifestEntry> m_entries;
+};
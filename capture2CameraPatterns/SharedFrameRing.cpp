@@ -0,0 +1,396 @@
+#include "SharedFrameRing.h"
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+// ring layout: one page of ring header, then per slot one page of slot
+// header followed by the page aligned payload
+static const DWORD c_ringMagic = 0x474E5246;	// "FRNG"
+static const size_t c_pageBytes = 4096;
+
+struct SharedRingHeader
+{
+	volatile DWORD magic;
+	DWORD slotCount;
+	unsigned long long slotBytes;
+	volatile LONG64 publishedCount;
+	volatile LONG readerProcess[c_maxSharedReaders];	// 0 while the entry is free
+};
+
+struct SharedSlotHeader
+{
+	volatile LONG64 lock;	// odd while the publisher writes the slot
+	SharedFrameInfo info;
+};
+
+static SharedRingHeader* ringHeader(unsigned char* view)
+{
+	return (SharedRingHeader*)view;
+}
+
+static SharedSlotHeader* slotHeader(unsigned char* view, size_t slotStride, long long sequence)
+{
+	int slot = (int)((sequence - 1) % ringHeader(view)->slotCount);
+	return (SharedSlotHeader*)(view + c_pageBytes + slotStride * slot);
+}
+
+static unsigned char* slotPayload(SharedSlotHeader* header)
+{
+	return (unsigned char*)header + c_pageBytes;
+}
+
+static size_t slotStrideFor(unsigned long long slotBytes)
+{
+	return c_pageBytes + (size_t)((slotBytes + c_pageBytes - 1) / c_pageBytes * c_pageBytes);
+}
+
+static string eventName(const string& ringName, int readerIndex)
+{
+	return "Local\\" + ringName + "_reader" + to_string(readerIndex);
+}
+
+// false once the process has exited; a process we may not query is alive
+static bool isProcessAlive(DWORD processId)
+{
+	HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
+	if (process == NULL)
+	{
+		return GetLastError() == ERROR_ACCESS_DENIED;
+	}
+	DWORD exitCode = 0;
+	bool isAlive = GetExitCodeProcess(process, &exitCode) && exitCode == STILL_ACTIVE;
+	CloseHandle(process);
+	return isAlive;
+}
+
+
+CSharedFramePublisher::CSharedFramePublisher(void)
+	: m_mapping(NULL), m_view(NULL), m_slotStride(0)
+{
+	for (int k = 0; k < c_maxSharedReaders; k++)
+	{
+		m_readerEvents[k] = NULL;
+	}
+}
+
+CSharedFramePublisher::~CSharedFramePublisher(void)
+{
+	Close();
+}
+
+//--------------------------------------------------------------------
+// Create the named ring, or attach to the ring of an earlier run that
+// a reader still holds open
+//
+// Input:
+//		name		= ring name, readers open the same name
+//		slotBytes	= largest payload, frame bytes times frames per set
+//		slotCount	= payloads kept; a reader has slotCount - 1 publishes
+//					  of time to use a mapped payload
+//--------------------------------------------------------------------
+bool CSharedFramePublisher::Create(const string& name, size_t slotBytes, int slotCount)
+{
+	Close();
+	m_name = name;
+	m_slotStride = slotStrideFor(slotBytes);
+	unsigned long long mappingBytes = c_pageBytes + (unsigned long long)m_slotStride * slotCount;
+	string mappingName = "Local\\" + name;
+	m_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+		(DWORD)(mappingBytes >> 32), (DWORD)(mappingBytes & 0xFFFFFFFF), mappingName.c_str());
+	if (m_mapping == NULL)
+	{
+		cout << "cannot create shared frame ring " << name << endl;
+		return false;
+	}
+	bool isExisting = GetLastError() == ERROR_ALREADY_EXISTS;
+	m_view = (unsigned char*)MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, (size_t)mappingBytes);
+	if (m_view == NULL)
+	{
+		cout << "cannot map shared frame ring " << name << " (" << mappingBytes / (1024 * 1024) << " MB)" << endl;
+		Close();
+		return false;
+	}
+
+	SharedRingHeader* header = ringHeader(m_view);
+	if (isExisting)
+	{
+		if (header->magic == c_ringMagic && header->slotCount == slotCount && header->slotBytes == slotBytes)
+		{
+			return true;
+		}
+		cout << "shared frame ring " << name << " is in use with another size" << endl;
+		Close();
+		return false;
+	}
+	// a new mapping is zero filled; the magic is written last so a reader
+	// never sees a half initialised header
+	header->slotCount = slotCount;
+	header->slotBytes = slotBytes;
+	MemoryBarrier();
+	header->magic = c_ringMagic;
+	return true;
+}
+
+void CSharedFramePublisher::Close(void)
+{
+	for (int k = 0; k < c_maxSharedReaders; k++)
+	{
+		if (m_readerEvents[k] != NULL)
+		{
+			CloseHandle(m_readerEvents[k]);
+			m_readerEvents[k] = NULL;
+		}
+	}
+	if (m_view != NULL)
+	{
+		UnmapViewOfFile(m_view);
+		m_view = NULL;
+	}
+	if (m_mapping != NULL)
+	{
+		CloseHandle(m_mapping);
+		m_mapping = NULL;
+	}
+}
+
+//--------------------------------------------------------------------
+// Copy a frame or a set into the next slot and wake the readers
+// Never waits: a reader still using the overwritten slot finds out
+// from IsValid()
+//
+// Input:
+//		frames	= info.frameCount frames of width * height * bytesPerPixel
+//		info	= geometry and frame counter, the sequence is set here
+//--------------------------------------------------------------------
+bool CSharedFramePublisher::Publish(const unsigned char* const frames[], SharedFrameInfo info)
+{
+	if (!IsOpen())
+	{
+		return false;
+	}
+	SharedRingHeader* header = ringHeader(m_view);
+	size_t frameBytes = (size_t)info.width * info.height * info.bytesPerPixel;
+	if (frameBytes * info.frameCount > header->slotBytes)
+	{
+		cout << info.frameCount << " frames do not fit the slots of shared frame ring " << m_name << endl;
+		return false;
+	}
+
+	long long sequence = header->publishedCount + 1;
+	SharedSlotHeader* slot = slotHeader(m_view, m_slotStride, sequence);
+	unsigned char* payload = slotPayload(slot);
+	InterlockedIncrement64(&slot->lock);
+	for (int k = 0; k < info.frameCount; k++)
+	{
+		memcpy(payload + frameBytes * k, frames[k], frameBytes);
+	}
+	info.sequence = sequence;
+	slot->info = info;
+	InterlockedIncrement64(&slot->lock);
+	InterlockedExchange64(&header->publishedCount, sequence);
+
+	_notifyReaders();
+	return true;
+}
+
+// set the event of every registered reader; events of readers that
+// registered since the last publish are opened on first use
+void CSharedFramePublisher::_notifyReaders(void)
+{
+	SharedRingHeader* header = ringHeader(m_view);
+	for (int k = 0; k < c_maxSharedReaders; k++)
+	{
+		if (header->readerProcess[k] == 0)
+		{
+			continue;
+		}
+		if (m_readerEvents[k] == NULL)
+		{
+			m_readerEvents[k] = OpenEventA(EVENT_MODIFY_STATE, FALSE, eventName(m_name, k).c_str());
+		}
+		if (m_readerEvents[k] != NULL)
+		{
+			SetEvent(m_readerEvents[k]);
+		}
+	}
+}
+
+
+CSharedFrameReader::CSharedFrameReader(void)
+	: m_mapping(NULL), m_view(NULL), m_slotStride(0), m_readerIndex(-1), m_event(NULL), m_lastSequence(0)
+{
+}
+
+CSharedFrameReader::~CSharedFrameReader(void)
+{
+	Close();
+}
+
+// attach to a ring created by the capture process and register for its
+// publish events
+bool CSharedFrameReader::Open(const string& name)
+{
+	Close();
+	m_name = name;
+	string mappingName = "Local\\" + name;
+	m_mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, mappingName.c_str());
+	if (m_mapping == NULL)
+	{
+		cout << "no shared frame ring " << name << endl;
+		return false;
+	}
+	m_view = (unsigned char*)MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	if (m_view == NULL || ringHeader(m_view)->magic != c_ringMagic)
+	{
+		cout << "shared frame ring " << name << " is not ready" << endl;
+		Close();
+		return false;
+	}
+	SharedRingHeader* header = ringHeader(m_view);
+	m_slotStride = slotStrideFor(header->slotBytes);
+
+	// readers that ended without Close() leave their entry behind; free the
+	// entries of processes that are gone, unless another reader did already
+	for (int k = 0; k < c_maxSharedReaders; k++)
+	{
+		LONG processId = header->readerProcess[k];
+		if (processId != 0 && !isProcessAlive((DWORD)processId))
+		{
+			InterlockedCompareExchange(&header->readerProcess[k], 0, processId);
+		}
+	}
+
+	// a publish between claiming the entry and creating the event is not
+	// lost, WaitForFrame() checks the sequence before it waits
+	for (int k = 0; k < c_maxSharedReaders && m_readerIndex < 0; k++)
+	{
+		if (InterlockedCompareExchange(&header->readerProcess[k], (LONG)GetCurrentProcessId(), 0) == 0)
+		{
+			m_readerIndex = k;
+		}
+	}
+	if (m_readerIndex < 0)
+	{
+		cout << "shared frame ring " << name << " has no free reader entry" << endl;
+		Close();
+		return false;
+	}
+	m_event = CreateEventA(NULL, FALSE, FALSE, eventName(name, m_readerIndex).c_str());
+	m_lastSequence = 0;
+	return true;
+}
+
+void CSharedFrameReader::Close(void)
+{
+	if (m_readerIndex >= 0)
+	{
+		InterlockedExchange(&ringHeader(m_view)->readerProcess[m_readerIndex], 0);
+		m_readerIndex = -1;
+	}
+	if (m_event != NULL)
+	{
+		CloseHandle(m_event);
+		m_event = NULL;
+	}
+	if (m_view != NULL)
+	{
+		UnmapViewOfFile(m_view);
+		m_view = NULL;
+	}
+	if (m_mapping != NULL)
+	{
+		CloseHandle(m_mapping);
+		m_mapping = NULL;
+	}
+}
+
+// true when something was published after the last mapped payload
+bool CSharedFrameReader::WaitForFrame(int timeout_ms)
+{
+	if (!IsOpen())
+	{
+		return false;
+	}
+	SharedRingHeader* header = ringHeader(m_view);
+	if (header->publishedCount > m_lastSequence)
+	{
+		return true;
+	}
+	if (m_event != NULL)
+	{
+		WaitForSingleObject(m_event, timeout_ms);
+	}
+	return header->publishedCount > m_lastSequence;
+}
+
+//--------------------------------------------------------------------
+// Map the newest payload in place, without copying
+// Output:
+//		info	= geometry, frame counter and sequence of the payload
+//		lock	= pass to IsValid() after using the payload
+//		NULL when nothing was published yet
+//--------------------------------------------------------------------
+const unsigned char* CSharedFrameReader::MapLatest(SharedFrameInfo& info, long long& lock)
+{
+	if (!IsOpen())
+	{
+		return NULL;
+	}
+	SharedRingHeader* header = ringHeader(m_view);
+	for (int attempt = 0; attempt < 4; attempt++)
+	{
+		long long sequence = header->publishedCount;
+		if (sequence == 0)
+		{
+			return NULL;
+		}
+		SharedSlotHeader* slot = slotHeader(m_view, m_slotStride, sequence);
+		lock = slot->lock;
+		if (lock & 1)
+		{
+			continue;
+		}
+		info = slot->info;
+		MemoryBarrier();
+		if (slot->lock != lock)
+		{
+			continue;
+		}
+		m_lastSequence = info.sequence;
+		return slotPayload(slot);
+	}
+	return NULL;
+}
+
+// false when the publisher has started to overwrite the mapped payload
+bool CSharedFrameReader::IsValid(const SharedFrameInfo& info, long long lock) const
+{
+	if (!IsOpen())
+	{
+		return false;
+	}
+	MemoryBarrier();
+	return slotHeader(m_view, m_slotStride, info.sequence)->lock == lock;
+}
+
+// copy the newest payload; retried when it is overwritten during the copy
+bool CSharedFrameReader::ReadLatest(SharedFrameInfo& info, vector<unsigned char>& data)
+{
+	for (int attempt = 0; attempt < 4; attempt++)
+	{
+		long long lock = 0;
+		const unsigned char* payload = MapLatest(info, lock);
+		if (payload == NULL)
+		{
+			return false;
+		}
+		size_t payloadBytes = (size_t)info.width * info.height * info.bytesPerPixel * info.frameCount;
+		data.assign(payload, payload + payloadBytes);
+		if (IsValid(info, lock))
+		{
+			return true;
+		}
+	}
+	return false;
+}
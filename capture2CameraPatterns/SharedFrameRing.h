@@ -0,0 +1,73 @@
+/*
+	 Frames and finished sets published to other processes through a
+	 named shared memory ring. Every slot is guarded by a sequence lock:
+	 the publisher never waits for readers, readers map the newest slot
+	 in place and check afterwards that it was not overwritten while
+	 they used it. Each reader registers an event the publisher sets
+	 after every publish, so readers sleep instead of polling.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <Windows.h>
+
+struct SharedFrameInfo
+{
+	long long sequence;		// publish number, starting at 1
+	unsigned long frameCounter;
+	double timeStamp;		// host time in seconds
+	int width, height, bytesPerPixel;
+	int frameCount;			// 1 for a single frame, the frame number of a set
+	int setIndex;			// position of a set, -1 for single frames
+};
+
+static const int c_maxSharedReaders = 8;
+
+class CSharedFramePublisher
+{
+public:
+	CSharedFramePublisher(void);
+	~CSharedFramePublisher(void);
+
+	bool Create(const std::string& name, size_t slotBytes, int slotCount = 4);
+	void Close(void);
+	bool IsOpen(void) const { return m_view != NULL; }
+
+	bool Publish(const unsigned char* const frames[], SharedFrameInfo info);
+
+private:
+	void _notifyReaders(void);
+
+	std::string m_name;
+	HANDLE m_mapping;
+	unsigned char* m_view;
+	size_t m_slotStride;
+	HANDLE m_readerEvents[c_maxSharedReaders];
+};
+
+class CSharedFrameReader
+{
+public:
+	CSharedFrameReader(void);
+	~CSharedFrameReader(void);
+
+	bool Open(const std::string& name);
+	void Close(void);
+	bool IsOpen(void) const { return m_view != NULL; }
+
+	bool WaitForFrame(int timeout_ms);
+	const unsigned char* MapLatest(SharedFrameInfo& info, long long& lock);
+	bool IsValid(const SharedFrameInfo& info, long long lock) const;
+	bool ReadLatest(SharedFrameInfo& info, std::vector<unsigned char>& data);
+
+private:
+	std::string m_name;
+	HANDLE m_mapping;
+	unsigned char* m_view;
+	size_t m_slotStride;
+	int m_readerIndex;
+	HANDLE m_event;
+	long long m_lastSequence;
+};
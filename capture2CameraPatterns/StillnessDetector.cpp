@@ -0,0 +1,92 @@
+#include "StillnessDetector.h"
+#include "FringeKernels.h"
+
+
+CStillnessDetector::CStillnessDetector(float stillTime_ms, float threshold, int cycleFrames)
+	: m_stillTime_s(stillTime_ms / 1000.0f), m_threshold(threshold), m_cycleFrames(1)
+{
+	SetCycleFrames(cycleFrames);
+}
+
+CStillnessDetector::~CStillnessDetector(void)
+{
+}
+
+// frames between two showings of the same pattern, 1 for a static pattern
+void CStillnessDetector::SetCycleFrames(int cycleFrames)
+{
+	m_cycleFrames = cycleFrames > 0 ? cycleFrames : 1;
+	Reset();
+}
+
+// forget the frame history; the first rest after a reset fires
+void CStillnessDetector::Reset(void)
+{
+	m_thumbnails.assign(m_cycleFrames, std::vector<unsigned short>());
+	m_motion = 0;
+	m_stillSince = -1;
+	m_hasMoved = true;
+}
+
+// after a capture: fire again only once the scene moved and came to rest
+void CStillnessDetector::Rearm(void)
+{
+	m_stillSince = -1;
+	m_hasMoved = false;
+}
+
+//--------------------------------------------------------------------
+// Add a preview frame
+// Input:
+//		frameData		= width * height pixels, 8-bit or 16-bit
+//		frameCounter	= embedded frame counter, selects the pattern slot
+//						  so dropped preview frames do not shift the cycle
+//		frameTime		= time stamp of the frame in seconds
+// Output:
+//		true once the scene has been still for the still time
+//--------------------------------------------------------------------
+bool CStillnessDetector::Update(const unsigned char* frameData, int width, int height, int bytesPerPixel,
+	unsigned long frameCounter, double frameTime)
+{
+	int thumbSize = (width / 8) * (height / 8);
+	std::vector<unsigned short>& thumb = m_thumbnails[frameCounter % m_cycleFrames];
+
+	// the slot holds the frame one cycle back; keep it until compared
+	std::vector<unsigned short> current(thumbSize);
+	if (bytesPerPixel == 2)
+	{
+		FringeKernels::thumbnail8x8((const unsigned short*)frameData, width, height, width, current.data());
+	}
+	else
+	{
+		FringeKernels::thumbnail8x8(frameData, width, height, width, current.data());
+	}
+	bool isComparable = thumb.size() == current.size() && thumbSize > 0;
+	if (isComparable)
+	{
+		// block sums are on a 64 x 8-bit scale
+		m_motion = (float)((double)FringeKernels::sumAbsDiff(thumb.data(), current.data(), thumbSize) / (64.0 * thumbSize));
+	}
+	thumb.swap(current);
+	if (!isComparable)
+	{
+		return false;
+	}
+
+	if (m_motion > m_threshold)
+	{
+		m_stillSince = -1;
+		m_hasMoved = true;
+		return false;
+	}
+	if (m_stillSince < 0)
+	{
+		m_stillSince = frameTime;
+	}
+	if (m_hasMoved && frameTime - m_stillSince >= m_stillTime_s)
+	{
+		m_hasMoved = false;
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,40 @@
+/*
+	 Detects when the scene in front of a camera has come to rest, so a
+	 position can be captured without a key press. Preview frames are
+	 reduced to 8x8 block-sum thumbnails and compared with the thumbnail
+	 one projector cycle earlier, which shows the same pattern; the
+	 detector fires once the mean difference has stayed below a
+	 threshold for the still time, and then waits for motion again.
+*/
+
+#pragma once
+
+#include <vector>
+
+class CStillnessDetector
+{
+public:
+	CStillnessDetector(float stillTime_ms = 500.0f, float threshold = 2.0f, int cycleFrames = 1);
+	~CStillnessDetector(void);
+
+	void SetStillTime(float stillTime_ms) { m_stillTime_s = stillTime_ms / 1000.0f; }
+	void SetThreshold(float threshold) { m_threshold = threshold; }
+	void SetCycleFrames(int cycleFrames);
+
+	void Reset(void);
+	void Rearm(void);
+	bool Update(const unsigned char* frameData, int width, int height, int bytesPerPixel,
+		unsigned long frameCounter, double frameTime);
+	float GetMotion(void) const { return m_motion; }
+	bool IsStill(void) const { return m_stillSince >= 0; }
+
+private:
+	float m_stillTime_s;
+	float m_threshold;		// mean absolute difference in 8-bit grey levels
+	int m_cycleFrames;
+
+	std::vector<std::vector<unsigned short>> m_thumbnails;	// last thumbnail per pattern slot
+	float m_motion;
+	double m_stillSince;	// time the scene became still, -1 while moving
+	bool m_hasMoved;		// a capture fires only after the scene moved
+};
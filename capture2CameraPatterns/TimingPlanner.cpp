@@ -0,0 +1,179 @@
+#include "TimingPlanner.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+
+CTimingPlanner::CTimingPlanner(void)
+{
+}
+
+CTimingPlanner::~CTimingPlanner(void)
+{
+}
+
+//--------------------------------------------------------------------
+// Fill the camera dependent part of the configuration from an opened,
+// initialized camera: current ROI, pixel format and the sensor's
+// frame rate limit at these settings
+//--------------------------------------------------------------------
+bool CTimingPlanner::QueryCamera(pointGreyCapture& camera, TimingConfig& config)
+{
+	config.imageWidth = camera.getImageWidth();
+	config.imageHeight = camera.getImageHeight();
+	switch (camera.getPixelFormat())
+	{
+	case PIXEL_FORMAT_RAW12:
+	case PIXEL_FORMAT_MONO12:
+		config.bitsPerPixel = 12;
+		break;
+	case PIXEL_FORMAT_RAW16:
+	case PIXEL_FORMAT_MONO16:
+		config.bitsPerPixel = 16;
+		break;
+	default:
+		config.bitsPerPixel = 8;
+		break;
+	}
+	return camera.getFrameRateLimit(config.sensorMaxFrameRate);
+}
+
+//--------------------------------------------------------------------
+// Shortest trigger period that every stage can sustain
+// Mode 14 reads the previous frame out while the next one is exposed,
+// so the period is bounded by the larger of:
+//		exposure	= trigger delay + exposure, the next trigger must not
+//					  arrive while the sensor is still exposing
+//		sensor		= 1 / sensor max frame rate at this ROI and format
+//		link		= bytes of all cameras per trigger / link bandwidth
+//		buffers		= a host slower than the camera falls behind by
+//					  (1 - period / host time) frames per frame, the
+//					  backlog of one cycle has to fit the buffers
+//
+// Input:
+//		requestedFrameRate	= rate to check, 0 plans the fastest rate
+//--------------------------------------------------------------------
+bool CTimingPlanner::Plan(const TimingConfig& config, TimingPlan& plan, float requestedFrameRate)
+{
+	plan = TimingPlan();
+	if (config.imageWidth <= 0 || config.imageHeight <= 0 || config.cycleFrames <= 0 || config.linkBandwidth_MBps <= 0)
+	{
+		cout << "invalid timing configuration" << endl;
+		return false;
+	}
+
+	double frameBytes = (double)config.imageWidth * config.imageHeight * config.bitsPerPixel / 8.0;
+	double linkBytes = frameBytes * (config.numberOfCameras > 0 ? config.numberOfCameras : 1);
+
+	struct Limit { const char* name; double period_us; };
+	Limit limits[4];
+	limits[0] = { "exposure", config.triggerDelay_us + config.exposureTime_ms * 1000.0 };
+	limits[1] = { "sensor readout", config.sensorMaxFrameRate > 0 ? 1e6 / config.sensorMaxFrameRate : 0.0 };
+	limits[2] = { "link bandwidth", linkBytes / config.linkBandwidth_MBps };
+	double bufferedShare = (double)config.numberOfBuffers / config.cycleFrames;
+	limits[3] = { "host buffers", bufferedShare < 1.0 ? config.hostFrameTime_ms * 1000.0 * (1.0 - bufferedShare) : 0.0 };
+
+	int limitingIndex = 0;
+	for (int i = 1; i < 4; i++)
+	{
+		if (limits[i].period_us > limits[limitingIndex].period_us) limitingIndex = i;
+	}
+	double minimumPeriod_us = limits[limitingIndex].period_us;
+	// the trigger pulse itself must fit as well
+	minimumPeriod_us = (std::max)(minimumPeriod_us, (double)(config.triggerDelay_us + config.triggerPulseWidth_us + 1));
+
+	double period_us = minimumPeriod_us * (1.0 + config.safetyMargin);
+	if (requestedFrameRate > 0)
+	{
+		period_us = 1e6 / requestedFrameRate;
+		if (period_us < minimumPeriod_us)
+		{
+			plan.willDropFrames = true;
+			ostringstream warning;
+			warning << requestedFrameRate << " Hz is faster than the " << limits[limitingIndex].name
+				<< " limit of " << 1e6 / minimumPeriod_us << " Hz";
+			plan.warnings.push_back(warning.str());
+		}
+	}
+
+	plan.period_us = (unsigned long)ceil(period_us);
+	plan.frameRate = (float)(1e6 / plan.period_us);
+	plan.cycleTime_ms = (float)(plan.period_us * config.cycleFrames / 1000.0);
+	plan.limitingFactor = limits[limitingIndex].name;
+	plan.bandwidthUse = (float)(linkBytes / plan.period_us / config.linkBandwidth_MBps);
+
+	// backlog left in the host buffers at the end of one cycle
+	double hostTime_us = config.hostFrameTime_ms * 1000.0;
+	if (hostTime_us > plan.period_us)
+	{
+		plan.peakBufferedFrames = (int)ceil(config.cycleFrames * (1.0 - plan.period_us / hostTime_us));
+	}
+	if (plan.peakBufferedFrames > config.numberOfBuffers)
+	{
+		plan.willDropFrames = true;
+		plan.warnings.push_back("host falls behind by more than the " + to_string(config.numberOfBuffers) + " buffers per cycle");
+	}
+	if (plan.bandwidthUse > 1.0f)
+	{
+		plan.willDropFrames = true;
+		plan.warnings.push_back("link bandwidth is exceeded");
+	}
+	if (config.sensorMaxFrameRate <= 0)
+	{
+		plan.warnings.push_back("sensor frame rate limit unknown, readout is not modelled");
+	}
+	return !plan.willDropFrames;
+}
+
+//--------------------------------------------------------------------
+// Set the camera frame rate property to the plan
+// In trigger mode the property only has to allow the trigger rate, so
+// it is set with the safety margin on top (capped by the sensor), then
+// the exposure is applied again since the frame rate bounds it
+//--------------------------------------------------------------------
+bool CTimingPlanner::Apply(const TimingPlan& plan, const TimingConfig& config, pointGreyCapture& camera)
+{
+	float cameraFrameRate = plan.frameRate * (1.0f + config.safetyMargin);
+	if (config.sensorMaxFrameRate > 0 && cameraFrameRate > config.sensorMaxFrameRate)
+	{
+		cameraFrameRate = config.sensorMaxFrameRate;
+	}
+	float exposureTime = config.exposureTime_ms;
+	return camera.setFrameRate(cameraFrameRate) && camera.setExposureTime(exposureTime);
+}
+
+bool CTimingPlanner::Apply(const TimingPlan& plan, const TimingConfig& config, CTriggerController& trigger)
+{
+	return trigger.Configure(plan.frameRate, config.triggerPulseWidth_us, config.triggerDelay_us);
+}
+
+//--------------------------------------------------------------------
+// Compare the mean frame interval measured over a set with the plan
+//--------------------------------------------------------------------
+bool CTimingPlanner::Validate(const TimingPlan& plan, float measuredFrameInterval_ms, float tolerance)
+{
+	float plannedInterval_ms = plan.period_us / 1000.0f;
+	float deviation = fabs(measuredFrameInterval_ms - plannedInterval_ms) / plannedInterval_ms;
+	cout << "frame interval measured " << measuredFrameInterval_ms << " ms, planned " << plannedInterval_ms << " ms" << endl;
+	return deviation <= tolerance;
+}
+
+void CTimingPlanner::Report(const TimingPlan& plan)
+{
+	ostringstream report;
+	report << "timing plan: " << plan.frameRate << " Hz, period " << plan.period_us << " us, cycle "
+		<< plan.cycleTime_ms << " ms, limited by " << plan.limitingFactor << endl;
+	report << "  link use " << (int)(plan.bandwidthUse * 100.0f + 0.5f) << "%, peak buffered frames " << plan.peakBufferedFrames << endl;
+	for (const string& warning : plan.warnings)
+	{
+		report << "  warning: " << warning << endl;
+	}
+	if (plan.willDropFrames)
+	{
+		report << "  this configuration will drop frames" << endl;
+	}
+	cout << report.str();
+}
@@ -0,0 +1,56 @@
+/*
+	 Capture timing planner for trigger mode 14 (overlapped readout).
+	 Derives the fastest sustainable trigger period for a pattern
+	 cycle from exposure, sensor readout, link bandwidth shared by the
+	 cameras and host buffering, and flags settings that drop frames.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "pointGreyCapture.h"
+#include "TriggerController.h"
+
+struct TimingConfig
+{
+	float exposureTime_ms = 3.0f;
+	int imageWidth = 1920;
+	int imageHeight = 1200;
+	int bitsPerPixel = 8;					// 8, 12 (packed) or 16
+	int numberOfCameras = 2;				// cameras sharing the host link
+	float linkBandwidth_MBps = 380.0f;		// usable bandwidth of the shared link
+	int numberOfBuffers = 60;				// setBufferedGrab
+	float hostFrameTime_ms = 1.0f;			// host time to consume one frame
+	float sensorMaxFrameRate = 0.0f;		// FRAME_RATE absMax at this ROI and format, 0 if unknown
+	unsigned long triggerDelay_us = 200;
+	unsigned long triggerPulseWidth_us = 466;
+	int cycleFrames = 64;
+	float safetyMargin = 0.05f;				// added to the shortest period
+};
+
+struct TimingPlan
+{
+	float frameRate = 0.0f;
+	unsigned long period_us = 0;
+	float cycleTime_ms = 0.0f;
+	std::string limitingFactor;
+	float bandwidthUse = 0.0f;				// fraction of the link in use
+	int peakBufferedFrames = 0;				// host buffers filled at the end of a cycle
+	bool willDropFrames = false;
+	std::vector<std::string> warnings;
+};
+
+class CTimingPlanner
+{
+public:
+	CTimingPlanner(void);
+	~CTimingPlanner(void);
+
+	bool QueryCamera(pointGreyCapture& camera, TimingConfig& config);
+	bool Plan(const TimingConfig& config, TimingPlan& plan, float requestedFrameRate = 0.0f);
+	bool Apply(const TimingPlan& plan, const TimingConfig& config, pointGreyCapture& camera);
+	bool Apply(const TimingPlan& plan, const TimingConfig& config, CTriggerController& trigger);
+	bool Validate(const TimingPlan& plan, float measuredFrameInterval_ms, float tolerance = 0.02f);
+	void Report(const TimingPlan& plan);
+};
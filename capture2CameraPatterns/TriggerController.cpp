@@ -0,0 +1,231 @@
+#include "TriggerController.h"
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+
+CTriggerController::CTriggerController(void)
+	: m_port(INVALID_HANDLE_VALUE)
+{
+}
+
+CTriggerController::~CTriggerController(void)
+{
+	Close();
+}
+
+//--------------------------------------------------------------------
+// Open the board's COM port at 115200 8N1
+// Opening the port resets most Arduino boards, so wait for the
+// READY line the sketch prints from setup()
+//
+// Input:
+//		portName		= e.g. "COM3"
+//		bootTimeout_ms	= how long to wait for READY
+//--------------------------------------------------------------------
+bool CTriggerController::Open(const string& portName, int bootTimeout_ms)
+{
+	Close();
+	string devicePath = "\\\\.\\" + portName;
+	m_port = CreateFileA(devicePath.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+	if (m_port == INVALID_HANDLE_VALUE)
+	{
+		cout << "cannot open trigger port " << portName << endl;
+		return false;
+	}
+
+	DCB dcb;
+	memset(&dcb, 0, sizeof(dcb));
+	dcb.DCBlength = sizeof(dcb);
+	GetCommState(m_port, &dcb);
+	dcb.BaudRate = CBR_115200;
+	dcb.ByteSize = 8;
+	dcb.Parity = NOPARITY;
+	dcb.StopBits = ONESTOPBIT;
+	dcb.fBinary = TRUE;
+	dcb.fDtrControl = DTR_CONTROL_ENABLE;
+	dcb.fRtsControl = RTS_CONTROL_DISABLE;
+	dcb.fOutxCtsFlow = FALSE;
+	dcb.fOutxDsrFlow = FALSE;
+	dcb.fOutX = FALSE;
+	dcb.fInX = FALSE;
+	if (!SetCommState(m_port, &dcb))
+	{
+		cout << "cannot configure trigger port " << portName << endl;
+		Close();
+		return false;
+	}
+
+	// reads return as soon as bytes are available, or after 10 ms
+	COMMTIMEOUTS timeouts;
+	memset(&timeouts, 0, sizeof(timeouts));
+	timeouts.ReadIntervalTimeout = MAXDWORD;
+	timeouts.ReadTotalTimeoutMultiplier = MAXDWORD;
+	timeouts.ReadTotalTimeoutConstant = 10;
+	timeouts.WriteTotalTimeoutConstant = 100;
+	SetCommTimeouts(m_port, &timeouts);
+	PurgeComm(m_port, PURGE_RXCLEAR | PURGE_TXCLEAR);
+	m_pending.clear();
+
+	string line;
+	ULONGLONG deadline = GetTickCount64() + bootTimeout_ms;
+	while (GetTickCount64() < deadline)
+	{
+		if (_readLine(line, (int)(deadline - GetTickCount64())) && line == "READY")
+		{
+			return true;
+		}
+	}
+	// boards that do not reset on open never print READY, ask instead
+	string settings;
+	if (Query(settings))
+	{
+		return true;
+	}
+	cout << "no trigger board answers on " << portName << endl;
+	Close();
+	return false;
+}
+
+void CTriggerController::Close(void)
+{
+	if (m_port != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_port);
+		m_port = INVALID_HANDLE_VALUE;
+	}
+}
+
+bool CTriggerController::SetPeriod(unsigned long period_us)
+{
+	string reply;
+	return _sendCommand("P " + to_string(period_us), reply);
+}
+
+bool CTriggerController::SetPulseWidth(unsigned long width_us)
+{
+	string reply;
+	return _sendCommand("W " + to_string(width_us), reply);
+}
+
+bool CTriggerController::SetDelay(unsigned long delay_us)
+{
+	string reply;
+	return _sendCommand("D " + to_string(delay_us), reply);
+}
+
+// stop after the given number of cycles, 0 runs until Stop()
+bool CTriggerController::SetBurst(unsigned long cycles)
+{
+	string reply;
+	return _sendCommand("B " + to_string(cycles), reply);
+}
+
+bool CTriggerController::Start(void)
+{
+	string reply;
+	return _sendCommand("S", reply);
+}
+
+bool CTriggerController::Stop(void)
+{
+	string reply;
+	return _sendCommand("X", reply);
+}
+
+// settings as reported by the board: "P<us> W<us> D<us> B<n> R<0|1>"
+bool CTriggerController::Query(string& settings)
+{
+	return _sendCommand("?", settings);
+}
+
+//--------------------------------------------------------------------
+// Program a free running trigger at the given frame rate
+// The board checks each value against the current ones, so the order
+// is chosen to keep delay + width < period at every step
+//--------------------------------------------------------------------
+bool CTriggerController::Configure(float frameRate, unsigned long width_us, unsigned long delay_us)
+{
+	if (frameRate <= 0)
+	{
+		return false;
+	}
+	unsigned long period_us = (unsigned long)(1000000.0f / frameRate + 0.5f);
+	if (delay_us + width_us >= period_us)
+	{
+		cout << "trigger pulse does not fit a " << frameRate << " Hz period" << endl;
+		return false;
+	}
+	bool isConfigured = Stop() && SetDelay(0) && SetPulseWidth(1) && SetPeriod(period_us) &&
+		SetPulseWidth(width_us) && SetDelay(delay_us) && SetBurst(0) && Start();
+	if (isConfigured)
+	{
+		cout << "trigger set to " << frameRate << " Hz (" << period_us << " us)" << endl;
+	}
+	return isConfigured;
+}
+
+// send one command line and wait for its OK/ERR reply; other lines the
+// board prints on its own (READY, DONE) are skipped
+bool CTriggerController::_sendCommand(const string& command, string& reply)
+{
+	if (!IsOpen())
+	{
+		cout << "trigger port is not open" << endl;
+		return false;
+	}
+	string line = command + "\n";
+	DWORD written = 0;
+	if (!WriteFile(m_port, line.c_str(), (DWORD)line.size(), &written, NULL) || written != line.size())
+	{
+		cout << "cannot write to trigger port" << endl;
+		return false;
+	}
+
+	ULONGLONG deadline = GetTickCount64() + 500;
+	while (GetTickCount64() < deadline)
+	{
+		if (!_readLine(line, (int)(deadline - GetTickCount64())))
+		{
+			continue;
+		}
+		if (line.compare(0, 3, "OK ") == 0)
+		{
+			reply = line.substr(3);
+			return true;
+		}
+		if (line.compare(0, 4, "ERR ") == 0)
+		{
+			cout << "trigger board rejected \"" << command << "\": " << line.substr(4) << endl;
+			return false;
+		}
+	}
+	cout << "trigger board did not answer \"" << command << "\"" << endl;
+	return false;
+}
+
+// read one line, keeping any partial line for the next call
+bool CTriggerController::_readLine(string& line, int timeout_ms)
+{
+	ULONGLONG deadline = GetTickCount64() + (timeout_ms > 0 ? timeout_ms : 0);
+	do
+	{
+		size_t end = m_pending.find('\n');
+		if (end != string::npos)
+		{
+			line = m_pending.substr(0, end);
+			m_pending.erase(0, end + 1);
+			if (!line.empty() && line.back() == '\r') line.pop_back();
+			return true;
+		}
+		char buffer[64];
+		DWORD bytesRead = 0;
+		if (!ReadFile(m_port, buffer, sizeof(buffer), &bytesRead, NULL))
+		{
+			return false;
+		}
+		m_pending.append(buffer, bytesRead);
+	} while (GetTickCount64() < deadline);
+	return false;
+}
@@ -0,0 +1,39 @@
+/*
+	 Host side of the serial protocol of the Arduino trigger board
+	 (Arduino_15Hz_delay.ino): period, camera pulse width, projector
+	 to camera delay and burst count are set over a COM port, so the
+	 trigger rate follows the capture settings without reflashing.
+*/
+
+#pragma once
+
+#include <string>
+#include <Windows.h>
+
+class CTriggerController
+{
+public:
+	CTriggerController(void);
+	~CTriggerController(void);
+
+	bool Open(const std::string& portName, int bootTimeout_ms = 3000);
+	void Close(void);
+	bool IsOpen(void) const { return m_port != INVALID_HANDLE_VALUE; }
+
+	bool SetPeriod(unsigned long period_us);
+	bool SetPulseWidth(unsigned long width_us);
+	bool SetDelay(unsigned long delay_us);
+	bool SetBurst(unsigned long cycles);
+	bool Start(void);
+	bool Stop(void);
+	bool Query(std::string& settings);
+
+	bool Configure(float frameRate, unsigned long width_us, unsigned long delay_us);
+
+private:
+	bool _sendCommand(const std::string& command, std::string& reply);
+	bool _readLine(std::string& line, int timeout_ms);
+
+	HANDLE m_port;
+	std::string m_pending;
+};
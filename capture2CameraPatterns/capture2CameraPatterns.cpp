@@ -2,9 +2,13 @@
 //
 
 #include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <functional>
 #include <thread>
 #include <Windows.h>
 #include <direct.h>
+#include <io.h>
 
 #include "opencv2/opencv.hpp"
 
@@ -13,10 +17,25 @@
 #include "opencv2/calib3d/calib3d.hpp"
 #include "opencv2/features2d/features2d.hpp"
 #include "PngFileIO.h"
+#include "FringeProcessing.h"
+#include "FringeTypes.h"
+#include "FringeKernels.h"
+#include "AutoExposure.h"
+#include "RectifyRemap.h"
+#include "TriggerController.h"
+#include "TimingPlanner.h"
+#include "CaptureControl.h"
+#include "RawStreamRecorder.h"
+#include "SharedFrameRing.h"
+#include "StillnessDetector.h"
+#include "ReviewPyramid.h"
+#include "FrameTrace.h"
+#include "SetManifest.h"
+#include "FrameQualityGate.h"
+#include "FrameStreamServer.h"
+#include "FringeCodec.h"
 #include "pointGreyCapture.h"
 
-std::mutex mtx;
-
 Ptr<cv::SimpleBlobDetector> markerDetector()
 {
     SimpleBlobDetector::Params detectorParams;
@@ -65,14 +84,175 @@ public:
     float frameRate = 15.0;
     float expTime = 3.0f;
 
-    bool stopCapture = false;
+    // COM port of the Arduino trigger board; when set the board is programmed
+    // to frameRate before capture, otherwise it keeps its power-up 15 Hz timing
+    string triggerPort;
+    unsigned long triggerPulseWidth_us = 466;
+    unsigned long triggerDelay_us = 200;
+
+    // replace frameRate by the fastest rate exposure, readout, link bandwidth
+    // and host buffers sustain for both cameras, and check it per camera
+    bool planTiming = false;
+    float linkBandwidth_MBps = 380.0f;
+    float hostFrameTime_ms = 1.0f;
+    TimingPlan m_timingPlan;
+
+    // adjust each camera's exposure during preview so the brightest 1% of the
+    // scene sits just below saturation; expTime is the starting point
+    bool autoExposure = false;
+
+    // RAW8 or, for more phase precision, 12-bit packed / 16-bit formats
+    // high bit depth frames are stored as 16-bit MSB aligned pixels
+    PixelFormat pixelFormat = PIXEL_FORMAT_RAW8;
+
+    // number of consecutive pattern cycles averaged into one set for better SNR
+    int averageCycles = 1;
+
+    // HDR: exposure times in ms, one pattern cycle each, fused into a 16-bit set
+    // leave empty for a single exposure at expTime; 8-bit pixel formats only
+    vector<float> hdrExposureTimes;
+
+    // projected pattern sequence for aligning sets, see CSequenceAligner::LoadCodebook;
+    // empty: two bright frames followed by the fringe frames
+    string codebookFile;
+
+    // check every set frame as it arrives and report when a frame dropped
+    // out (mean below qualityMinMeanRatio of the set's median frame), more
+    // than qualityMaxSaturated of its fringe pixels reach
+    // qualitySaturationLevel (the marker patterns are meant to be bright),
+    // or the set is dark; qualityFile gives per pattern limits, including
+    // the focus check (see CFrameQualityGate); with qualityReject such a
+    // set is captured again, and not written if it still fails after
+    // setCaptureAttempts
+    bool qualityGate = true;
+    bool qualityReject = false;
+    string qualityFile;
+    float qualityBlackLevel = 8.0f;
+    float qualityMinMeanRatio = 0.25f;
+    float qualityMaxSaturated = 0.05f;
+    int qualitySaturationLevel = 250;
+
+    // write <set>/manifest.crc with the CRC32C of every frame file and its
+    // pixels, taken while the frame is in memory for encoding; check an
+    // archive against it with datasetTool verify
+    bool writeManifest = true;
+
+    // write <set>/review/contact.png (all frames at 1/8) and mean2.png /
+    // mean4.png (mean texture at 1/2 and 1/4) while a set is saved
+    bool saveReview = true;
+
+    // save each set as one losslessly coded <set>/set.fsc instead of a PNG per
+    // frame; bands of fringeBandRows rows are coded in parallel, and a frame
+    // reads back from the keyframe at most fringeKeyframeInterval - 1 before it
+    bool fringeCodec = false;
+    int fringeBandRows = 64;
+    int fringeKeyframeInterval = 8;
+
+    // folder with calib<serial>.yml per camera (K, D, R, P, imageSize for the
+    // full frame at m_offsetX/m_offsetY); when set, rectified sets are saved
+    // next to the raw ones in posEval<N>/rect
+    string calibrationDir;
+
+    // ESC in any preview ends the preview of all cameras, q quits; the
+    // cameras then arm, capture and commit each position together
+    CCaptureControl m_captureControl;
+
+    // capture a position on its own once the preview has been still for
+    // stillTime_ms: the mean difference to the frame one projector cycle
+    // (stillCycleFrames) earlier stays below stillThreshold grey levels;
+    // after a capture the scene has to move before the next one fires
+    bool autoTrigger = false;
+    float stillTime_ms = 500.0f;
+    float stillThreshold = 2.0f;
+    int stillCycleFrames = 64;
+
+    // a motion stage requests the next position by creating this file,
+    // it is deleted when the capture starts
+    string triggerFile;
+
+    // keep the preview stream running into the set capture; the set starts at
+    // the next cycle boundary of the embedded frame counter instead of after a
+    // stop/start of the camera (auto ROI still restarts to change the readout)
+    bool continuousAcquisition = false;
+    int setCaptureAttempts = 3;
+
+    // a frame retrieve gives up after grabTimeout_ms, 0 derives it from the
+    // frame period (-1 waits forever); a stalled stream is restarted, or the
+    // camera reconnected, and the set is captured again from the next cycle;
+    // faultPeriod > 0 fails faultCount retrieves every faultPeriod frames
+    // with faultError to exercise the recovery (2 faults force a reconnect)
+    int grabTimeout_ms = 0;
+    int faultPeriod = 0;
+    int faultCount = 1;
+    ErrorType faultError = PGRERROR_TIMEOUT;
+
+    // read every camera setting back after bring-up and report those the
+    // camera does not hold, a check of the configuration cache and setters
+    bool verifyCameraConfig = false;
+
+    // record a continuous stream instead of one set per position: recordFrameNo
+    // raw frames per camera go to posEval<N>/stream.raw with an index file;
+    // recordSlots frames may wait for the disk before the backpressure applies
+    int recordFrameNo = 0;
+    int recordSlots = 64;
+    CRawStreamRecorder::Backpressure recordBackpressure = CRawStreamRecorder::BLOCK;
+
+    // publish preview frames and finished sets to other processes through the
+    // shared memory rings fringeFrames<serial> and fringeSets<serial>
+    bool sharedPublishing = false;
+    int sharedFrameSlots = 8;
+    int sharedSetSlots = 2;
+
+    // trace every frame from retrieve to its write and export the timeline of
+    // both cameras to traceFile (Chrome trace-event JSON)
+    string traceFile;
+    int traceRecordsPerThread = 65536;
+    CFrameTrace m_frameTrace;
+    // wait until each saved file is on the disk, so a traced write stage ends
+    // when the frame is durable; this slows down saving, traced or not
+    bool durableWrites = false;
+
+    // serve the preview of both cameras to remote viewers on streamPort, 0 is
+    // off (datasetTool watch uses c_defaultStreamPort): streamRate frames per second and camera,
+    // downsampled by streamDownsample and JPEG encoded at streamQuality;
+    // a viewer that falls streamClientFrames behind loses its oldest frames
+    unsigned short streamPort = 0;
+    float streamRate = 10.0f;
+    int streamDownsample = 4;
+    int streamQuality = 80;
+    int streamClientFrames = 4;
+    CFrameStreamServer m_streamServer;
+
+    // auto region of interest: locate the object from fringe modulation in a
+    // short pre-scan and read out only the padded bounding box for the set
+    bool autoROI = false;
+    int prescanFrameNo = 8;
+    int roiPadding = 32;
+    int roiModulationThreshold = 20;
 
 public:
     bool createSubDirectory(string folderDir);
     void grabImage(unsigned int cameraSerialNo, string folderDir, int totalPosNo);
     void grabImageSet(unsigned int cameraSerialNo, string folderDir, int totalPosNo);
     void rectSequence(vector<Mat>rawFringeMat, vector<Mat>& outputFringeMat);
-    void savePosFringe(string rootPath, vector<Mat>setFringeMat);
+    bool findObjectROI(vector<Mat>prescanFringeMat, int padding, Rect& roi);
+    bool saveROI(string rootPath, int offsetX, int offsetY, int width, int height, int frameOffsetX, int frameOffsetY);
+    bool saveExposures(string rootPath, const vector<float>& exposureTimes, Mat exposureMap);
+    bool captureFrame(pointGreyCapture& grab, unsigned char* frameData);
+    bool captureSet(pointGreyCapture& grab, unsigned char* setData[], int numberOfFrames, int numberOfCycles = 1, int firstFrameCounter = 0);
+    void savePosFringe(string rootPath, vector<Mat>setFringeMat, unsigned int cameraSerialNo = 0, unsigned long firstFrameCounter = 0,
+        const vector<int>& captureIndex = vector<int>());
+    bool writeEncodedFile(string fileName, const vector<uchar>& encodedData, bool isDurable);
+    void reportUnwrittenFile(string fileName);
+    bool recordStream(pointGreyCapture& grab, string fileName, int numberOfFrames);
+    bool publishFrames(CSharedFramePublisher& publisher, pointGreyCapture& grab, const vector<Mat>& frameMat, int setIndex = -1);
+    bool streamPreview(pointGreyCapture& grab, unsigned int cameraSerialNo, const Mat& image, float exposureTime_ms, int posNo);
+    bool startStream();
+    bool startTrigger(CTriggerController& trigger);
+    bool consumeTriggerFile();
+    TimingConfig timingConfig();
+    bool planFrameRate(unsigned int cameraSerialNo1, unsigned int cameraSerialNo2);
+    bool queryFrameRateLimit(unsigned int cameraSerialNo, TimingConfig& config);
     void runMultiThread(unsigned int cameraSerialNo1, unsigned int cameraSerialNo2, string folderDir, int totalPosNo);
     void runSetMultiThread(unsigned int cameraSerialNo1, unsigned int cameraSerialNo2, string folderDir, int totalPosNo);
 };
@@ -102,89 +282,605 @@ bool CGrabImages::createSubDirectory(string folderDir)
 
 void CGrabImages::rectSequence(vector<Mat>rawFringeMat, vector<Mat>& outputFringeMat)
 {
-    double minDiffValue = 100000000;
-    int maxID = 0;
-    vector<Scalar>meanValues;
-    meanValues.clear();
+    CFringeProcessor fringeProcessor;
+    fringeProcessor.rectSequence(rawFringeMat, outputFringeMat);
+}
+
 
-    // maximum two bright fringes
-    for (int k = 0; k < rawFringeMat.size(); k++)
+// find the bounding box of the pixels that respond to the projected fringes
+// modulation is the max - min over the pre-scan frames; the box is padded
+// and clipped to the frame
+bool CGrabImages::findObjectROI(vector<Mat>prescanFringeMat, int padding, Rect& roi)
+{
+    if (prescanFringeMat.empty())
     {
-        Scalar mValue = mean(rawFringeMat[k]);
-        meanValues.push_back(mValue);
+        return false;
     }
-    double maxValue = -100000000;
-    for (int k = 0; k < rawFringeMat.size(); k++)
+
+    Mat maxMat = prescanFringeMat[0].clone();
+    Mat minMat = prescanFringeMat[0].clone();
+    for (int k = 1; k < prescanFringeMat.size(); k++)
+    {
+        (cv::max)(maxMat, prescanFringeMat[k], maxMat);
+        (cv::min)(minMat, prescanFringeMat[k], minMat);
+    }
+
+    double modulationThreshold = roiModulationThreshold * (maxMat.depth() == CV_16U ? 256.0 : 1.0);
+    Mat modulationMask = (maxMat - minMat) > modulationThreshold;
+    morphologyEx(modulationMask, modulationMask, MORPH_OPEN, getStructuringElement(MORPH_RECT, Size(5, 5)));
+
+    vector<Point> objectPoints;
+    findNonZero(modulationMask, objectPoints);
+    if (objectPoints.empty())
     {
-        double sumValue = meanValues[k](0) + meanValues[(k + 1) % rawFringeMat.size()](0);
-        if (maxValue < sumValue)
+        cout << "no fringe modulation found, keep full frame" << endl;
+        return false;
+    }
+
+    Rect frameRect(0, 0, maxMat.cols, maxMat.rows);
+    roi = boundingRect(objectPoints);
+    roi = Rect(roi.x - padding, roi.y - padding, roi.width + 2 * padding, roi.height + 2 * padding) & frameRect;
+    return roi.area() > 0;
+}
+
+// record where a ROI set sits on the sensor so it can be placed back later;
+// frameOffsetX/Y is the full frame the calibration was made for, so readers
+// place the set relative to it the same way the capture rectifies it
+bool CGrabImages::saveROI(string rootPath, int offsetX, int offsetY, int width, int height, int frameOffsetX, int frameOffsetY)
+{
+    ofstream roiFile(rootPath + "/roi.txt");
+    if (!roiFile.is_open())
+    {
+        return false;
+    }
+    roiFile << offsetX << " " << offsetY << " " << width << " " << height << " " << frameOffsetX << " " << frameOffsetY << endl;
+    return true;
+}
+
+// store the per-pixel exposure index of a HDR set and the exposure times it refers to
+bool CGrabImages::saveExposures(string rootPath, const vector<float>& exposureTimes, Mat exposureMap)
+{
+    ofstream exposureFile(rootPath + "/exposures.txt");
+    if (!exposureFile.is_open())
+    {
+        return false;
+    }
+    for (int e = 0; e < exposureTimes.size(); e++)
+    {
+        exposureFile << e << " " << exposureTimes[e] << endl;
+    }
+    return imwrite(rootPath + "/expMap.png", exposureMap);
+}
+
+// capture a preview frame into an 8-bit or 16-bit buffer depending on the pixel format
+bool CGrabImages::captureFrame(pointGreyCapture& grab, unsigned char* frameData)
+{
+    if (grab.isHighBitDepth())
+    {
+        return grab.captureSingleImageData((unsigned short*)frameData, true);
+    }
+    return grab.captureSingleImageData(frameData, true);
+}
+
+// capture a set into 8-bit or 16-bit buffers depending on the pixel format
+// more than one cycle averages the cycles per phase slot
+bool CGrabImages::captureSet(pointGreyCapture& grab, unsigned char* setData[], int numberOfFrames, int numberOfCycles, int firstFrameCounter)
+{
+    if (grab.isHighBitDepth())
+    {
+        return grab.captureImageSetAverage((unsigned short**)setData, numberOfFrames, numberOfCycles, firstFrameCounter, true);
+    }
+    return grab.captureImageSetAverage(setData, numberOfFrames, numberOfCycles, firstFrameCounter, true);
+}
+
+// capture frames straight into the recorder's slots; the disk writes run in
+// the background, so the loop only waits when all slots are still in flight
+bool CGrabImages::recordStream(pointGreyCapture& grab, string fileName, int numberOfFrames)
+{
+    int bytesPerPixel = grab.isHighBitDepth() ? 2 : 1;
+    CRawStreamRecorder recorder;
+    if (!recorder.Open(fileName, grab.getImageWidth(), grab.getImageHeight(), bytesPerPixel, numberOfFrames,
+        recordSlots, recordBackpressure))
+    {
+        return false;
+    }
+
+    unsigned long previousFrameCounter = grab.getLastFrameCounter();
+    int missedFrames = 0;
+    bool isRecorded = true;
+    int k = 0;
+    for (; k < numberOfFrames && isRecorded; k++)
+    {
+        // the recorder hands out a scratch buffer for frames it cannot write
+        // and counts them as dropped, so only the camera ends the stream
+        unsigned char* frameData = recorder.AcquireSlot();
+        isRecorded = frameData != NULL && captureFrame(grab, frameData);
+        if (isRecorded)
         {
-            maxValue = sumValue;
-            maxID = k;
+            unsigned long frameCounter = grab.getLastFrameCounter();
+            missedFrames += (int)(frameCounter - previousFrameCounter) - 1;
+            previousFrameCounter = frameCounter;
+            isRecorded = recorder.Submit(frameCounter, grab.getLastFrameTime());
         }
     }
+    if (!isRecorded)
+    {
+        cout << "recording " << fileName << " stopped after " << k - 1 << " of " << numberOfFrames << " frames" << endl;
+    }
+    if (missedFrames > 0)
+    {
+        cout << "camera skipped " << missedFrames << " frames while recording " << fileName << endl;
+    }
+    return recorder.Close() && isRecorded;
+}
 
-    for (int k = 0; k < rawFringeMat.size() - 2; k++)
+// hand frames to the shared ring; only copies, never waits for readers
+bool CGrabImages::publishFrames(CSharedFramePublisher& publisher, pointGreyCapture& grab, const vector<Mat>& frameMat, int setIndex)
+{
+    if (!publisher.IsOpen() || frameMat.empty())
     {
-        outputFringeMat.push_back(rawFringeMat[(k + maxID + 2) % rawFringeMat.size()].clone());
+        return false;
     }
+    vector<const unsigned char*> frames;
+    for (int k = 0; k < frameMat.size(); k++)
+    {
+        frames.push_back(frameMat[k].data);
+    }
+    SharedFrameInfo info;
+    info.sequence = 0;
+    info.frameCounter = grab.getLastFrameCounter();
+    info.timeStamp = grab.getLastFrameTime();
+    info.width = frameMat[0].cols;
+    info.height = frameMat[0].rows;
+    info.bytesPerPixel = (int)frameMat[0].elemSize();
+    info.frameCount = (int)frameMat.size();
+    info.setIndex = setIndex;
+    return publisher.Publish(frames.data(), info);
 }
 
+// write a file and, if asked, wait until it is on the disk
+bool CGrabImages::writeEncodedFile(string fileName, const vector<uchar>& encodedData, bool isDurable)
+{
+    FILE* file = fopen(fileName.c_str(), "wb");
+    if (!file)
+    {
+        cout << "cannot write " << fileName << endl;
+        return false;
+    }
+    bool isWritten = fwrite(encodedData.data(), 1, encodedData.size(), file) == encodedData.size();
+    isWritten = fflush(file) == 0 && isWritten;
+    if (isDurable)
+    {
+        isWritten = _commit(_fileno(file)) == 0 && isWritten;
+    }
+    fclose(file);
+    return isWritten;
+}
+
+// a file that failed to write is removed and left out of the manifest, so
+// the manifest only vouches for files that are complete on the disk
+void CGrabImages::reportUnwrittenFile(string fileName)
+{
+    cout << fileName << " is not written and is left out of the manifest" << endl;
+    remove(fileName.c_str());
+}
 
-void CGrabImages::savePosFringe(string rootPath, vector<Mat>setFringeMat)
+// the review images are reduced from each frame right after it was written
+// (after the set file with the fringe codec)
+// frames are encoded and written as separate steps so the trace can tell
+// them apart, and the checksums come from the frame and the encoded bytes
+// before they leave the cache; cameraSerialNo and firstFrameCounter key the
+// trace records, captureIndex gives the position of each aligned frame in
+// capture order so a frame record carries its own frame counter
+void CGrabImages::savePosFringe(string rootPath, vector<Mat>setFringeMat, unsigned int cameraSerialNo, unsigned long firstFrameCounter,
+    const vector<int>& captureIndex)
 {
     createSubDirectory(rootPath);
-    for (int k = 0; k < setFringeMat.size(); k++)
+    CReviewPyramid review;
+    review.Begin((int)setFringeMat.size());
+    bool isTraced = m_frameTrace.IsEnabled() && cameraSerialNo != 0;
+    CSetManifest manifest;
+    vector<uchar> encodedData;
+    if (fringeCodec)
+    {
+        // the whole set is one file, so the trace has one record per stage
+        long long encodeStart = m_frameTrace.Now();
+        unsigned int pixelCrc = 0;
+        for (int k = 0; writeManifest && k < setFringeMat.size(); k++)
+        {
+            pixelCrc = CSetManifest::PixelChecksum(setFringeMat[k], pixelCrc);
+        }
+        CFringeCodec codec(0, fringeBandRows, fringeKeyframeInterval);
+        if (codec.EncodeSet(setFringeMat, encodedData))
+        {
+            unsigned int fileCrc = writeManifest ? FringeKernels::crc32c(encodedData.data(), encodedData.size()) : 0;
+            long long writeStart = m_frameTrace.Now();
+            if (!writeEncodedFile(rootPath + "/set.fsc", encodedData, durableWrites))
+            {
+                reportUnwrittenFile(rootPath + "/set.fsc");
+            }
+            else if (writeManifest)
+            {
+                manifest.AddFile("set.fsc", encodedData.size(), fileCrc, pixelCrc);
+            }
+            if (isTraced)
+            {
+                m_frameTrace.Record(cameraSerialNo, TRACE_ENCODE, firstFrameCounter, 0, encodeStart, writeStart, (int)setFringeMat.size());
+                m_frameTrace.Record(cameraSerialNo, TRACE_WRITE, firstFrameCounter, 0, writeStart, m_frameTrace.Now(), (int)setFringeMat.size());
+            }
+        }
+        for (int k = 0; saveReview && k < setFringeMat.size(); k++)
+        {
+            review.AddFrame(k, setFringeMat[k]);
+        }
+    }
+    else
+    {
+        for (int k = 0; k < setFringeMat.size(); k++)
+        {
+            string frameName = "f" + to_string(k) + ".png";
+            string fileName = rootPath + "/" + frameName;
+            long long encodeStart = m_frameTrace.Now();
+            unsigned int pixelCrc = writeManifest ? CSetManifest::PixelChecksum(setFringeMat[k]) : 0;
+            imencode(".png", setFringeMat[k], encodedData);
+            unsigned int fileCrc = writeManifest ? FringeKernels::crc32c(encodedData.data(), encodedData.size()) : 0;
+            long long writeStart = m_frameTrace.Now();
+            if (!writeEncodedFile(fileName, encodedData, durableWrites))
+            {
+                reportUnwrittenFile(fileName);
+            }
+            else if (writeManifest)
+            {
+                manifest.AddFile(frameName, encodedData.size(), fileCrc, pixelCrc);
+            }
+            if (isTraced)
+            {
+                unsigned long frameCounter = firstFrameCounter + (k < captureIndex.size() ? captureIndex[k] : k);
+                m_frameTrace.Record(cameraSerialNo, TRACE_ENCODE, frameCounter, 0, encodeStart, writeStart);
+                m_frameTrace.Record(cameraSerialNo, TRACE_WRITE, frameCounter, 0, writeStart, m_frameTrace.Now());
+            }
+            if (saveReview)
+            {
+                review.AddFrame(k, setFringeMat[k]);
+            }
+        }
+    }
+    if (writeManifest)
+    {
+        manifest.Write(rootPath);
+    }
+    if (saveReview)
+    {
+        review.Save(rootPath + "/review");
+    }
+}
+
+// offer a preview frame to the remote viewers; returns at once when nobody
+// watches or the stream is not due for a frame
+bool CGrabImages::streamPreview(pointGreyCapture& grab, unsigned int cameraSerialNo, const Mat& image, float exposureTime_ms, int posNo)
+{
+    if (!m_streamServer.IsRunning())
+    {
+        return false;
+    }
+    StreamFrameInfo info;
+    info.cameraSerial = cameraSerialNo;
+    info.frameCounter = grab.getLastFrameCounter();
+    info.frameTime = grab.getLastFrameTime();
+    info.exposureTime_ms = exposureTime_ms;
+    info.positionNo = posNo;
+    return m_streamServer.PostFrame(image, info);
+}
+
+// start the preview server before the camera threads
+bool CGrabImages::startStream()
+{
+    if (streamPort == 0)
+    {
+        return false;
+    }
+    return m_streamServer.Start(streamPort, streamRate, streamDownsample, streamQuality, streamClientFrames);
+}
+
+// only one camera thread can delete the file, so a request fires once
+bool CGrabImages::consumeTriggerFile()
+{
+    return !triggerFile.empty() && remove(triggerFile.c_str()) == 0;
+}
+
+// timing model inputs from the capture settings
+TimingConfig CGrabImages::timingConfig()
+{
+    TimingConfig config;
+    config.exposureTime_ms = expTime;
+    for (float hdrExposureTime : hdrExposureTimes)
+    {
+        config.exposureTime_ms = (std::max)(config.exposureTime_ms, hdrExposureTime);
+    }
+    config.imageWidth = m_cameraWidth;
+    config.imageHeight = m_cameraHeight;
+    config.bitsPerPixel = (pixelFormat == PIXEL_FORMAT_RAW8 || pixelFormat == PIXEL_FORMAT_MONO8) ? 8 :
+        ((pixelFormat == PIXEL_FORMAT_RAW12 || pixelFormat == PIXEL_FORMAT_MONO12) ? 12 : 16);
+    config.numberOfCameras = 2;
+    config.linkBandwidth_MBps = linkBandwidth_MBps;
+    config.hostFrameTime_ms = hostFrameTime_ms;
+    config.triggerDelay_us = triggerDelay_us;
+    config.triggerPulseWidth_us = triggerPulseWidth_us;
+    return config;
+}
+
+// readout limit of one camera at the capture format and ROI; the camera is
+// brought up the way grabImageSet does it and closed again
+bool CGrabImages::queryFrameRateLimit(unsigned int cameraSerialNo, TimingConfig& config)
+{
+    pointGreyCapture grab;
+    if (!grab.openCamera(cameraSerialNo))
+    {
+        cout << "camera " << cameraSerialNo << " cannot be opened" << endl;
+        return false;
+    }
+    bool isHardwareTrigger = true;
+    grab.setPixelFormat(pixelFormat);
+    CTimingPlanner planner;
+    bool isQueried = grab.initCamera(m_cameraWidth, m_cameraHeight, m_offsetX, m_offsetY, frameRate, expTime, isHardwareTrigger)
+        && planner.QueryCamera(grab, config);
+    grab.closeCamera();
+    return isQueried;
+}
+
+// plan the rig frame rate before the trigger starts, for the slower of the
+// two cameras' readout limits; false when no rate avoids dropped frames
+bool CGrabImages::planFrameRate(unsigned int cameraSerialNo1, unsigned int cameraSerialNo2)
+{
+    TimingConfig config = timingConfig();
+    unsigned int cameraSerialNos[2] = { cameraSerialNo1, cameraSerialNo2 };
+    for (unsigned int cameraSerialNo : cameraSerialNos)
     {
-        string fileName = rootPath + "/f" + to_string(k) + ".png";
-        imwrite(fileName, setFringeMat[k]);
+        TimingConfig cameraConfig = timingConfig();
+        if (!queryFrameRateLimit(cameraSerialNo, cameraConfig))
+        {
+            return false;
+        }
+        if (cameraConfig.sensorMaxFrameRate > 0 &&
+            (config.sensorMaxFrameRate <= 0 || cameraConfig.sensorMaxFrameRate < config.sensorMaxFrameRate))
+        {
+            config.sensorMaxFrameRate = cameraConfig.sensorMaxFrameRate;
+        }
     }
+    CTimingPlanner planner;
+    bool isPlanned = planner.Plan(config, m_timingPlan);
+    planner.Report(m_timingPlan);
+    frameRate = m_timingPlan.frameRate;
+    return isPlanned;
+}
+
+// program the trigger board for the configured frame rate and exposure
+bool CGrabImages::startTrigger(CTriggerController& trigger)
+{
+    if (triggerPort.empty())
+    {
+        return false;
+    }
+    // overlapped readout needs the exposure to end before the next trigger
+    float period_us = 1000000.0f / frameRate;
+    if (triggerDelay_us + expTime * 1000.0f >= period_us)
+    {
+        cout << "exposure " << expTime << " ms does not fit " << frameRate << " Hz" << endl;
+    }
+    if (!trigger.Open(triggerPort))
+    {
+        return false;
+    }
+    return trigger.Configure(frameRate, triggerPulseWidth_us, triggerDelay_us);
 }
 
 void CGrabImages::runMultiThread(unsigned int cameraSerialNo1, unsigned int cameraSerialNo2, string folderDir, int totalPosNo)
 {
+    CTriggerController trigger;
+    startTrigger(trigger);
+    m_captureControl.Reset(2);
+    if (!traceFile.empty())
+    {
+        m_frameTrace.Start(traceRecordsPerThread);
+    }
+    startStream();
     std::thread t1(&CGrabImages::grabImage, this, cameraSerialNo1, folderDir, totalPosNo);
     std::thread t2(&CGrabImages::grabImage, this, cameraSerialNo2, folderDir, totalPosNo);
     t1.join();
     t2.join();
+    m_streamServer.Stop();
+    if (m_frameTrace.IsEnabled())
+    {
+        m_frameTrace.Stop();
+        m_frameTrace.WriteChromeTrace(traceFile);
+    }
 }
 
 void CGrabImages::runSetMultiThread(unsigned int cameraSerialNo1, unsigned int cameraSerialNo2, string folderDir, int totalPosNo)
 {
+    // the trigger is programmed once, so it has to suit both cameras before it starts
+    if (planTiming && !planFrameRate(cameraSerialNo1, cameraSerialNo2))
+    {
+        cout << "no frame rate fits both cameras, the capture does not start" << endl;
+        return;
+    }
+    CTriggerController trigger;
+    startTrigger(trigger);
+    m_captureControl.Reset(2);
+    if (!traceFile.empty())
+    {
+        m_frameTrace.Start(traceRecordsPerThread);
+    }
+    startStream();
     std::thread t1(&CGrabImages::grabImageSet, this, cameraSerialNo1, folderDir, totalPosNo);
     std::thread t2(&CGrabImages::grabImageSet, this, cameraSerialNo2, folderDir, totalPosNo);
     t1.join();
     t2.join();
+    m_streamServer.Stop();
+    if (m_frameTrace.IsEnabled())
+    {
+        m_frameTrace.Stop();
+        m_frameTrace.WriteChromeTrace(traceFile);
+    }
 }
 
 void CGrabImages::grabImageSet(unsigned int cameraSerialNo, string folderDir, int totalPosNo)
 {
     pointGreyCapture m_grab;
 
+    // a codebook of another length would rotate every set by a meaningless offset
+    CSequenceAligner aligner;
+    if (codebookFile.empty())
+    {
+        aligner.SetDefaultCodebook(c_setPatternCount);
+    }
+    else if (!aligner.LoadCodebook(codebookFile) || aligner.GetCodebookSize() != c_setPatternCount)
+    {
+        cout << "codebook " << codebookFile << " does not describe a set of " << c_setPatternCount << " patterns" << endl;
+        m_captureControl.RequestQuit();
+        return;
+    }
+
     // turn on the camera based on camera serial number
-    m_grab.openCamera(cameraSerialNo);
+    if (!m_grab.openCamera(cameraSerialNo))
+    {
+        // the other camera must not wait for this one at the barrier
+        cout << "camera " << cameraSerialNo << " cannot be opened" << endl;
+        m_captureControl.RequestQuit();
+        return;
+    }
+    m_grab.setGrabTimeout(grabTimeout_ms);
+    m_grab.injectRetrieveFaults(faultError, faultPeriod, faultCount);
 
     // initialize camera
     bool isHardwareTrigger = true;
+    m_grab.setPixelFormat(pixelFormat);
     m_grab.initCamera(m_cameraWidth, m_cameraHeight, m_offsetX, m_offsetY, frameRate, expTime, isHardwareTrigger);
     m_grab.setExposureTime(expTime);
+    vector<string> configMismatches;
+    if (verifyCameraConfig && !m_grab.verifyConfiguration(configMismatches))
+    {
+        for (const string& mismatch : configMismatches)
+        {
+            cout << "camera " << cameraSerialNo << " " << mismatch << endl;
+        }
+    }
     m_grab.startAcquisition();
 
-    const int setImageNo = 64;
-    unsigned char* textureImage = new unsigned char[m_cameraSize];
+    // check the trigger rate against this camera's readout limit and apply it;
+    // a camera that cannot follow the trigger would drop frames in every set
+    CTimingPlanner planner;
+    TimingConfig cameraTiming = timingConfig();
+    if (planTiming && planner.QueryCamera(m_grab, cameraTiming))
+    {
+        TimingPlan cameraPlan;
+        if (!planner.Plan(cameraTiming, cameraPlan, frameRate))
+        {
+            cout << "camera " << cameraSerialNo << " cannot follow the trigger: ";
+            planner.Report(cameraPlan);
+            m_captureControl.RequestQuit();
+            return;
+        }
+        planner.Apply(m_timingPlan, cameraTiming, m_grab);
+    }
+
+    // each camera converges on its own exposure, bounded by the frame period
+    float cameraExpTime = expTime;
+    CAutoExposure exposureControl(0.02f, 0.9f * 1000.0f / frameRate);
+    exposureControl.SetCycleFrames(stillCycleFrames);
+
+    // the rectification maps are built once per camera
+    CRectifyRemap rectifier;
+    if (!calibrationDir.empty())
+    {
+        rectifier.LoadCalibration(calibrationDir + "/calib" + to_string(cameraSerialNo) + ".yml");
+    }
+
+    const int setImageNo = c_setPatternCount;
+    bool isHighBitDepth = m_grab.isHighBitDepth();
+    int bytesPerPixel = isHighBitDepth ? 2 : 1;
+    int pixelType = isHighBitDepth ? CV_16UC1 : CV_8UC1;
+    unsigned char* textureImage = new unsigned char[m_cameraSize * bytesPerPixel];
     vector<Mat> rawSetFringeMat, setFringeMat;
+
+    // HDR sets are fused to 16 bits even though the camera streams 8-bit frames
+    vector<float> exposureTimes = hdrExposureTimes;
+    sort(exposureTimes.begin(), exposureTimes.end(), greater<float>());
+    bool isHDR = !exposureTimes.empty();
+    if (isHDR && isHighBitDepth)
+    {
+        cout << "HDR capture needs an 8-bit pixel format, using expTime only" << endl;
+        isHDR = false;
+    }
+    int setBytesPerPixel = (isHighBitDepth || isHDR) ? 2 : 1;
+    int setPixelType = (isHighBitDepth || isHDR) ? CV_16UC1 : CV_8UC1;
+    unsigned char* exposureMapData = isHDR ? new unsigned char[m_cameraSize] : NULL;
     unsigned char* setFringeData[setImageNo];
     for (int k = 0; k < setImageNo; k++)
     {
-        setFringeData[k] = new unsigned char[m_cameraSize];
+        setFringeData[k] = new unsigned char[m_cameraSize * setBytesPerPixel];
+    }
+
+    CFrameQualityGate setQuality;
+    setQuality.SetLimits(qualityBlackLevel, qualityMinMeanRatio, qualityMaxSaturated, (unsigned char)qualitySaturationLevel);
+    setQuality.SetFringePatterns(aligner.GetFringePatterns());
+    bool hasQualityExpectations = !qualityFile.empty() && setQuality.LoadExpectations(qualityFile);
+    bool isQualityGated = qualityGate;
+    // set frames are reduced to thumbnails while they arrive, so the set is
+    // aligned without another pass over the frames
+    m_grab.setFrameCallback([&aligner, &setQuality, isQualityGated](int frameIndex, const unsigned char* frameData, int width, int height, int bytesPerPixel)
+    {
+        aligner.AddFrame(frameIndex, frameData, width, height, bytesPerPixel);
+        if (isQualityGated)
+        {
+            setQuality.AddFrame(frameIndex, frameData, width, height, bytesPerPixel);
+        }
+    });
+    if (m_frameTrace.IsEnabled())
+    {
+        m_grab.setFrameTrace(&m_frameTrace);
+    }
+
+    CStillnessDetector stillness(stillTime_ms, stillThreshold, stillCycleFrames);
+
+    CSharedFramePublisher framePublisher, setPublisher;
+    if (sharedPublishing)
+    {
+        framePublisher.Create("fringeFrames" + to_string(cameraSerialNo), (size_t)m_cameraSize * bytesPerPixel, sharedFrameSlots);
+        setPublisher.Create("fringeSets" + to_string(cameraSerialNo), (size_t)m_cameraSize * setBytesPerPixel * setImageNo, sharedSetSlots);
     }
 
     Mat image;
     for (int posNo = 0; posNo < totalPosNo; posNo++) {
-        while (!stopCapture)
+        while (m_captureControl.IsPreviewing())
         {
-            m_grab.captureSingleImageData(textureImage, true);
-            image = Mat(Size(m_cameraWidth, m_cameraHeight), CV_8UC1, textureImage);
+            // a failed retrieve feeds nothing downstream, the window keeps the last frame
+            if (captureFrame(m_grab, textureImage))
+            {
+                image = Mat(Size(m_cameraWidth, m_cameraHeight), pixelType, textureImage);
+                publishFrames(framePublisher, m_grab, vector<Mat>(1, image));
+                streamPreview(m_grab, cameraSerialNo, image, cameraExpTime, posNo);
+                if (autoExposure)
+                {
+                    bool isExposureChanged = isHighBitDepth
+                        ? exposureControl.Update((unsigned short*)textureImage, m_cameraWidth, m_cameraHeight, cameraExpTime)
+                        : exposureControl.Update(textureImage, m_cameraWidth, m_cameraHeight, cameraExpTime);
+                    if (isExposureChanged)
+                    {
+                        m_grab.setExposureTime(cameraExpTime);
+                    }
+                }
+                if (autoTrigger && stillness.Update(textureImage, m_cameraWidth, m_cameraHeight, bytesPerPixel,
+                    m_grab.getLastFrameCounter(), m_grab.getLastFrameTime()))
+                {
+                    cout << "camera " << cameraSerialNo << " is still, capture position " << posNo << endl;
+                    m_captureControl.RequestCapture();
+                }
+            }
+            if (consumeTriggerFile())
+            {
+                m_captureControl.RequestCapture();
+            }
 
             //vector<Point2f> cameraPoints;
             //const Size featureDimensions(12, 19);
@@ -198,43 +894,236 @@ void CGrabImages::grabImageSet(unsigned int cameraSerialNo, string folderDir, in
             //Mat imageRGB;
             //imageRGB = image;
             //demosaicing(image, imageRGB, COLOR_BayerBG2BGR);
-            namedWindow(to_string(cameraSerialNo), WINDOW_NORMAL);
-            resizeWindow(to_string(cameraSerialNo), m_cameraWidth / 2, m_cameraHeight / 2);
-            imshow(to_string(cameraSerialNo), image);
+            if (!image.empty())
+            {
+                namedWindow(to_string(cameraSerialNo), WINDOW_NORMAL);
+                resizeWindow(to_string(cameraSerialNo), m_cameraWidth / 2, m_cameraHeight / 2);
+                imshow(to_string(cameraSerialNo), image);
+            }
 
             int c = waitKey(1);
             if (c == 27)
             {
-                stopCapture = true;
+                m_captureControl.RequestCapture();
+            }
+            else if (c == 'q')
+            {
+                m_captureControl.RequestQuit();
             }
         }
 
         destroyWindow(to_string(cameraSerialNo));
-        m_grab.stopAcquisition();
+        if (m_captureControl.GetCommand() == CCaptureControl::QUIT)
+        {
+            break;
+        }
+        bool isStreaming = continuousAcquisition && !autoROI;
+        if (!isStreaming)
+        {
+            m_grab.stopAcquisition();
+        }
+
+        // locate the object and shrink the readout to it
+        bool isROISet = false;
+        if (autoROI)
+        {
+            vector<Mat> prescanFringeMat;
+            m_grab.startAcquisition();
+            captureSet(m_grab, setFringeData, prescanFrameNo);
+            m_grab.stopAcquisition();
+            for (int k = 0; k < prescanFrameNo; k++)
+            {
+                prescanFringeMat.push_back(Mat(Size(m_cameraWidth, m_cameraHeight), pixelType, setFringeData[k]));
+            }
 
-        //mtx.lock();
+            Rect roi;
+            if (findObjectROI(prescanFringeMat, roiPadding, roi))
+            {
+                unsigned int roiWidth = roi.width;
+                unsigned int roiHeight = roi.height;
+                unsigned int roiOffsetX = m_offsetX + roi.x;
+                unsigned int roiOffsetY = m_offsetY + roi.y;
+                isROISet = m_grab.setImageROI(roiWidth, roiHeight, roiOffsetX, roiOffsetY);
+            }
+        }
+        int setWidth = m_grab.getImageWidth();
+        int setHeight = m_grab.getImageHeight();
 
         // capture fringe set
         cout << "Capture & save camera " << cameraSerialNo << " set " << posNo << endl;
-        m_grab.setExposureTime(expTime);
-        m_grab.startAcquisition();
-        m_grab.captureImageSetData(setFringeData, setImageNo, 0, true);
-        rawSetFringeMat.clear();
-        setFringeMat.clear();
-        for (int k = 0; k < setImageNo; k++)
+        // a streaming camera already runs at the preview exposure
+        if (!isStreaming)
+        {
+            m_grab.setExposureTime(cameraExpTime);
+            m_grab.startAcquisition();
+        }
+        else
+        {
+            cout << "set follows preview frame " << m_grab.getLastFrameCounter() << endl;
+        }
+
+        // all cameras are ready; every camera starts from the first cycle
+        // boundary after the release so both sets cover the same triggers
+        double releaseTime = 0;
+        if (!m_captureControl.Arm(releaseTime))
+        {
+            break;
+        }
+        unsigned long firstFrameCounter = 0;
+        m_grab.skipFramesBefore(releaseTime, firstFrameCounter);
+        string posPath = folderDir + to_string(cameraSerialNo) + "/posEval" + to_string(posNo + 2);
+        if (recordFrameNo > 0)
+        {
+            createSubDirectory(posPath);
+            recordStream(m_grab, posPath + "/stream.raw", recordFrameNo);
+        }
+        else
+        {
+            // a dropped frame or a set that fails the quality gate on any
+            // camera is captured again by all cameras from a common cycle
+            bool isSetCaptured = false;
+            bool isQualityRejected = false;
+            bool isSetAccepted = false;
+            bool isQuit = false;
+            for (int attempt = 0; attempt < setCaptureAttempts && !isSetAccepted; attempt++)
+            {
+                if (attempt > 0)
+                {
+                    if (!m_captureControl.Arm(releaseTime))
+                    {
+                        isQuit = true;
+                        break;
+                    }
+                    m_grab.skipFramesBefore(releaseTime, firstFrameCounter);
+                }
+                aligner.Reset();
+                setQuality.Reset(setImageNo);
+                isQualityRejected = false;
+                if (isHDR)
+                {
+                    isSetCaptured = m_grab.captureImageSetHDR((unsigned short**)setFringeData, exposureMapData, setImageNo,
+                        exposureTimes.data(), (int)exposureTimes.size(), firstFrameCounter, true);
+                    m_grab.setExposureTime(cameraExpTime);
+                }
+                else
+                {
+                    isSetCaptured = captureSet(m_grab, setFringeData, setImageNo, averageCycles, firstFrameCounter);
+                }
+                if (isSetCaptured && isQualityGated)
+                {
+                    // per pattern limits and the marker patterns need to know which pattern each frame shows
+                    int patternOffset = 0;
+                    float patternConfidence = 0;
+                    vector<string> problems;
+                    bool isAligned = aligner.Align(patternOffset, patternConfidence);
+                    if (!isAligned && hasQualityExpectations)
+                    {
+                        // without the offset the frames would be checked against the wrong patterns
+                        problems.push_back("set cannot be aligned to the codebook for the per pattern checks");
+                        isQualityRejected = true;
+                    }
+                    else
+                    {
+                        // the longest HDR exposure is meant to saturate, and without the
+                        // offset the bright marker frames cannot be told apart
+                        isQualityRejected = !setQuality.Check(patternOffset, isHDR || !isAligned, problems);
+                    }
+                    for (const string& problem : problems)
+                    {
+                        cout << "camera " << cameraSerialNo << " set " << posNo << (qualityReject ? ": " : " warning: ") << problem << endl;
+                    }
+                    isQualityRejected = isQualityRejected && qualityReject;
+                    isSetCaptured = !isQualityRejected;
+                }
+                if (!m_captureControl.Vote(isSetCaptured, isSetAccepted))
+                {
+                    isQuit = true;
+                    break;
+                }
+            }
+            if (isQuit)
+            {
+                break;
+            }
+            if (isQualityRejected)
+            {
+                cout << "camera " << cameraSerialNo << " set " << posNo << " failed the quality gate after "
+                    << setCaptureAttempts << " attempts and is not written" << endl;
+            }
+            else if (!isSetCaptured)
+            {
+                // a dropped frame or a lost stream leaves the set buffers partly stale
+                cout << "camera " << cameraSerialNo << " set " << posNo << " failed after " << setCaptureAttempts
+                    << " attempts and is not written" << endl;
+            }
+            else if (!isSetAccepted)
+            {
+                // the sets are kept in pairs, a set without its partner is of no use
+                cout << "camera " << cameraSerialNo << " set " << posNo << " is not written, another camera failed it after "
+                    << setCaptureAttempts << " attempts" << endl;
+            }
+            else
+            {
+                if (planTiming && !planner.Validate(m_timingPlan, m_grab.getLastSetFrameInterval()))
+                {
+                    cout << "camera " << cameraSerialNo << " does not run at the planned rate" << endl;
+                }
+                unsigned long setFrameCounter = m_grab.getSetFirstFrameCounter();
+                long long processStart = m_frameTrace.Now();
+                rawSetFringeMat.clear();
+                setFringeMat.clear();
+                for (int k = 0; k < setImageNo; k++)
+                {
+                    Mat fringeMat = Mat(Size(setWidth, setHeight), setPixelType, setFringeData[k]);
+                    rawSetFringeMat.push_back(fringeMat.clone());
+                }
+                float alignConfidence = 0;
+                vector<int> captureIndex;
+                aligner.AlignSequence(rawSetFringeMat, setFringeMat, alignConfidence, &captureIndex);
+                publishFrames(setPublisher, m_grab, setFringeMat, posNo);
+                m_frameTrace.Record(cameraSerialNo, TRACE_PROCESS, setFrameCounter, 0, processStart, m_frameTrace.Now(), setImageNo);
+                savePosFringe(posPath, setFringeMat, cameraSerialNo, setFrameCounter, captureIndex);
+                if (rectifier.IsLoaded())
+                {
+                    vector<Mat> rectFringeMat;
+                    Point roiOffset(m_grab.getOffsetX() - m_offsetX, m_grab.getOffsetY() - m_offsetY);
+                    processStart = m_frameTrace.Now();
+                    if (rectifier.RemapSet(setFringeMat, rectFringeMat, roiOffset))
+                    {
+                        m_frameTrace.Record(cameraSerialNo, TRACE_PROCESS, setFrameCounter, 0, processStart, m_frameTrace.Now(), setImageNo);
+                        savePosFringe(posPath + "/rect", rectFringeMat, cameraSerialNo, setFrameCounter, captureIndex);
+                    }
+                }
+                if (isHDR)
+                {
+                    saveExposures(posPath, exposureTimes, Mat(Size(setWidth, setHeight), CV_8UC1, exposureMapData));
+                }
+            }
+        }
+
+        // go back to the full frame for the preview of the next position
+        if (isROISet)
         {
-            Mat fringeMat = Mat(Size(m_cameraWidth, m_cameraHeight), CV_8UC1, setFringeData[k]);
-            rawSetFringeMat.push_back(fringeMat.clone());
+            saveROI(posPath, m_grab.getOffsetX(), m_grab.getOffsetY(), setWidth, setHeight, m_offsetX, m_offsetY);
+            unsigned int fullWidth = m_cameraWidth;
+            unsigned int fullHeight = m_cameraHeight;
+            unsigned int fullOffsetX = m_offsetX;
+            unsigned int fullOffsetY = m_offsetY;
+            m_grab.setImageROI(fullWidth, fullHeight, fullOffsetX, fullOffsetY);
+            m_grab.startAcquisition();
         }
-        rectSequence(rawSetFringeMat, setFringeMat);
-        savePosFringe(folderDir + to_string(cameraSerialNo) + "/posEval" + to_string(posNo+2), setFringeMat);
 
-        stopCapture = false;
-        //mtx.unlock();
+        // wait for the other cameras to save before the next preview
+        if (!m_captureControl.Commit())
+        {
+            break;
+        }
+        stillness.Rearm();
     
     }
     
     // turn off the camera
+    m_grab.printRecoveryReport();
     m_grab.stopAcquisition();
     m_grab.closeCamera();
 
@@ -242,6 +1131,7 @@ void CGrabImages::grabImageSet(unsigned int cameraSerialNo, string folderDir, in
     {
         delete[] setFringeData[k];
     }
+    delete[] exposureMapData;
     delete[] textureImage;
 }
 
@@ -250,22 +1140,56 @@ void CGrabImages::grabImage(unsigned int cameraSerialNo, string folderDir, int t
     pointGreyCapture m_grab;
 
     // turn on the camera based on camera serial number
-    m_grab.openCamera(cameraSerialNo);
+    if (!m_grab.openCamera(cameraSerialNo))
+    {
+        // the other camera must not wait for this one at the barrier
+        cout << "camera " << cameraSerialNo << " cannot be opened" << endl;
+        m_captureControl.RequestQuit();
+        return;
+    }
+    m_grab.setGrabTimeout(grabTimeout_ms);
+    m_grab.injectRetrieveFaults(faultError, faultPeriod, faultCount);
 
     // initialize camera
     bool isHardwareTrigger = true;
     m_grab.initCamera(m_cameraWidth, m_cameraHeight, m_offsetX, m_offsetY, frameRate, expTime, isHardwareTrigger);
-    m_grab.setExposureTime(expTime); 
+    m_grab.setExposureTime(expTime);
+    vector<string> configMismatches;
+    if (verifyCameraConfig && !m_grab.verifyConfiguration(configMismatches))
+    {
+        for (const string& mismatch : configMismatches)
+        {
+            cout << "camera " << cameraSerialNo << " " << mismatch << endl;
+        }
+    }
     m_grab.startAcquisition();
 
     unsigned char* textureImage = new unsigned char[m_cameraSize];
+    CStillnessDetector stillness(stillTime_ms, stillThreshold, stillCycleFrames);
+    if (m_frameTrace.IsEnabled())
+    {
+        m_grab.setFrameTrace(&m_frameTrace);
+    }
 
     Mat image;
     for (int posNo = 0; posNo < totalPosNo; posNo++) {
-        while (!stopCapture)
+        while (m_captureControl.IsPreviewing())
         {
-            m_grab.captureSingleImageData(textureImage, true);
-            image = Mat(Size(m_cameraWidth, m_cameraHeight), CV_8UC1, textureImage);
+            if (m_grab.captureSingleImageData(textureImage, true))
+            {
+                image = Mat(Size(m_cameraWidth, m_cameraHeight), CV_8UC1, textureImage);
+                streamPreview(m_grab, cameraSerialNo, image, expTime, posNo);
+                if (autoTrigger && stillness.Update(textureImage, m_cameraWidth, m_cameraHeight, 1,
+                    m_grab.getLastFrameCounter(), m_grab.getLastFrameTime()))
+                {
+                    cout << "camera " << cameraSerialNo << " is still, capture position " << posNo << endl;
+                    m_captureControl.RequestCapture();
+                }
+            }
+            if (consumeTriggerFile())
+            {
+                m_captureControl.RequestCapture();
+            }
 
             //vector<Point2f> cameraPoints;
             //const Size featureDimensions(12, 19);
@@ -279,27 +1203,46 @@ void CGrabImages::grabImage(unsigned int cameraSerialNo, string folderDir, int t
             //Mat imageRGB;
             //imageRGB = image;
             //demosaicing(image, imageRGB, COLOR_BayerBG2BGR);
-            namedWindow(to_string(cameraSerialNo), WINDOW_NORMAL);
-            resizeWindow(to_string(cameraSerialNo), m_cameraWidth / 2, m_cameraHeight / 2);
-            imshow(to_string(cameraSerialNo), image);
+            if (!image.empty())
+            {
+                namedWindow(to_string(cameraSerialNo), WINDOW_NORMAL);
+                resizeWindow(to_string(cameraSerialNo), m_cameraWidth / 2, m_cameraHeight / 2);
+                imshow(to_string(cameraSerialNo), image);
+            }
 
             int c = waitKey(1);
             if (c == 27)
             {
-                stopCapture = true;
+                m_captureControl.RequestCapture();
+            }
+            else if (c == 'q')
+            {
+                m_captureControl.RequestQuit();
             }
         }
 
         destroyWindow(to_string(cameraSerialNo));
+        if (m_captureControl.GetCommand() == CCaptureControl::QUIT)
+        {
+            break;
+        }
 
         // capture single image
         string fileName = folderDir + to_string(cameraSerialNo) + "/" + to_string(posNo) + ".png";
-        imwrite(fileName, image);
-        stopCapture = false;
+        if (!image.empty())
+        {
+            imwrite(fileName, image);
+        }
+        if (!m_captureControl.Commit())
+        {
+            break;
+        }
+        stillness.Rearm();
     }
 
 
     // turn off the camera
+    m_grab.printRecoveryReport();
     m_grab.stopAcquisition();
     m_grab.closeCamera();
 
@@ -16,14 +16,49 @@
 
 //#include "StdAfx.h"
 #include "pointGreyCapture.h"
+#include "FringeKernels.h"
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
 using namespace std;
 
+// a retrieve waits this many frame periods, plus the margin for the host,
+// before the stream counts as stalled
+static const float c_grabTimeoutPeriods = 4.0f;
+static const int c_grabTimeoutMargin_ms = 100;
+// consecutive failed retrieves, each followed by a recovery, before a
+// capture gives up and leaves the next try to the caller
+static const int c_maxRetrieveFailures = 3;
+
 pointGreyCapture::pointGreyCapture() :
 	c_cameraPower(0x610), c_cameraPowerValue(0x80000000)
 {
 	m_acquisitionStarted = false;
 	m_isCameraStarted = false;
+	m_previousFrameNumber = 0;
+	m_lastSetFrameInterval_ms = 0;
+	m_imageWidth = m_imageHeight = m_imageSize = 0;
+	m_offsetX = m_offsetY = 0;
+	m_pixelFormat = PIXEL_FORMAT_RAW8;
+	m_cameraSerialNumber = 0;
+	m_useConfigCache = true;
+	m_setFirstFrameNumber = 0;
+	m_frameTrace = NULL;
+	m_frameRate = 0;
+	m_exposureTime_ms = 0;
+	m_isHardwareTrigger = true;
+	m_numBuffers = 0;
+	m_grabTimeoutSetting = 0;
+	m_grabTimeout_ms = 0;
+	m_lastError = PGRERROR_OK;
+	m_retrieveFailures = 0;
+	m_faultError = PGRERROR_OK;
+	m_faultPeriod = m_faultCount = 0;
+	m_framesToFault = m_faultsLeft = 0;
 }
 
 pointGreyCapture::~pointGreyCapture()
@@ -34,6 +69,9 @@ pointGreyCapture::~pointGreyCapture()
 // turn on the camera
 bool pointGreyCapture::openCamera(unsigned int cameraSerialNumber)
 {
+	m_bringUpSteps.clear();
+	auto stepStart = chrono::steady_clock::now();
+
 	BusManager	m_busManager; // Bus manager for all cameras
 	unsigned int numCameras;
 	if (!_checkLogError(m_busManager.GetNumOfCameras(&numCameras)))
@@ -64,39 +102,71 @@ bool pointGreyCapture::openCamera(unsigned int cameraSerialNumber)
 		return false;
 	}
 
+	_recordStep("bus enumeration", stepStart);
+
 	if (!_checkLogError(m_pCam.Connect(&m_cameraGUID)))
 	{
 		return false;
 	}
+	CameraInfo cameraInfo;
+	if (_checkLogError(m_pCam.GetCameraInfo(&cameraInfo)))
+	{
+		m_cameraSerialNumber = cameraInfo.serialNumber;
+	}
+	_recordStep("connect", stepStart);
 
-	// Power on the camera
-	if (!_checkLogError(m_pCam.WriteRegister(c_cameraPower, c_cameraPowerValue)))
+	// a camera that stayed powered still holds the settings of the last run,
+	// so its cached configuration is valid; a cold camera starts from defaults
+	bool isPowered = false;
+	if (!_powerUp(isPowered))
 	{
 		return false;
 	}
+	_loadConfigCache(isPowered && m_useConfigCache);
+	_recordStep(isPowered ? "power up (already on)" : "power up", stepStart);
 
-	//	Wait for the camera to power up
+	return true;
+}
+
+// power on the camera unless it is still on; isPowered tells which
+bool pointGreyCapture::_powerUp(bool& isPowered)
+{
 	unsigned int currentPowerValue = 0;
-	do
+	if (!_checkLogError(m_pCam.ReadRegister(c_cameraPower, &currentPowerValue)))
 	{
-		if (!_checkLogError(m_pCam.ReadRegister(c_cameraPower, &currentPowerValue)))
-		{
-			return false;
-		}
-
-	} while ((currentPowerValue & c_cameraPowerValue) == 0);
-
+		return false;
+	}
+	isPowered = (currentPowerValue & c_cameraPowerValue) != 0;
+	if (isPowered)
+	{
+		return true;
+	}
+	if (!_checkLogError(m_pCam.WriteRegister(c_cameraPower, c_cameraPowerValue)))
+	{
+		return false;
+	}
+	//	Wait for the camera to power up
+	if (!_waitForRegister(c_cameraPower, c_cameraPowerValue, c_cameraPowerValue, 2000))
+	{
+		cout << "camera did not power up" << endl;
+		return false;
+	}
 	return true;
 }
 
 // turn off the camera
 bool pointGreyCapture::closeCamera()
 {
-	if (!_checkLogError(m_pCam.StopCapture()))
+	// a camera that was only configured, e.g. to query its limits, never started
+	if (m_acquisitionStarted && !stopAcquisition())
 	{
 		return false;
 	} //	Failed to stop the camera
 
+	// the camera stays powered, keep what it is configured to for the next run
+	_saveConfigCache();
+	m_grabTimeout_ms = 0;
+
 	if (!_checkLogError(m_pCam.Disconnect()))
 	{
 		return false;
@@ -108,40 +178,83 @@ bool pointGreyCapture::closeCamera()
 // Exposure time is in ms 
 bool pointGreyCapture::initCamera(unsigned int imageWidth, unsigned int imageHeight, unsigned int offsetX, unsigned int offsetY, float frameRate, float exposureTime_ms, bool isHardwareTrigger)
 {
+	// settings that already match the cached camera state are not written again
+	auto stepStart = chrono::steady_clock::now();
+	// the grab timeout follows the frame period, also when the rate is cached
+	m_frameRate = frameRate;
+	m_exposureTime_ms = exposureTime_ms;
+	m_isHardwareTrigger = isHardwareTrigger;
+
 	// Set the frame counter on so that we can check what frame we are on
-	EmbeddedImageInfo imageInfo;
-	imageInfo.frameCounter.onOff = true;
-	if (!_checkLogError(m_pCam.SetEmbeddedImageInfo(&imageInfo)))
+	bool isCached = _isCached("embeddedInfo", "1");
+	if (!isCached)
 	{
-		return false;
+		EmbeddedImageInfo imageInfo;
+		imageInfo.frameCounter.onOff = true;
+		if (!_checkLogError(m_pCam.SetEmbeddedImageInfo(&imageInfo)))
+		{
+			return false;
+		}
+		_cacheValue("embeddedInfo", "1");
 	}
+	_recordStep("embedded image info", stepStart, isCached);
 
 	// setup gain to be always 0.0 to minimize noise impact
-	setGainValue(0.0);
+	isCached = _isCached("gain", _configValue(0.0f));
+	if (!isCached) setGainValue(0.0);
+	_recordStep("gain", stepStart, isCached);
 
 	// disable gamma
-	setGammaEnabled(false);
+	isCached = _isCached("gamma", "0");
+	if (!isCached) setGammaEnabled(false);
+	_recordStep("gamma", stepStart, isCached);
 
 	// setup hardware trigger 
-	setHardwareTrigger(isHardwareTrigger);
+	isCached = _isCached("trigger", isHardwareTrigger ? "1" : "0");
+	if (!isCached) setHardwareTrigger(isHardwareTrigger);
+	_recordStep("trigger", stepStart, isCached);
 
 	// set desired image resolution
-	setImageResolution(imageWidth, imageHeight, offsetX, offsetY);
+	isCached = _isCached("format7", _format7Value(imageWidth, imageHeight, offsetX, offsetY));
+	if (isCached)
+	{
+		m_imageWidth = imageWidth;
+		m_imageHeight = imageHeight;
+		m_imageSize = m_imageWidth * m_imageHeight;
+		m_offsetX = offsetX;
+		m_offsetY = offsetY;
+	}
+	else
+	{
+		setImageResolution(imageWidth, imageHeight, offsetX, offsetY);
+	}
+	_recordStep("format7", stepStart, isCached);
 
 	// set frame rate
-	setFrameRate(frameRate);
+	isCached = _isCached("frameRate", _configValue(frameRate));
+	if (!isCached) setFrameRate(frameRate);
+	_recordStep("frame rate", stepStart, isCached);
 
-	// set number of 
+	// set number of buffers, this is driver state and always applied
 	setBufferedGrab(60);
+	_recordStep("buffered grab", stepStart);
 
 	// set up expTime, this should be called after setFrameRate()
-	setExposureTime(exposureTime_ms);
+	isCached = _isCached("exposure", _configValue(exposureTime_ms));
+	if (!isCached) setExposureTime(exposureTime_ms);
+	_recordStep("exposure", stepStart, isCached);
 
-	// start frame counter
-	setFrameCounterEnabled(true);
+	// start frame counter and camera time stamp; the first step only turned
+	// on the frame counter, so the time stamp has its own cache entry
+	isCached = _isCached("embeddedTimestamp", "1");
+	if (!isCached) setFrameCounterEnabled(true);
+	_recordStep("frame counter", stepStart, isCached);
 
-	setWhiteBalance(650, 600);
+	isCached = _isCached("whiteBalance", _configValue(650.0f) + " " + _configValue(600.0f));
+	if (!isCached) setWhiteBalance(650, 600);
+	_recordStep("white balance", stepStart, isCached);
 
+	printBringUpReport();
 	return true;
 }
 // enable hardware trigger
@@ -165,19 +278,16 @@ bool pointGreyCapture::setHardwareTrigger(bool isHardwareTrigger)
 		return false;
 	}
 
-	int triggerValue = isHardwareTrigger ? 1 : 0;
+	// wait until bit 31 of the software trigger register leaves the trigger value
 	const unsigned int k_softwareTrigger = 0x62C;
-	unsigned int regVal = 0;
-	Error error;
-	do
+	const unsigned int k_triggerBit = 0x80000000;
+	if (!_waitForRegister(k_softwareTrigger, k_triggerBit, isHardwareTrigger ? 0 : k_triggerBit, 1000))
 	{
-		if (!_checkLogError(m_pCam.ReadRegister(k_softwareTrigger, &regVal)))
-		{
-			error.PrintErrorTrace();
-			//return false;
-		}
-
-	} while ((regVal >> 31) == triggerValue);
+		cout << "trigger register did not update" << endl;
+		return false;
+	}
+	_cacheValue("trigger", isHardwareTrigger ? "1" : "0");
+	m_isHardwareTrigger = isHardwareTrigger;
 
 	cout << "trigger updated to: " << to_string(isHardwareTrigger) << "..." << endl;
 	return true;
@@ -205,7 +315,10 @@ bool pointGreyCapture::setExposureTime(float& exposureTimeToSet)
 		cout << "camera exposure time cannot be updated" << endl;
 		return false;
 	}
+	_cacheValue("exposure", _configValue(exposureTimeToSet));
 	cout << "exposure time set to " << exposureTimeToSet << endl;
+	m_exposureTime_ms = exposureTimeToSet;
+	_updateGrabTimeout();
 	return true;
 }
 
@@ -236,7 +349,7 @@ bool pointGreyCapture::setImageResolution(unsigned int &widthToSet, unsigned int
 	cameraImageSettings.height = heightToSet;
 	cameraImageSettings.offsetX = offsetX;
 	cameraImageSettings.offsetY = offsetY;
-	cameraImageSettings.pixelFormat = PIXEL_FORMAT_RAW8;
+	cameraImageSettings.pixelFormat = m_pixelFormat;
 
 	bool valid;
 	Format7PacketInfo packetInfo;
@@ -276,6 +389,9 @@ bool pointGreyCapture::setImageResolution(unsigned int &widthToSet, unsigned int
 	m_imageWidth = cameraImageSettings.width;
 	m_imageHeight = cameraImageSettings.height;
 	m_imageSize = m_imageWidth * m_imageHeight;
+	m_offsetX = cameraImageSettings.offsetX;
+	m_offsetY = cameraImageSettings.offsetY;
+	_cacheValue("format7", _format7Value(m_imageWidth, m_imageHeight, m_offsetX, m_offsetY));
 
 	cout << "camera resolution set to (" << m_imageWidth << "," << m_imageHeight << ")" << endl;
 
@@ -305,7 +421,7 @@ bool pointGreyCapture::setImageResolution(unsigned int& widthToSet, unsigned int
 	cameraImageSettings.height = heightToSet;
 	cameraImageSettings.offsetX = offsetX;
 	cameraImageSettings.offsetY = offsetY;
-	cameraImageSettings.pixelFormat = PIXEL_FORMAT_RAW8;
+	cameraImageSettings.pixelFormat = m_pixelFormat;
 
 	bool valid;
 	Format7PacketInfo packetInfo;
@@ -345,12 +461,108 @@ bool pointGreyCapture::setImageResolution(unsigned int& widthToSet, unsigned int
 	m_imageWidth = cameraImageSettings.width;
 	m_imageHeight = cameraImageSettings.height;
 	m_imageSize = m_imageWidth * m_imageHeight;
+	m_offsetX = cameraImageSettings.offsetX;
+	m_offsetY = cameraImageSettings.offsetY;
+	_cacheValue("format7", _format7Value(m_imageWidth, m_imageHeight, m_offsetX, m_offsetY));
 
 	cout << "camera resolution set to (" << m_imageWidth << "," << m_imageHeight << ")" << endl;
 
 	return true;
 }
 
+// set pixel format, 8-bit (RAW8/MONO8), 12-bit packed (RAW12/MONO12) or 16-bit (RAW16/MONO16)
+// if the resolution is already configured it is re-applied with the new format
+bool pointGreyCapture::setPixelFormat(PixelFormat pixelFormatToSet)
+{
+	switch (pixelFormatToSet)
+	{
+	case PIXEL_FORMAT_RAW8:
+	case PIXEL_FORMAT_MONO8:
+	case PIXEL_FORMAT_RAW12:
+	case PIXEL_FORMAT_MONO12:
+	case PIXEL_FORMAT_RAW16:
+	case PIXEL_FORMAT_MONO16:
+		break;
+	default:
+		cout << "unsupported pixel format" << endl;
+		return false;
+	}
+
+	PixelFormat previousPixelFormat = m_pixelFormat;
+	m_pixelFormat = pixelFormatToSet;
+	if (m_imageWidth > 0)
+	{
+		unsigned int width = m_imageWidth;
+		unsigned int height = m_imageHeight;
+		if (!setImageResolution(width, height, m_offsetX, m_offsetY))
+		{
+			m_pixelFormat = previousPixelFormat;
+			return false;
+		}
+	}
+	return true;
+}
+
+// snap a region of interest to the sensor's Format7 step constraints
+// offsets are rounded down and sizes rounded up so that the snapped
+// region always covers the requested one, then clamped to the sensor
+bool pointGreyCapture::snapImageROI(unsigned int& widthToSet, unsigned int& heightToSet, unsigned int& offsetX, unsigned int& offsetY)
+{
+	Format7Info format7Info;
+	format7Info.mode = MODE_0;
+	bool supported = false;
+	if (!_checkLogError(m_pCam.GetFormat7Info(&format7Info, &supported)) || !supported)
+	{
+		cout << "format7 information cannot be retrieved" << endl;
+		return false;
+	}
+
+	unsigned int offsetHStep = format7Info.offsetHStepSize ? format7Info.offsetHStepSize : 1;
+	unsigned int offsetVStep = format7Info.offsetVStepSize ? format7Info.offsetVStepSize : 1;
+	unsigned int imageHStep = format7Info.imageHStepSize ? format7Info.imageHStepSize : 1;
+	unsigned int imageVStep = format7Info.imageVStepSize ? format7Info.imageVStepSize : 1;
+
+	offsetX = (std::min)(offsetX, format7Info.maxWidth - 1);
+	offsetY = (std::min)(offsetY, format7Info.maxHeight - 1);
+	unsigned int right = (std::min)(offsetX + widthToSet, format7Info.maxWidth);
+	unsigned int bottom = (std::min)(offsetY + heightToSet, format7Info.maxHeight);
+
+	offsetX = (offsetX / offsetHStep) * offsetHStep;
+	offsetY = (offsetY / offsetVStep) * offsetVStep;
+	widthToSet = ((right - offsetX + imageHStep - 1) / imageHStep) * imageHStep;
+	heightToSet = ((bottom - offsetY + imageVStep - 1) / imageVStep) * imageVStep;
+	widthToSet = (std::max)(imageHStep, (std::min)(widthToSet, (format7Info.maxWidth / imageHStep) * imageHStep));
+	heightToSet = (std::max)(imageVStep, (std::min)(heightToSet, (format7Info.maxHeight / imageVStep) * imageVStep));
+
+	// shift the region back inside the sensor if rounding pushed it out
+	if (offsetX + widthToSet > format7Info.maxWidth)
+	{
+		offsetX = ((format7Info.maxWidth - widthToSet) / offsetHStep) * offsetHStep;
+	}
+	if (offsetY + heightToSet > format7Info.maxHeight)
+	{
+		offsetY = ((format7Info.maxHeight - heightToSet) / offsetVStep) * offsetVStep;
+	}
+
+	return true;
+}
+
+// set a region of interest snapped to the sensor constraints
+// the snapped region is returned through the arguments
+bool pointGreyCapture::setImageROI(unsigned int& widthToSet, unsigned int& heightToSet, unsigned int& offsetX, unsigned int& offsetY)
+{
+	if (!snapImageROI(widthToSet, heightToSet, offsetX, offsetY))
+	{
+		return false;
+	}
+	if (!setImageResolution(widthToSet, heightToSet, offsetX, offsetY))
+	{
+		return false;
+	}
+	cout << "camera ROI offset set to (" << m_offsetX << "," << m_offsetY << ")" << endl;
+	return true;
+}
+
 // set frame rate
 bool pointGreyCapture::setFrameRate(float frameRateToSet)
 {
@@ -367,11 +579,28 @@ bool pointGreyCapture::setFrameRate(float frameRateToSet)
 		return false;
 	}
 
+	_cacheValue("frameRate", _configValue(frameRateToSet));
 	cout << "frame rate is set as " << frameRateToSet << endl;
+	m_frameRate = frameRateToSet;
+	_updateGrabTimeout();
 
 	return true;
 }
 
+// highest frame rate the camera allows at the current resolution, pixel format and exposure
+bool pointGreyCapture::getFrameRateLimit(float& maxFrameRate)
+{
+	PropertyInfo frameRateInfo;
+	frameRateInfo.type = FlyCapture2::FRAME_RATE;
+	if (!_checkLogError(m_pCam.GetPropertyInfo(&frameRateInfo)) || !frameRateInfo.present)
+	{
+		cout << "camera frame rate range cannot be retrieved" << endl;
+		return false;
+	}
+	maxFrameRate = frameRateInfo.absMax;
+	return true;
+}
+
 // set gain value
 bool pointGreyCapture::setGainValue(float gainvalueToSet)
 {
@@ -395,6 +624,7 @@ bool pointGreyCapture::setGainValue(float gainvalueToSet)
 		return false;
 	}
 
+	_cacheValue("gain", _configValue(gainvalueToSet));
 	cout << "gain is set as " << gainvalueToSet << endl;
 
 	return true;
@@ -418,6 +648,7 @@ bool pointGreyCapture::setGammaEnabled(bool isEnabled)
 		cout << "cannot configure gamma" << endl;
 		return false;
 	}
+	_cacheValue("gamma", "0");
 	cout << "gamma is disabled" << endl;
 
 	return true;
@@ -446,12 +677,15 @@ bool pointGreyCapture::setWhiteBalance(float gainRedToSet, float gainBlueToSet)
 		return false;
 	}
 
+	_cacheValue("whiteBalance", _configValue(gainRedToSet) + " " + _configValue(gainBlueToSet));
 	cout << "white balance is updated" << endl;
 
 	return true;
 }
 
 // set buffered grab, if necessary
+// RetrieveBuffer waits at most the grab timeout, so a missed trigger or a
+// stalled camera is noticed instead of blocking the capture thread
 bool pointGreyCapture::setBufferedGrab(int buffers)
 {
 	// Setup buffer grab mode
@@ -464,7 +698,7 @@ bool pointGreyCapture::setBufferedGrab(int buffers)
 	}
 
 	config.grabMode = BUFFER_FRAMES;
-	config.grabTimeout = TIMEOUT_INFINITE;
+	config.grabTimeout = _grabTimeout();
 	config.numBuffers = buffers;
 
 	if (!_checkLogError(m_pCam.SetConfiguration(&config)))
@@ -472,11 +706,54 @@ bool pointGreyCapture::setBufferedGrab(int buffers)
 		cout << "camera buffer cannot be upated" << endl;
 		return false;
 	}
+	m_numBuffers = buffers;
+	m_grabTimeout_ms = config.grabTimeout;
 
 	return true;
 }
 
-// enable frame counter
+// RetrieveBuffer timeout: a few frame periods, or exposures if they are
+// longer, so a missed trigger is noticed well within a second
+int pointGreyCapture::_grabTimeout() const
+{
+	if (m_grabTimeoutSetting != 0)
+	{
+		return m_grabTimeoutSetting < 0 ? TIMEOUT_INFINITE : m_grabTimeoutSetting;
+	}
+	float framePeriod_ms = m_frameRate > 0 ? 1000.0f / m_frameRate : 0;
+	return (int)(c_grabTimeoutPeriods * (std::max)(framePeriod_ms, m_exposureTime_ms)) + c_grabTimeoutMargin_ms;
+}
+
+// apply a changed grab timeout once the buffered grab is configured
+bool pointGreyCapture::_updateGrabTimeout()
+{
+	int grabTimeout = _grabTimeout();
+	if (m_grabTimeout_ms == 0 || grabTimeout == m_grabTimeout_ms)
+	{
+		return true;
+	}
+	FC2Config config;
+	if (!_checkLogError(m_pCam.GetConfiguration(&config)))
+	{
+		return false;
+	}
+	config.grabTimeout = grabTimeout;
+	if (!_checkLogError(m_pCam.SetConfiguration(&config)))
+	{
+		cout << "camera grab timeout cannot be updated" << endl;
+		return false;
+	}
+	m_grabTimeout_ms = grabTimeout;
+	return true;
+}
+
+bool pointGreyCapture::setGrabTimeout(int timeout_ms)
+{
+	m_grabTimeoutSetting = timeout_ms;
+	return _updateGrabTimeout();
+}
+
+// enable frame counter, and the camera time stamp where the camera has one
 bool pointGreyCapture::setFrameCounterEnabled(bool isEnabled)
 {
 	EmbeddedImageInfo EmbeddedInfo;
@@ -495,27 +772,496 @@ bool pointGreyCapture::setFrameCounterEnabled(bool isEnabled)
 		cout << "Frame counter is not available!" << endl;
 		return false;
 	}
+	// the camera time stamp goes along for the frame trace, where available
+	if (EmbeddedInfo.timestamp.available == true)
+	{
+		EmbeddedInfo.timestamp.onOff = isEnabled;
+	}
 	if (!_checkLogError(m_pCam.SetEmbeddedImageInfo(&EmbeddedInfo)))
 	{
 		cout << "camera frame counter cannot be changed" << endl;
 		return false;
 	}
+	_cacheValue("embeddedInfo", isEnabled ? "1" : "0");
+	_cacheValue("embeddedTimestamp", isEnabled ? "1" : "0");
+
+	return true;
+}
+
+// poll a register until (value & mask) == expectedValue
+// the delay between reads doubles from 0.1 ms up to 10 ms instead of spinning
+bool pointGreyCapture::_waitForRegister(unsigned int address, unsigned int mask, unsigned int expectedValue, int timeout_ms)
+{
+	auto startTime = chrono::steady_clock::now();
+	int delay_us = 100;
+	unsigned int regVal = 0;
+	while (true)
+	{
+		if (!_checkLogError(m_pCam.ReadRegister(address, &regVal)))
+		{
+			return false;
+		}
+		if ((regVal & mask) == expectedValue)
+		{
+			return true;
+		}
+		if (chrono::steady_clock::now() - startTime > chrono::milliseconds(timeout_ms))
+		{
+			cout << "register 0x" << hex << address << dec << " timed out after " << timeout_ms << " ms" << endl;
+			return false;
+		}
+		this_thread::sleep_for(chrono::microseconds(delay_us));
+		delay_us = (std::min)(delay_us * 2, 10000);
+	}
+}
+
+// per-serial configuration cache, one "key value" pair per line
+// the file is removed once loaded and written back on closeCamera, so a run
+// that ends without closing the camera leaves no stale cache behind
+std::string pointGreyCapture::_configCacheFile() const
+{
+	return "cameraConfig" + to_string(m_cameraSerialNumber) + ".txt";
+}
+
+void pointGreyCapture::_loadConfigCache(bool isValid)
+{
+	m_configCache.clear();
+	if (isValid)
+	{
+		ifstream cacheFile(_configCacheFile());
+		string line;
+		while (getline(cacheFile, line))
+		{
+			size_t split = line.find(' ');
+			if (split != string::npos)
+			{
+				m_configCache[line.substr(0, split)] = line.substr(split + 1);
+			}
+		}
+	}
+	remove(_configCacheFile().c_str());
+}
+
+void pointGreyCapture::_saveConfigCache() const
+{
+	if (!m_useConfigCache || m_cameraSerialNumber == 0)
+	{
+		return;
+	}
+	ofstream cacheFile(_configCacheFile());
+	for (auto& entry : m_configCache)
+	{
+		cacheFile << entry.first << " " << entry.second << endl;
+	}
+}
+
+// a write is skipped only when the cache holds the value and the camera
+// reads back the same, so a camera changed by another tool or reset since
+// the cache was saved is configured again; a read costs less than a write
+// and its validation, and settings missing from the cache are not read
+bool pointGreyCapture::_isCached(const std::string& key, const std::string& value)
+{
+	auto entry = m_configCache.find(key);
+	if (entry == m_configCache.end() || entry->second != value)
+	{
+		return false;
+	}
+	if (_isSameConfigValue(_readConfigValue(key), value))
+	{
+		return true;
+	}
+	cout << "camera " << m_cameraSerialNumber << " " << key << " differs from the cached value, applying it again" << endl;
+	return false;
+}
+
+// the camera's current value of a cached setting, formatted like the cache;
+// empty when it cannot be read
+std::string pointGreyCapture::_readConfigValue(const std::string& key)
+{
+	if (key == "embeddedInfo")
+	{
+		EmbeddedImageInfo imageInfo;
+		if (!_checkLogError(m_pCam.GetEmbeddedImageInfo(&imageInfo))) return "";
+		return imageInfo.frameCounter.onOff ? "1" : "0";
+	}
+	// a camera without a time stamp has it as far on as it gets
+	if (key == "embeddedTimestamp")
+	{
+		EmbeddedImageInfo imageInfo;
+		if (!_checkLogError(m_pCam.GetEmbeddedImageInfo(&imageInfo))) return "";
+		return !imageInfo.timestamp.available || imageInfo.timestamp.onOff ? "1" : "0";
+	}
+	if (key == "trigger")
+	{
+		TriggerMode triggerMode;
+		if (!_checkLogError(m_pCam.GetTriggerMode(&triggerMode))) return "";
+		return triggerMode.onOff ? "1" : "0";
+	}
+	if (key == "format7")
+	{
+		Format7ImageSettings imageSettings;
+		unsigned int packetSize;
+		float packetPercentage;
+		if (!_checkLogError(m_pCam.GetFormat7Configuration(&imageSettings, &packetSize, &packetPercentage))) return "";
+		ostringstream text;
+		text << imageSettings.width << " " << imageSettings.height << " " << imageSettings.offsetX << " "
+			<< imageSettings.offsetY << " " << (int)imageSettings.pixelFormat;
+		return text.str();
+	}
+
+	Property property;
+	if (key == "gain") property.type = GAIN;
+	else if (key == "gamma") property.type = GAMMA;
+	else if (key == "frameRate") property.type = FRAME_RATE;
+	else if (key == "exposure") property.type = SHUTTER;
+	else if (key == "whiteBalance") property.type = WHITE_BALANCE;
+	else return "";
+	if (!_checkLogError(m_pCam.GetProperty(&property))) return "";
+	if (key == "gamma") return property.onOff ? "1" : "0";
+	if (key == "whiteBalance") return _configValue((float)property.valueA) + " " + _configValue((float)property.valueB);
+	return _configValue(property.absValue);
+}
+
+// values match field by field; numbers within the 0.5% the camera's
+// register steps round a written value to
+bool pointGreyCapture::_isSameConfigValue(const std::string& cameraValue, const std::string& value) const
+{
+	istringstream cameraFields(cameraValue), fields(value);
+	double cameraField, field;
+	bool isSame = !cameraValue.empty();
+	while (isSame && (fields >> field))
+	{
+		isSame = (cameraFields >> cameraField) && fabs(cameraField - field) <= 0.005 * (std::max)(fabs(field), 1e-3);
+	}
+	return isSame && !(cameraFields >> cameraField);
+}
+
+//--------------------------------------------------------------------
+// Read every applied setting back from the camera
+// A check of the configuration the cache and the setters believe the
+// camera holds, e.g. after bring-up or a reconnect
+// Output:
+//		mismatches		= one "setting: expected ..., camera ..." line each
+//		true if the camera holds every setting
+//--------------------------------------------------------------------
+bool pointGreyCapture::verifyConfiguration(std::vector<std::string>& mismatches)
+{
+	size_t mismatchCount = mismatches.size();
+	for (auto& entry : m_configCache)
+	{
+		string cameraValue = _readConfigValue(entry.first);
+		if (!_isSameConfigValue(cameraValue, entry.second))
+		{
+			mismatches.push_back(entry.first + ": expected " + entry.second + ", camera " + (cameraValue.empty() ? "unreadable" : cameraValue));
+		}
+	}
+	return mismatches.size() == mismatchCount;
+}
+
+void pointGreyCapture::_cacheValue(const std::string& key, const std::string& value)
+{
+	m_configCache[key] = value;
+}
+
+std::string pointGreyCapture::_configValue(float value) const
+{
+	ostringstream text;
+	text << value;
+	return text.str();
+}
+
+std::string pointGreyCapture::_format7Value(unsigned int width, unsigned int height, unsigned int offsetX, unsigned int offsetY) const
+{
+	ostringstream text;
+	text << width << " " << height << " " << offsetX << " " << offsetY << " " << (int)m_pixelFormat;
+	return text.str();
+}
+
+// time of one bring-up step, measured from stepStart which is then reset
+void pointGreyCapture::_recordStep(const char* stepName, std::chrono::steady_clock::time_point& stepStart, bool isCached)
+{
+	auto now = chrono::steady_clock::now();
+	string name = isCached ? string(stepName) + " (cached)" : string(stepName);
+	m_bringUpSteps.push_back(make_pair(name, chrono::duration<double, milli>(now - stepStart).count()));
+	stepStart = now;
+}
+
+// print the time taken by each step of openCamera and initCamera
+// built into one string so the reports of concurrent cameras do not interleave
+void pointGreyCapture::printBringUpReport() const
+{
+	double total = 0;
+	ostringstream report;
+	report << "camera " << m_cameraSerialNumber << " bring-up:" << endl;
+	for (auto& step : m_bringUpSteps)
+	{
+		report << "  " << step.first << ": " << step.second << " ms" << endl;
+		total += step.second;
+	}
+	report << "  total: " << total << " ms" << endl;
+	cout << report.str();
+}
+
+// retrieve frames until one arrives at or after releaseTime (system clock
+// seconds since the epoch); its frame counter is returned so that a set
+// started with it as firstFrameCounter begins with the next frame
+bool pointGreyCapture::skipFramesBefore(double releaseTime, unsigned long& frameCounter)
+{
+	if (!m_acquisitionStarted)
+	{
+		cout << "image acquisition has not started, call startAcqusition() first" << endl;
+		return false;
+	}
+	do
+	{
+		if (!_retrieveBuffer() && _isStreamLost())
+		{
+			cout << "frame is not properly retrieved" << endl;
+			return false;
+		}
+	} while (_frameTime() < releaseTime);
+	frameCounter = m_rawImageBuffer.GetMetadata().embeddedFrameCounter;
+	m_previousFrameNumber = frameCounter;
+	return true;
+}
+
+// hand a stored set frame to the frame callback, if one is set
+template <typename T>
+void pointGreyCapture::_notifyFrame(int frameIndex, const T* frameData)
+{
+	if (m_frameCallback)
+	{
+		m_frameCallback(frameIndex, (const unsigned char*)frameData, m_imageWidth, m_imageHeight, (int)sizeof(T));
+	}
+}
+
+// retrieve the next frame from the driver; with a trace set, the time spent
+// waiting in RetrieveBuffer is recorded against the frame that arrived
+// a retrieve that timed out or lost the stream recovers it before it
+// returns false, so the next call waits for a fresh frame; torn frames
+// (image consistency errors) are only dropped
+bool pointGreyCapture::_retrieveBuffer()
+{
+	long long retrieveStart = _traceStart();
+	bool isRetrieved = _isFaultDue() ? _injectFault() : _checkLogError(m_pCam.RetrieveBuffer(&m_rawImageBuffer));
+	if (!isRetrieved)
+	{
+		if (m_lastError != PGRERROR_IMAGE_CONSISTENCY_ERROR && m_acquisitionStarted)
+		{
+			m_retrieveFailures++;
+			_recoverStream(m_lastError);
+		}
+		return false;
+	}
+	m_retrieveFailures = 0;
+	_traceFrame(TRACE_RETRIEVE, retrieveStart);
+	return true;
+}
+
+// a capture waiting for the start of a cycle keeps going after a recovered
+// failure, until the failures run without a good frame in between
+bool pointGreyCapture::_isStreamLost() const
+{
+	return m_retrieveFailures >= c_maxRetrieveFailures;
+}
+
+//--------------------------------------------------------------------
+// Bring a failed stream back
+// The capture is stopped and started again; when that fails, or the
+// retrieve after the last restart failed as well, the camera is
+// disconnected and connected again. The camera settings stay on the
+// powered camera, only the driver's grab configuration is applied again.
+// Frames of a set in progress are lost, the caller captures the set
+// again from the next cycle. Error, outcome and time taken are recorded.
+//--------------------------------------------------------------------
+bool pointGreyCapture::_recoverStream(ErrorType error)
+{
+	auto recoveryStart = chrono::steady_clock::now();
+	long long traceStart = _traceStart();
+	StreamRecovery recovery;
+	recovery.error = error;
+	recovery.description = m_lastErrorDescription;
+	recovery.frameCounter = m_previousFrameNumber;
+	recovery.isReconnected = m_retrieveFailures > 1;
+	recovery.isRecovered = false;
+	if (!recovery.isReconnected)
+	{
+		m_pCam.StopCapture();	// fails on a lost stream, the start tells
+		recovery.isRecovered = _checkLogError(m_pCam.StartCapture());
+		recovery.isReconnected = !recovery.isRecovered;
+	}
+	if (recovery.isReconnected)
+	{
+		recovery.isRecovered = _reconnectCamera();
+	}
+	// the capture is still wanted, a failed recovery is tried again on the next retrieve
+	m_acquisitionStarted = true;
+	recovery.recovery_ms = chrono::duration<float, milli>(chrono::steady_clock::now() - recoveryStart).count();
+	m_recoveries.push_back(recovery);
+	if (m_frameTrace)
+	{
+		m_frameTrace->Record(m_cameraSerialNumber, TRACE_RECOVER, recovery.frameCounter, 0, traceStart, m_frameTrace->Now(), (int)error);
+	}
+	cout << "camera " << m_cameraSerialNumber << (recovery.isReconnected ? " reconnected" : " restarted")
+		<< (recovery.isRecovered ? "" : " without success") << " after error " << error
+		<< " in " << recovery.recovery_ms << " ms" << endl;
+	return recovery.isRecovered;
+}
+
+// a camera that needed a reconnect may have lost power or re-enumerated
+// and come back with default registers: the cache is dropped, the whole
+// configuration written again, and the trigger and format7 settings read
+// back before the stream counts as recovered
+bool pointGreyCapture::_reconnectCamera()
+{
+	m_pCam.StopCapture();
+	m_pCam.Disconnect();
+	m_configCache.clear();
+	bool isPowered = false;
+	if (!_checkLogError(m_pCam.Connect(&m_cameraGUID)) || !_powerUp(isPowered))
+	{
+		return false;
+	}
+
+	unsigned int width = m_imageWidth;
+	unsigned int height = m_imageHeight;
+	unsigned int offsetX = m_offsetX;
+	unsigned int offsetY = m_offsetY;
+	m_bringUpSteps.clear();
+	if (!initCamera(width, height, offsetX, offsetY, m_frameRate, m_exposureTime_ms, m_isHardwareTrigger))
+	{
+		m_configCache.clear();
+		return false;
+	}
+	if (!_isSameConfigValue(_readConfigValue("trigger"), m_isHardwareTrigger ? "1" : "0") ||
+		!_isSameConfigValue(_readConfigValue("format7"), _format7Value(width, height, offsetX, offsetY)))
+	{
+		cout << "camera " << m_cameraSerialNumber << " does not hold its trigger and format7 settings after the reconnect" << endl;
+		m_configCache.clear();
+		return false;
+	}
+	return startAcquisition();
+}
 
+void pointGreyCapture::injectRetrieveFaults(ErrorType error, int faultPeriod, int faultCount)
+{
+	m_faultError = error;
+	m_faultPeriod = faultPeriod;
+	m_faultCount = (std::max)(faultCount, 1);
+	m_framesToFault = faultPeriod;
+	m_faultsLeft = 0;
+}
+
+// count down to the next injected fault; true when this retrieve fails
+bool pointGreyCapture::_isFaultDue()
+{
+	if (m_faultPeriod <= 0)
+	{
+		return false;
+	}
+	if (m_faultsLeft > 0)
+	{
+		m_faultsLeft--;
+		return true;
+	}
+	if (--m_framesToFault > 0)
+	{
+		return false;
+	}
+	m_framesToFault = m_faultPeriod;
+	m_faultsLeft = m_faultCount - 1;
 	return true;
 }
 
+// fail a retrieve as the driver would; a timeout first waits it out
+bool pointGreyCapture::_injectFault()
+{
+	if (m_faultError == PGRERROR_TIMEOUT && m_grabTimeout_ms > 0)
+	{
+		this_thread::sleep_for(chrono::milliseconds(m_grabTimeout_ms));
+	}
+	return _logError(m_faultError, "injected fault");
+}
+
+// print the errors seen and every stream recovery with its cost
+// built into one string so the reports of concurrent cameras do not interleave
+void pointGreyCapture::printRecoveryReport() const
+{
+	if (m_errorCounts.empty())
+	{
+		return;
+	}
+	ostringstream report;
+	report << "camera " << m_cameraSerialNumber << " errors:" << endl;
+	for (auto& errorCount : m_errorCounts)
+	{
+		report << "  error " << errorCount.first << ": " << errorCount.second << " times" << endl;
+	}
+	for (const StreamRecovery& recovery : m_recoveries)
+	{
+		report << "  frame " << recovery.frameCounter << ", error " << recovery.error << " (" << recovery.description << "): "
+			<< (recovery.isReconnected ? "reconnect" : "restart") << (recovery.isRecovered ? "" : " failed")
+			<< ", " << recovery.recovery_ms << " ms" << endl;
+	}
+	cout << report.str();
+}
+
+// start time of a traced stage, 0 without a trace
+long long pointGreyCapture::_traceStart() const
+{
+	return m_frameTrace ? m_frameTrace->Now() : 0;
+}
+
+// record a stage of the last retrieved frame that began at stageStart
+void pointGreyCapture::_traceFrame(FrameTraceStage stage, long long stageStart)
+{
+	if (m_frameTrace)
+	{
+		ImageMetadata metadata = m_rawImageBuffer.GetMetadata();
+		m_frameTrace->Record(m_cameraSerialNumber, stage, metadata.embeddedFrameCounter, metadata.embeddedTimeStamp,
+			stageStart, m_frameTrace->Now());
+	}
+}
+
+// a set stops at a gap in the frame counter; the trace marks where it happened
+void pointGreyCapture::_reportSkip(unsigned long frameCounter)
+{
+	cout << "...frame skiped: " << frameCounter - m_previousFrameNumber << endl;
+	if (m_frameTrace)
+	{
+		m_frameTrace->RecordSkip(m_cameraSerialNumber, frameCounter, (int)(frameCounter - m_previousFrameNumber) - 1);
+	}
+}
+
+// host time stamp of the last retrieved frame in seconds
+double pointGreyCapture::_frameTime() const
+{
+	TimeStamp timeStamp = m_rawImageBuffer.GetTimeStamp();
+	return (double)timeStamp.seconds + timeStamp.microSeconds * 1e-6;
+}
+
 // check PRG error messages
 bool pointGreyCapture::_checkLogError(Error error)
 {
 	if (error != PGRERROR_OK)
 	{
-		return false;
+		return _logError(error.GetType(), error.GetDescription());
 	} // Log our error and return false
 
 	//  No error, return true
 	return true;
 }
 
+// keep the error for the stream recovery and the recovery report
+bool pointGreyCapture::_logError(ErrorType errorType, const char* description)
+{
+	m_lastError = errorType;
+	m_lastErrorDescription = description;
+	m_errorCounts[errorType]++;
+	cout << "camera " << m_cameraSerialNumber << " error " << errorType << ": " << description << endl;
+	return false;
+}
+
 // start capture
 bool pointGreyCapture::startAcquisition()
 {
@@ -553,9 +1299,11 @@ bool pointGreyCapture::captureSingleImage(Image &captureImage, bool isStreamMode
 		cout << "image acquisition has not started, check startAcqusition()" << endl;
 		return false;
 	}
-	if (!_checkLogError(m_pCam.RetrieveBuffer(&m_rawImageBuffer)))
+	if (!_retrieveBuffer())
 	{
 		cout << "frame is not properly retrieved" << endl;
+		if (!isStreamMode) stopAcquisition();
+		return false;
 	}
 	if (!_checkLogError(m_rawImageBuffer.Convert(PIXEL_FORMAT_MONO8, &captureImage)))
 	{
@@ -587,9 +1335,15 @@ bool pointGreyCapture::captureImageSet(Image captureImage[], int numberOfFrames,
 	long int currentFrameCounter = firstFrameCounter;
 	while ((currentFrameCounter - firstFrameCounter) % numberOfFrames != 1)
 	{
-		if (!_checkLogError(m_pCam.RetrieveBuffer(&m_rawImageBuffer)))
+		if (!_retrieveBuffer())
 		{
-			cout << "frame is not properly retrieved" << endl;
+			// a recovered stream goes on to the next cycle start
+			if (_isStreamLost())
+			{
+				cout << "frame is not properly retrieved" << endl;
+				return false;
+			}
+			continue;
 		}
 		currentFrameCounter = m_rawImageBuffer.GetMetadata().embeddedFrameCounter;
 	}
@@ -604,7 +1358,7 @@ bool pointGreyCapture::captureImageSet(Image captureImage[], int numberOfFrames,
 	for (int k = 1; k < numberOfFrames; k++)
 	{
 		
-		if (!_checkLogError(m_pCam.RetrieveBuffer(&m_rawImageBuffer)))
+		if (!_retrieveBuffer())
 		{
 			cout << "frame is not properly retrieved" << endl;
 			return false;
@@ -622,7 +1376,7 @@ bool pointGreyCapture::captureImageSet(Image captureImage[], int numberOfFrames,
 		}
 		else
 		{
-			cout << "...frame skiped: " << currentFrameCounter - m_previousFrameNumber << endl;
+			_reportSkip(currentFrameCounter);
 			return false;
 		}
 		cout << "frame counter: " << currentFrameCounter << endl;
@@ -647,11 +1401,40 @@ bool pointGreyCapture::captureSingleImageData(unsigned char *captureImage, bool
 		cout << "image acquisition has not started, check startAcqusition()" << endl;
 		return false;
 	}
-	if (!_checkLogError(m_pCam.RetrieveBuffer(&m_rawImageBuffer)))
+	// the buffer still holds the last frame, it is not handed out again
+	if (!_retrieveBuffer())
+	{
+		cout << "frame is not properly retrieved" << endl;
+		if (!isStreamMode) stopAcquisition();
+		return false;
+	}
+	_copyFrameData(captureImage);
+	// a set captured from the same stream continues from this frame
+	m_previousFrameNumber = m_rawImageBuffer.GetMetadata().embeddedFrameCounter;
+	if (!isStreamMode) stopAcquisition();
+	return true;
+}
+
+// capture single image at high bit depth
+// store the image in a 16-bit image data array
+bool pointGreyCapture::captureSingleImageData(unsigned short* captureImage, bool isStreamMode)
+{
+	if (!isStreamMode) startAcquisition();
+	if (!m_acquisitionStarted)
+	{
+		cout << "image acquisition has not started, check startAcqusition()" << endl;
+		return false;
+	}
+	// the buffer still holds the last frame, it is not handed out again
+	if (!_retrieveBuffer())
 	{
 		cout << "frame is not properly retrieved" << endl;
+		if (!isStreamMode) stopAcquisition();
+		return false;
 	}
-	memcpy(captureImage, m_rawImageBuffer.GetData(), sizeof(captureImage[0]) * m_imageSize );
+	_copyFrameData(captureImage);
+	// a set captured from the same stream continues from this frame
+	m_previousFrameNumber = m_rawImageBuffer.GetMetadata().embeddedFrameCounter;
 	if (!isStreamMode) stopAcquisition();
 	return true;
 }
@@ -665,6 +1448,21 @@ bool pointGreyCapture::captureSingleImageData(unsigned char *captureImage, bool
 //				user interactions
 bool pointGreyCapture::captureImageSetData(unsigned char *captureImage[], int numberOfFrames, 
 	int firstFrameCounter, bool isStreamMode)
+{
+	return _captureImageSetData(captureImage, numberOfFrames, firstFrameCounter, isStreamMode);
+}
+
+// capture a set of images at high bit depth
+// store the set of images in 16-bit image data arrays
+bool pointGreyCapture::captureImageSetData(unsigned short* captureImage[], int numberOfFrames,
+	int firstFrameCounter, bool isStreamMode)
+{
+	return _captureImageSetData(captureImage, numberOfFrames, firstFrameCounter, isStreamMode);
+}
+
+template <typename T>
+bool pointGreyCapture::_captureImageSetData(T* captureImage[], int numberOfFrames,
+	int firstFrameCounter, bool isStreamMode)
 {
 	if (!isStreamMode) startAcquisition();
 	if (!m_acquisitionStarted)
@@ -677,21 +1475,32 @@ bool pointGreyCapture::captureImageSetData(unsigned char *captureImage[], int nu
 	long int currentFrameCounter = firstFrameCounter;
 	while ((currentFrameCounter - firstFrameCounter) % numberOfFrames != 1)
 	{
-		if (!_checkLogError(m_pCam.RetrieveBuffer(&m_rawImageBuffer)))
+		if (!_retrieveBuffer())
 		{
-			cout << "frame is not properly retrieved" << endl;
+			// a recovered stream goes on to the next cycle start
+			if (_isStreamLost())
+			{
+				cout << "frame is not properly retrieved" << endl;
+				return false;
+			}
+			continue;
 		}
 		currentFrameCounter = m_rawImageBuffer.GetMetadata().embeddedFrameCounter;
 	}
 	// copy first frame
-	memcpy(captureImage[0], m_rawImageBuffer.GetData(), sizeof(captureImage[0][0]) * m_imageSize);
+	long long handOffStart = _traceStart();
+	_copyFrameData(captureImage[0]);
+	_traceFrame(TRACE_HANDOFF, handOffStart);
+	_notifyFrame(0, captureImage[0]);
+	double setStartTime = _frameTime();
 	m_previousFrameNumber = currentFrameCounter;
+	m_setFirstFrameNumber = currentFrameCounter;
 
 	// grab the rest number of frames
 	for (int k = 1; k < numberOfFrames; k++)
 	{
 
-		if (!_checkLogError(m_pCam.RetrieveBuffer(&m_rawImageBuffer)))
+		if (!_retrieveBuffer())
 		{
 			cout << "frame is not properly retrieved" << endl;
 			return false;
@@ -699,17 +1508,304 @@ bool pointGreyCapture::captureImageSetData(unsigned char *captureImage[], int nu
 		currentFrameCounter = m_rawImageBuffer.GetMetadata().embeddedFrameCounter;
 		if (currentFrameCounter - m_previousFrameNumber == 1)
 		{
-			memcpy(captureImage[k], m_rawImageBuffer.GetData(), sizeof(captureImage[k][0]) * m_imageSize);
+			handOffStart = _traceStart();
+			_copyFrameData(captureImage[k]);
+			_traceFrame(TRACE_HANDOFF, handOffStart);
+			_notifyFrame(k, captureImage[k]);
 			m_previousFrameNumber = currentFrameCounter;
 		}
 		else
 		{
-			cout << "...frame skiped: " << currentFrameCounter - m_previousFrameNumber << endl;
+			_reportSkip(currentFrameCounter);
 			return false;
 		}
 		cout << "frame counter: " << currentFrameCounter << endl;
 
 	}
+	m_lastSetFrameInterval_ms = (float)((_frameTime() - setStartTime) * 1000.0 / (std::max)(numberOfFrames - 1, 1));
 	if (!isStreamMode) stopAcquisition();
 	return true;
 }
+
+
+// capture numberOfCycles consecutive pattern cycles and average them per phase slot
+// frames are added into one set of accumulators as they arrive, so memory does not
+// grow with the number of cycles; up to 257 cycles for 8-bit and 65537 for 16-bit data
+bool pointGreyCapture::captureImageSetAverage(unsigned char* captureImage[], int numberOfFrames,
+	int numberOfCycles, int firstFrameCounter, bool isStreamMode)
+{
+	return _captureImageSetAverage(captureImage, numberOfFrames, numberOfCycles, firstFrameCounter, isStreamMode);
+}
+
+bool pointGreyCapture::captureImageSetAverage(unsigned short* captureImage[], int numberOfFrames,
+	int numberOfCycles, int firstFrameCounter, bool isStreamMode)
+{
+	return _captureImageSetAverage(captureImage, numberOfFrames, numberOfCycles, firstFrameCounter, isStreamMode);
+}
+
+template <typename T>
+bool pointGreyCapture::_captureImageSetAverage(T* captureImage[], int numberOfFrames,
+	int numberOfCycles, int firstFrameCounter, bool isStreamMode)
+{
+	if (numberOfCycles <= 1)
+	{
+		return _captureImageSetData(captureImage, numberOfFrames, firstFrameCounter, isStreamMode);
+	}
+	if ((sizeof(T) == 2) != isHighBitDepth())
+	{
+		cout << "set buffer depth does not match the pixel format" << endl;
+		return false;
+	}
+	const int maxCycles = sizeof(T) == 1 ? 257 : 65537;
+	if (numberOfCycles > maxCycles)
+	{
+		cout << "too many cycles to average: " << numberOfCycles << endl;
+		return false;
+	}
+
+	if (!isStreamMode) startAcquisition();
+	if (!m_acquisitionStarted)
+	{
+		cout << "image acquisition has not started, call startAcqusition() first" << endl;
+		return false;
+	}
+
+	auto accumulator = _getSetAccumulator(captureImage[0], (size_t)numberOfFrames * m_imageSize);
+
+	// skip frames that until the first frame
+	long int currentFrameCounter = firstFrameCounter;
+	while ((currentFrameCounter - firstFrameCounter) % numberOfFrames != 1)
+	{
+		if (!_retrieveBuffer())
+		{
+			// a recovered stream goes on to the next cycle start
+			if (_isStreamLost())
+			{
+				cout << "frame is not properly retrieved" << endl;
+				return false;
+			}
+			continue;
+		}
+		currentFrameCounter = m_rawImageBuffer.GetMetadata().embeddedFrameCounter;
+	}
+	// the first cycle initializes the accumulators
+	long long handOffStart = _traceStart();
+	_accumulateFrameData(accumulator, true);
+	_traceFrame(TRACE_HANDOFF, handOffStart);
+	double setStartTime = _frameTime();
+	m_previousFrameNumber = currentFrameCounter;
+	m_setFirstFrameNumber = currentFrameCounter;
+
+	// accumulate the rest of the frames into their phase slots
+	int totalFrames = numberOfFrames * numberOfCycles;
+	for (int k = 1; k < totalFrames; k++)
+	{
+		if (!_retrieveBuffer())
+		{
+			cout << "frame is not properly retrieved" << endl;
+			return false;
+		}
+		currentFrameCounter = m_rawImageBuffer.GetMetadata().embeddedFrameCounter;
+		if (currentFrameCounter - m_previousFrameNumber != 1)
+		{
+			_reportSkip(currentFrameCounter);
+			return false;
+		}
+		handOffStart = _traceStart();
+		_accumulateFrameData(accumulator + (size_t)(k % numberOfFrames) * m_imageSize, k < numberOfFrames);
+		_traceFrame(TRACE_HANDOFF, handOffStart);
+		m_previousFrameNumber = currentFrameCounter;
+	}
+	m_lastSetFrameInterval_ms = (float)((_frameTime() - setStartTime) * 1000.0 / (std::max)(totalFrames - 1, 1));
+	if (!isStreamMode) stopAcquisition();
+
+	// emit the averaged set
+	for (int k = 0; k < numberOfFrames; k++)
+	{
+		FringeKernels::averageFrame(accumulator + (size_t)k * m_imageSize, numberOfCycles, captureImage[k], m_imageSize);
+		_notifyFrame(k, captureImage[k]);
+	}
+	cout << numberOfCycles << " cycles averaged, last frame counter: " << currentFrameCounter << endl;
+	return true;
+}
+
+// 16-bit accumulators for 8-bit sets
+unsigned short* pointGreyCapture::_getSetAccumulator(unsigned char* captureImage, size_t accumulatorSize)
+{
+	if (m_setAccumulator16.size() < accumulatorSize) m_setAccumulator16.resize(accumulatorSize);
+	return m_setAccumulator16.data();
+}
+
+// 32-bit accumulators for 16-bit sets
+unsigned int* pointGreyCapture::_getSetAccumulator(unsigned short* captureImage, size_t accumulatorSize)
+{
+	if (m_setAccumulator32.size() < accumulatorSize) m_setAccumulator32.resize(accumulatorSize);
+	return m_setAccumulator32.data();
+}
+
+// capture one pattern cycle per exposure and fuse them into a 16-bit set while streaming
+// exposureTimes are in ms, longest first; each pixel keeps the longest exposure that did
+// not saturate in any frame of its cycle, so phase slots of one pixel share an exposure
+// fused values are in units of the shortest exposure scaled by 256; exposureMap receives
+// the index of the exposure used per pixel; raw exposure cycles are never buffered
+bool pointGreyCapture::captureImageSetHDR(unsigned short* fusedImage[], unsigned char* exposureMap, int numberOfFrames,
+	const float exposureTimes[], int numberOfExposures, int firstFrameCounter, bool isStreamMode)
+{
+	const unsigned char saturationLevel = 250;
+	if (isHighBitDepth())
+	{
+		cout << "HDR capture needs an 8-bit pixel format" << endl;
+		return false;
+	}
+	if (numberOfExposures < 1 || numberOfExposures > 255)
+	{
+		cout << "invalid number of HDR exposures: " << numberOfExposures << endl;
+		return false;
+	}
+	for (int e = 1; e < numberOfExposures; e++)
+	{
+		if (exposureTimes[e] > exposureTimes[e - 1])
+		{
+			cout << "HDR exposure times must be sorted from longest to shortest" << endl;
+			return false;
+		}
+	}
+
+	if (!isStreamMode) startAcquisition();
+	if (!m_acquisitionStarted)
+	{
+		cout << "image acquisition has not started, call startAcqusition() first" << endl;
+		return false;
+	}
+
+	if (m_saturatedFlags.size() < (size_t)m_imageSize) m_saturatedFlags.resize(m_imageSize);
+	memset(exposureMap, 0, m_imageSize);
+	memset(m_saturatedFlags.data(), 0, m_imageSize);
+
+	const float shortestExposure = exposureTimes[numberOfExposures - 1];
+	long int currentFrameCounter = firstFrameCounter;
+	for (int e = 0; e < numberOfExposures; e++)
+	{
+		float exposureTime = exposureTimes[e];
+		if (!setExposureTime(exposureTime)) return false;
+		unsigned short gain = (unsigned short)(256.0f * shortestExposure / exposureTime + 0.5f);
+
+		// frames in flight were exposed with the previous setting, let them pass
+		if (!_retrieveCycleStart(numberOfFrames, firstFrameCounter, 2)) return false;
+		currentFrameCounter = m_rawImageBuffer.GetMetadata().embeddedFrameCounter;
+		long long handOffStart = _traceStart();
+		FringeKernels::fuseExposureFrame(m_rawImageBuffer.GetData(), fusedImage[0], exposureMap,
+			m_saturatedFlags.data(), (unsigned char)e, gain, saturationLevel, m_imageSize);
+		_traceFrame(TRACE_HANDOFF, handOffStart);
+		if (e == 0) m_setFirstFrameNumber = currentFrameCounter;
+		// the longest exposure cycle stands in for the fused frames
+		if (e == 0) _notifyFrame(0, m_rawImageBuffer.GetData());
+		m_previousFrameNumber = currentFrameCounter;
+
+		for (int k = 1; k < numberOfFrames; k++)
+		{
+			if (!_retrieveBuffer())
+			{
+				cout << "frame is not properly retrieved" << endl;
+				return false;
+			}
+			currentFrameCounter = m_rawImageBuffer.GetMetadata().embeddedFrameCounter;
+			if (currentFrameCounter - m_previousFrameNumber != 1)
+			{
+				_reportSkip(currentFrameCounter);
+				return false;
+			}
+			handOffStart = _traceStart();
+			FringeKernels::fuseExposureFrame(m_rawImageBuffer.GetData(), fusedImage[k], exposureMap,
+				m_saturatedFlags.data(), (unsigned char)e, gain, saturationLevel, m_imageSize);
+			_traceFrame(TRACE_HANDOFF, handOffStart);
+			if (e == 0) _notifyFrame(k, m_rawImageBuffer.GetData());
+			m_previousFrameNumber = currentFrameCounter;
+		}
+		// saturated pixels move on to the next shorter exposure
+		if (e + 1 < numberOfExposures)
+		{
+			FringeKernels::promoteSaturated(exposureMap, m_saturatedFlags.data(), m_imageSize);
+		}
+	}
+	if (!isStreamMode) stopAcquisition();
+	cout << numberOfExposures << " exposures fused, last frame counter: " << currentFrameCounter << endl;
+	return true;
+}
+
+// retrieve frames until the first frame of a cycle, after at least minimumSkippedFrames
+bool pointGreyCapture::_retrieveCycleStart(int numberOfFrames, int firstFrameCounter, int minimumSkippedFrames)
+{
+	int skippedFrames = 0;
+	long int currentFrameCounter = firstFrameCounter;
+	while (skippedFrames <= minimumSkippedFrames || (currentFrameCounter - firstFrameCounter) % numberOfFrames != 1)
+	{
+		if (!_retrieveBuffer())
+		{
+			if (_isStreamLost())
+			{
+				cout << "frame is not properly retrieved" << endl;
+				return false;
+			}
+			continue;
+		}
+		currentFrameCounter = m_rawImageBuffer.GetMetadata().embeddedFrameCounter;
+		skippedFrames++;
+	}
+	return true;
+}
+
+// add the last retrieved 8-bit frame into its accumulator
+void pointGreyCapture::_accumulateFrameData(unsigned short* accumulator, bool isFirstCycle)
+{
+	FringeKernels::accumulateFrame(m_rawImageBuffer.GetData(), accumulator, m_imageSize, isFirstCycle);
+}
+
+// add the last retrieved high bit depth frame into its accumulator
+// packed 12-bit frames are unpacked into a scratch frame first
+void pointGreyCapture::_accumulateFrameData(unsigned int* accumulator, bool isFirstCycle)
+{
+	if (m_pixelFormat == PIXEL_FORMAT_RAW16 || m_pixelFormat == PIXEL_FORMAT_MONO16)
+	{
+		FringeKernels::accumulateFrame((const unsigned short*)m_rawImageBuffer.GetData(), accumulator, m_imageSize, isFirstCycle);
+		return;
+	}
+	if (m_unpackedFrame.size() < (size_t)m_imageSize) m_unpackedFrame.resize(m_imageSize);
+	_copyFrameData(m_unpackedFrame.data());
+	FringeKernels::accumulateFrame(m_unpackedFrame.data(), accumulator, m_imageSize, isFirstCycle);
+}
+
+// copy the last retrieved frame into an 8-bit image data array
+void pointGreyCapture::_copyFrameData(unsigned char* captureImage)
+{
+	if (isHighBitDepth())
+	{
+		cout << "8-bit buffer used with a high bit depth pixel format" << endl;
+		return;
+	}
+	memcpy(captureImage, m_rawImageBuffer.GetData(), sizeof(captureImage[0]) * m_imageSize);
+}
+
+// copy the last retrieved frame into a 16-bit image data array
+// 12-bit packed data is unpacked MSB aligned, 8-bit data is shifted up
+void pointGreyCapture::_copyFrameData(unsigned short* captureImage)
+{
+	const unsigned char* rawData = m_rawImageBuffer.GetData();
+	switch (m_pixelFormat)
+	{
+	case PIXEL_FORMAT_RAW12:
+	case PIXEL_FORMAT_MONO12:
+		FringeKernels::unpackMono12(rawData, captureImage, m_imageSize);
+		break;
+	case PIXEL_FORMAT_RAW16:
+	case PIXEL_FORMAT_MONO16:
+		FringeKernels::copyMono16(rawData, captureImage, m_imageSize);
+		break;
+	default:
+		for (int i = 0; i < m_imageSize; i++)
+		{
+			captureImage[i] = (unsigned short)(rawData[i] << 8);
+		}
+		break;
+	}
+}
@@ -15,11 +15,32 @@
 */
 
 #pragma once
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
 #include "FlyCapture2.h"
+#include "FrameTrace.h"
 #pragma comment(lib, "FlyCapture2_v140.lib")
 
 using namespace FlyCapture2;
 
+// called with each frame of a set as soon as it is stored, in set order
+typedef std::function<void(int frameIndex, const unsigned char* frameData, int width, int height, int bytesPerPixel)> SetFrameCallback;
+
+// a failed retrieve and how the stream was brought back
+struct StreamRecovery
+{
+	ErrorType error;				// of the retrieve that failed
+	std::string description;
+	unsigned long frameCounter;		// last frame before the failure
+	bool isReconnected;				// restarting the capture was not enough
+	bool isRecovered;
+	float recovery_ms;
+};
+
 class pointGreyCapture
 {
 public:
@@ -33,25 +54,102 @@ public:
 	bool initCamera(unsigned int imageWidth, unsigned int imageHeight, unsigned int offsetX, unsigned int offsetY, float frameRate = 60.0f, float exposureTime_ms = 2.0f, bool isHardwareTrigger = true);
 	bool setExposureTime(float& exposureTimeToSet);
 	bool setFrameRate(float frameRateToSet);
+	bool getFrameRateLimit(float& maxFrameRate);
 	bool setGainValue(float gainvalueToSet = 1.0f);
 	bool setHardwareTrigger(bool isHardwareTrigger = true);
 	bool setWhiteBalance(float gainRedToSet, float gainBlueToSet);
+	bool setPixelFormat(PixelFormat pixelFormatToSet);
+	bool setImageROI(unsigned int& widthToSet, unsigned int& heightToSet, unsigned int& offsetX, unsigned int& offsetY);
+	bool snapImageROI(unsigned int& widthToSet, unsigned int& heightToSet, unsigned int& offsetX, unsigned int& offsetY);
+
+	int getImageWidth() const { return m_imageWidth; }
+	int getImageHeight() const { return m_imageHeight; }
+	int getOffsetX() const { return m_offsetX; }
+	int getOffsetY() const { return m_offsetY; }
+	PixelFormat getPixelFormat() const { return m_pixelFormat; }
+	bool isAcquisitionStarted() const { return m_acquisitionStarted; }
+	unsigned long getLastFrameCounter() const { return m_previousFrameNumber; }
+	double getLastFrameTime() const { return _frameTime(); }
+	float getLastSetFrameInterval() const { return m_lastSetFrameInterval_ms; }
+	bool isHighBitDepth() const { return m_pixelFormat != PIXEL_FORMAT_RAW8 && m_pixelFormat != PIXEL_FORMAT_MONO8; }
 
 	bool captureSingleImage(Image& captureImage, bool isStreamMode = false);
 	bool captureImageSet(Image captureImage[], int numberOfFrames, int firstFrameCounter = 0, bool isStreamMode = true);
 	bool captureSingleImageData(unsigned char* captureImage, bool isStreamMode = false);
 	bool captureImageSetData(unsigned char *captureImage[], int numberOfFrames, int firstFrameCounter = 0, bool isStreamMode = true);
+	bool captureSingleImageData(unsigned short* captureImage, bool isStreamMode = false);
+	bool captureImageSetData(unsigned short* captureImage[], int numberOfFrames, int firstFrameCounter = 0, bool isStreamMode = true);
+	bool captureImageSetAverage(unsigned char* captureImage[], int numberOfFrames, int numberOfCycles, int firstFrameCounter = 0, bool isStreamMode = true);
+	bool captureImageSetAverage(unsigned short* captureImage[], int numberOfFrames, int numberOfCycles, int firstFrameCounter = 0, bool isStreamMode = true);
+	bool captureImageSetHDR(unsigned short* fusedImage[], unsigned char* exposureMap, int numberOfFrames, const float exposureTimes[], int numberOfExposures,
+		int firstFrameCounter = 0, bool isStreamMode = true);
 
 	bool startAcquisition();
 	bool stopAcquisition();
+	bool skipFramesBefore(double releaseTime, unsigned long& frameCounter);
+
+	void setFrameCallback(SetFrameCallback callback) { m_frameCallback = callback; }
+	// record retrieve and hand-off of every frame, and frame counter gaps
+	void setFrameTrace(CFrameTrace* frameTrace) { m_frameTrace = frameTrace; }
+	unsigned long getSetFirstFrameCounter() const { return m_setFirstFrameNumber; }
+
+	// RetrieveBuffer gives up after timeout_ms; 0 derives it from the frame period, -1 waits forever
+	bool setGrabTimeout(int timeout_ms);
+	int getGrabTimeout() const { return m_grabTimeout_ms; }
+	ErrorType getLastError() const { return m_lastError; }
+	const std::vector<StreamRecovery>& getRecoveries() const { return m_recoveries; }
+	void printRecoveryReport() const;
+	// test the recovery: every faultPeriod retrieves, the next faultCount fail with error
+	// without reaching the driver; a faultPeriod of 0 turns it off
+	void injectRetrieveFaults(ErrorType error, int faultPeriod, int faultCount = 1);
+
+	// skip writes that match the settings a still-powered camera kept from the last run
+	void setConfigCacheEnabled(bool isEnabled) { m_useConfigCache = isEnabled; }
+	void printBringUpReport() const;
+	bool verifyConfiguration(std::vector<std::string>& mismatches);
 
 private:
 	bool _checkLogError(FlyCapture2::Error error);
+	bool _logError(ErrorType errorType, const char* description);
 	bool setImageResolution(unsigned int& widthToSet, unsigned int& heightToSet);
 	bool setImageResolution(unsigned int& widthToSet, unsigned int& heightToSet, unsigned int offsetX, unsigned int offsetY);
 	bool setGammaEnabled(bool isEnabled = false);
 	bool setBufferedGrab(int buffers = 10);
 	bool setFrameCounterEnabled(bool isEnabled = true);
+	void _copyFrameData(unsigned char* captureImage);
+	void _copyFrameData(unsigned short* captureImage);
+	template <typename T> bool _captureImageSetData(T* captureImage[], int numberOfFrames, int firstFrameCounter, bool isStreamMode);
+	template <typename T> bool _captureImageSetAverage(T* captureImage[], int numberOfFrames, int numberOfCycles, int firstFrameCounter, bool isStreamMode);
+	unsigned short* _getSetAccumulator(unsigned char* captureImage, size_t accumulatorSize);
+	unsigned int* _getSetAccumulator(unsigned short* captureImage, size_t accumulatorSize);
+	void _accumulateFrameData(unsigned short* accumulator, bool isFirstCycle);
+	void _accumulateFrameData(unsigned int* accumulator, bool isFirstCycle);
+	bool _retrieveCycleStart(int numberOfFrames, int firstFrameCounter, int minimumSkippedFrames);
+	bool _waitForRegister(unsigned int address, unsigned int mask, unsigned int expectedValue, int timeout_ms);
+	std::string _configCacheFile() const;
+	void _loadConfigCache(bool isValid);
+	void _saveConfigCache() const;
+	bool _isCached(const std::string& key, const std::string& value);
+	std::string _readConfigValue(const std::string& key);
+	bool _isSameConfigValue(const std::string& cameraValue, const std::string& value) const;
+	void _cacheValue(const std::string& key, const std::string& value);
+	std::string _configValue(float value) const;
+	std::string _format7Value(unsigned int width, unsigned int height, unsigned int offsetX, unsigned int offsetY) const;
+	double _frameTime() const;
+	template <typename T> void _notifyFrame(int frameIndex, const T* frameData);
+	bool _retrieveBuffer();
+	bool _isFaultDue();
+	bool _injectFault();
+	bool _recoverStream(ErrorType error);
+	bool _reconnectCamera();
+	bool _powerUp(bool& isPowered);
+	bool _isStreamLost() const;
+	int _grabTimeout() const;
+	bool _updateGrabTimeout();
+	long long _traceStart() const;
+	void _traceFrame(FrameTraceStage stage, long long stageStart);
+	void _reportSkip(unsigned long frameCounter);
+	void _recordStep(const char* stepName, std::chrono::steady_clock::time_point& stepStart, bool isCached = false);
 
 
 	Camera m_pCam;		// camera handle
@@ -65,6 +163,41 @@ private:
 	bool m_acquisitionStarted;
 	bool m_isCameraStarted;
 	unsigned long m_previousFrameNumber;
+	float m_lastSetFrameInterval_ms;	// mean frame interval of the last set, from host time stamps
 	int m_imageWidth, m_imageHeight, m_imageSize;
+	int m_offsetX, m_offsetY;
+	PixelFormat m_pixelFormat;
+
+	// one set of accumulators for multi-cycle averaging, kept between sets
+	std::vector<unsigned short> m_setAccumulator16;
+	std::vector<unsigned int> m_setAccumulator32;
+	std::vector<unsigned short> m_unpackedFrame;
+	std::vector<unsigned char> m_saturatedFlags;
+
+	// camera settings known to be applied, by setting name
+	unsigned int m_cameraSerialNumber;
+	bool m_useConfigCache;
+	std::map<std::string, std::string> m_configCache;
+	std::vector<std::pair<std::string, double>> m_bringUpSteps;
+
+	SetFrameCallback m_frameCallback;
+	CFrameTrace* m_frameTrace;
+	unsigned long m_setFirstFrameNumber;	// first frame counter of the last set
+
+	// bounded retrieves and stream recovery
+	float m_frameRate;
+	float m_exposureTime_ms;
+	bool m_isHardwareTrigger;
+	int m_numBuffers;
+	int m_grabTimeoutSetting;		// setGrabTimeout, 0: derived
+	int m_grabTimeout_ms;			// applied to the driver, 0 before setBufferedGrab
+	ErrorType m_lastError;
+	std::string m_lastErrorDescription;
+	std::map<int, int> m_errorCounts;	// by FlyCapture2 error type
+	int m_retrieveFailures;			// consecutive, torn frames not counted
+	std::vector<StreamRecovery> m_recoveries;
+	ErrorType m_faultError;
+	int m_faultPeriod, m_faultCount;
+	int m_framesToFault, m_faultsLeft;
 };
 
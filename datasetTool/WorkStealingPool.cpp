@@ -0,0 +1,121 @@
+#include "WorkStealingPool.h"
+
+thread_local int CWorkStealingPool::t_workerIndex = -1;
+thread_local CWorkStealingPool* CWorkStealingPool::t_pool = nullptr;
+
+CWorkStealingPool::CWorkStealingPool(int nThreads) :
+	m_pendingTasks(0), m_queuedTasks(0), m_nextQueue(0), m_stolenTasks(0), m_isStopping(false)
+{
+	if (nThreads <= 0) nThreads = (int)std::thread::hardware_concurrency();
+	if (nThreads <= 0) nThreads = 1;
+
+	for (int i = 0; i < nThreads; i++)
+	{
+		m_queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+	}
+	for (int i = 0; i < nThreads; i++)
+	{
+		m_workers.push_back(std::thread(&CWorkStealingPool::workerLoop, this, i));
+	}
+}
+
+CWorkStealingPool::~CWorkStealingPool(void)
+{
+	wait();
+	{
+		std::lock_guard<std::mutex> lock(m_idleMtx);
+		m_isStopping = true;
+	}
+	m_workAvailable.notify_all();
+	for (auto& worker : m_workers)
+	{
+		worker.join();
+	}
+}
+
+// queue a task; from a worker thread it goes to that worker's own deque,
+// from any other thread the deques are filled round robin
+void CWorkStealingPool::submit(Task task)
+{
+	int queueIndex = (t_pool == this) ? t_workerIndex : (int)(m_nextQueue++ % m_queues.size());
+
+	m_pendingTasks++;
+	{
+		std::lock_guard<std::mutex> lock(m_queues[queueIndex]->mtx);
+		m_queues[queueIndex]->tasks.push_back(std::move(task));
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_idleMtx);
+		m_queuedTasks++;
+	}
+	m_workAvailable.notify_one();
+}
+
+// block until every submitted task, including tasks submitted by tasks, has run
+void CWorkStealingPool::wait()
+{
+	std::unique_lock<std::mutex> lock(m_idleMtx);
+	m_allDone.wait(lock, [this]() { return m_pendingTasks == 0; });
+}
+
+bool CWorkStealingPool::popLocal(int workerIndex, Task& task)
+{
+	WorkerQueue& queue = *m_queues[workerIndex];
+	std::lock_guard<std::mutex> lock(queue.mtx);
+	if (queue.tasks.empty())
+	{
+		return false;
+	}
+	task = std::move(queue.tasks.back());
+	queue.tasks.pop_back();
+	return true;
+}
+
+bool CWorkStealingPool::steal(int workerIndex, Task& task)
+{
+	int nQueues = (int)m_queues.size();
+	for (int i = 1; i < nQueues; i++)
+	{
+		WorkerQueue& victim = *m_queues[(workerIndex + i) % nQueues];
+		std::lock_guard<std::mutex> lock(victim.mtx);
+		if (victim.tasks.empty())
+		{
+			continue;
+		}
+		task = std::move(victim.tasks.front());
+		victim.tasks.pop_front();
+		m_stolenTasks++;
+		return true;
+	}
+	return false;
+}
+
+void CWorkStealingPool::workerLoop(int workerIndex)
+{
+	t_workerIndex = workerIndex;
+	t_pool = this;
+
+	while (true)
+	{
+		Task task;
+		if (popLocal(workerIndex, task) || steal(workerIndex, task))
+		{
+			m_queuedTasks--;
+			task();
+			if (--m_pendingTasks == 0)
+			{
+				std::lock_guard<std::mutex> lock(m_idleMtx);
+				m_allDone.notify_all();
+			}
+			continue;
+		}
+
+		// nothing to run or steal; sleep until a task is queued
+		std::unique_lock<std::mutex> lock(m_idleMtx);
+		m_workAvailable.wait(lock, [this]() { return m_isStopping || m_queuedTasks > 0; });
+		if (m_isStopping && m_queuedTasks == 0)
+		{
+			return;
+		}
+	}
+}
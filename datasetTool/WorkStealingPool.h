@@ -0,0 +1,58 @@
+/*
+	 Work-stealing thread pool
+	 Every worker owns a deque. Tasks submitted from a worker go to the
+	 back of its own deque and the owner pops from the back, so a chain
+	 of dependent tasks stays on one core with its data in cache. Idle
+	 workers steal from the front of the other deques.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class CWorkStealingPool
+{
+public:
+	typedef std::function<void()> Task;
+
+	CWorkStealingPool(int nThreads = 0);
+	~CWorkStealingPool(void);
+
+	void submit(Task task);
+	void wait();
+	int threadCount() const { return (int)m_workers.size(); }
+	long long stolenCount() const { return m_stolenTasks; }
+
+private:
+	struct WorkerQueue
+	{
+		std::mutex mtx;
+		std::deque<Task> tasks;
+	};
+
+	void workerLoop(int workerIndex);
+	bool popLocal(int workerIndex, Task& task);
+	bool steal(int workerIndex, Task& task);
+
+	std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+	std::vector<std::thread> m_workers;
+	std::atomic<int> m_pendingTasks;
+	std::atomic<int> m_queuedTasks;
+	std::atomic<unsigned int> m_nextQueue;
+	std::atomic<long long> m_stolenTasks;
+	std::atomic<bool> m_isStopping;
+
+	std::mutex m_idleMtx;
+	std::condition_variable m_workAvailable;
+	std::condition_variable m_allDone;
+
+	static thread_local int t_workerIndex;
+	static thread_local CWorkStealingPool* t_pool;
+};
@@ -0,0 +1,782 @@
+// datasetTool.cpp : headless processing of captured datasets
+// A dataset root holds <serial>/posEval<N>/f<k>.png sets written by grabImageSet,
+// or <serial>/posEval<N>/set.fsc when they were saved with the fringe codec.
+//
+// usage:
+//   datasetTool reprocess <datasetRoot> --steps n [--out dir] [--threads n]
+//                         [--cycle n] [--threshold t] [--calib dir] [--codebook file] [--force]
+//   datasetTool bench [--width w] [--height h] [--repeat r]
+//   datasetTool verify <datasetRoot> [--threads n] [--decode]
+//   datasetTool watch <host> [--port p] [--frames n] [--show]
+//
+// --steps is the number of phase shifts per sequence; a set holds one or more
+// sequences back to back, written as 16-bit phase<p>.png where 0..65535 maps
+// the wrapped phase -pi..pi
+// --threshold is the lowest modulation of a valid pixel in 8-bit levels, the
+// same threshold masks 8-bit and 16-bit sets alike
+// --calib takes a folder of calib<serial>.yml files; phase maps are then
+// computed on rectified frames, with roi.txt placing ROI sets on the sensor
+// --codebook gives the projected pattern sequence used to align raw cycles
+// (see CSequenceAligner::LoadCodebook); --cycle must match its length
+// bench times the typed phase kernels against the generic Mat version on
+// synthetic 8-bit sets of 4, 8 and 64 frames, and the fringe codec against
+// PNG on the same sets (size, encode and decode time, lossless check)
+// verify checks every set with a manifest.crc against the CRC32C of its
+// files without decoding them; --decode also checks the decoded pixels
+// watch receives the live preview a capture run streams on its streamPort
+// and prints each camera's frame counter, rate and exposure once a second;
+// --show also opens a window per camera
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <direct.h>
+
+#include "opencv2/opencv.hpp"
+#include "BatchPngLoader.h"
+#include "FrameStreamServer.h"
+#include "FringeCodec.h"
+#include "FringeProcessing.h"
+#include "PngFileIO.h"
+#include "RectifyRemap.h"
+#include "SetManifest.h"
+#include "WorkStealingPool.h"
+
+using namespace std;
+using namespace cv;
+
+struct ReprocessOptions
+{
+    string datasetRoot;
+    string outputRoot;          // empty: write next to the set in <set>/processed
+    int threads = 0;            // 0: one per core
+    int cycleFrames = 64;       // sets with a full raw cycle are re-aligned with rectSequence
+    int phaseSteps = 0;         // phase shifts per sequence, required
+    float modulationThreshold = 10.0f; // in 8-bit levels, scaled for 16-bit sets
+    string calibrationDir;      // empty: phase on the raw frames
+    string codebookFile;        // empty: two bright frames followed by fringes
+    bool isForced = false;      // re-process sets that are already done
+};
+
+// state carried along the load -> rect -> phase -> mask -> write chain of one set
+struct SetJob
+{
+    string setDir;
+    string outputDir;
+    BatchLoadInfo info;
+    Point roiOffset;
+    vector<unsigned char> storage;
+    vector<Mat> fringeMat;
+    vector<Mat> phaseMat;
+    vector<Mat> modulationMat;
+    Mat mask;
+};
+
+static bool fileExists(const string& fileName)
+{
+    FILE* fp = fopen(fileName.c_str(), "rb");
+    if (!fp) return false;
+    fclose(fp);
+    return true;
+}
+
+// create a directory and all of its parents
+static void createDirectories(const string& folderDir)
+{
+    for (size_t pos = folderDir.find_first_of("/\\", 1); pos != string::npos; pos = folderDir.find_first_of("/\\", pos + 1))
+    {
+        _mkdir(folderDir.substr(0, pos).c_str());
+    }
+    _mkdir(folderDir.c_str());
+}
+
+// find every set directory (a directory holding f0.png or set.fsc) below the dataset root
+static vector<string> scanDataset(const string& datasetRoot)
+{
+    vector<String> firstFrames, fringeSets;
+    glob(datasetRoot + "/f0.png", firstFrames, true);
+    glob(datasetRoot + "/set.fsc", fringeSets, true);
+    firstFrames.insert(firstFrames.end(), fringeSets.begin(), fringeSets.end());
+
+    vector<string> setDirs;
+    for (const String& firstFrame : firstFrames)
+    {
+        string setDir = string(firstFrame).substr(0, string(firstFrame).find_last_of("/\\"));
+        string setName = setDir.substr(setDir.find_last_of("/\\") + 1);
+        if (setName.compare(0, 7, "posEval") == 0)
+        {
+            setDirs.push_back(setDir);
+        }
+    }
+    sort(setDirs.begin(), setDirs.end());
+    setDirs.erase(unique(setDirs.begin(), setDirs.end()), setDirs.end());
+    return setDirs;
+}
+
+// camera serial of a set: the name of the directory holding posEval<N>
+static string serialFor(const string& setDir)
+{
+    string cameraDir = setDir.substr(0, setDir.find_last_of("/\\"));
+    return cameraDir.substr(cameraDir.find_last_of("/\\") + 1);
+}
+
+// offset of a ROI set in the full frame the calibration was made for,
+// (0, 0) for full frame sets; roi.txt holds the sensor offsets of the set
+// and of that frame (older files only the set's, for a frame at 0, 0)
+static Point readROIOffset(const string& setDir)
+{
+    Point offset(0, 0);
+    Point frameOffset(0, 0);
+    int width = 0, height = 0;
+    ifstream roiFile(setDir + "/roi.txt");
+    if (roiFile.is_open())
+    {
+        roiFile >> offset.x >> offset.y >> width >> height >> frameOffset.x >> frameOffset.y;
+    }
+    return Point(offset.x - frameOffset.x, offset.y - frameOffset.y);
+}
+
+static string outputDirFor(const ReprocessOptions& options, const string& setDir)
+{
+    if (options.outputRoot.empty())
+    {
+        return setDir + "/processed";
+    }
+    return options.outputRoot + setDir.substr(options.datasetRoot.size());
+}
+
+class CDatasetReprocessor
+{
+public:
+    CDatasetReprocessor(const ReprocessOptions& options) :
+        m_options(options), m_pool(options.threads), m_completedSets(0), m_failedSets(0)
+    {
+    }
+
+    int run()
+    {
+        if (!m_options.codebookFile.empty() && !m_processor.loadCodebook(m_options.codebookFile))
+        {
+            return 1;
+        }
+        vector<string> setDirs = scanDataset(m_options.datasetRoot);
+        vector<shared_ptr<SetJob>> jobs;
+        for (const string& setDir : setDirs)
+        {
+            shared_ptr<SetJob> job = make_shared<SetJob>();
+            job->setDir = setDir;
+            job->outputDir = outputDirFor(m_options, setDir);
+            // resume: a finished set has its done marker written last
+            if (!m_options.isForced && fileExists(job->outputDir + "/done"))
+            {
+                continue;
+            }
+            jobs.push_back(job);
+        }
+        // rectification maps are built up front and only read by the workers
+        if (!m_options.calibrationDir.empty())
+        {
+            for (auto& job : jobs)
+            {
+                string serial = serialFor(job->setDir);
+                if (m_rectifiers.count(serial)) continue;
+                shared_ptr<CRectifyRemap> rectifier = make_shared<CRectifyRemap>();
+                if (!rectifier->LoadCalibration(m_options.calibrationDir + "/calib" + serial + ".yml"))
+                {
+                    rectifier.reset();
+                }
+                m_rectifiers[serial] = rectifier;
+            }
+        }
+        cout << setDirs.size() << " sets found, " << setDirs.size() - jobs.size() << " already done, "
+            << jobs.size() << " to process on " << m_pool.threadCount() << " threads" << endl;
+
+        auto startTime = chrono::steady_clock::now();
+        for (auto& job : jobs)
+        {
+            submitStage(job, &CDatasetReprocessor::loadStage);
+        }
+
+        // progress report until the pool drains
+        int totalSets = (int)jobs.size();
+        while (m_completedSets + m_failedSets < totalSets)
+        {
+            this_thread::sleep_for(chrono::milliseconds(500));
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+            int doneSets = m_completedSets + m_failedSets;
+            printf("\r[%d/%d] %.1f sets/s, %d failed   ", doneSets, totalSets, seconds > 0 ? doneSets / seconds : 0.0, (int)m_failedSets);
+            fflush(stdout);
+        }
+        m_pool.wait();
+
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+        printf("\n%d sets processed, %d failed in %.1f s (%lld tasks stolen)\n",
+            (int)m_completedSets, (int)m_failedSets, seconds, m_pool.stolenCount());
+        return m_failedSets == 0 ? 0 : 1;
+    }
+
+private:
+    void fail(const shared_ptr<SetJob>& job, const string& reason)
+    {
+        cout << endl << job->setDir << ": " << reason << endl;
+        m_failedSets++;
+    }
+
+    // a stage that throws (cv::Exception, bad_alloc) fails its set instead of
+    // ending the worker thread and the run
+    void submitStage(shared_ptr<SetJob> job, void (CDatasetReprocessor::*stage)(shared_ptr<SetJob>))
+    {
+        m_pool.submit([this, job, stage]()
+        {
+            try
+            {
+                (this->*stage)(job);
+            }
+            catch (const exception& e)
+            {
+                fail(job, string("processing failed: ") + e.what());
+            }
+            catch (...)
+            {
+                fail(job, "processing failed");
+            }
+        });
+    }
+
+    void loadStage(shared_ptr<SetJob> job)
+    {
+        // sets are processed concurrently, so each load decodes on one thread
+        CBatchPngLoader loader(1);
+        if (!loader.ProbeSet(job->setDir, job->info))
+        {
+            fail(job, "cannot probe set");
+            return;
+        }
+        job->storage.resize(job->info.frameBytes * job->info.nFrames);
+        if (!loader.LoadSet(job->setDir, job->storage.data(), job->storage.size(), job->info))
+        {
+            fail(job, "cannot load set");
+            return;
+        }
+        int frameType = job->info.bytesPerPixel == 2 ? CV_16UC(job->info.nChannels) : CV_8UC(job->info.nChannels);
+        for (int k = 0; k < job->info.nFrames; k++)
+        {
+            job->fringeMat.push_back(Mat(job->info.imageHeight, job->info.imageWidth, frameType, job->storage.data() + k * job->info.frameBytes));
+        }
+        job->roiOffset = readROIOffset(job->setDir);
+        submitStage(job, &CDatasetReprocessor::rectStage);
+    }
+
+    void rectStage(shared_ptr<SetJob> job)
+    {
+        // saved sets are already aligned; only a full raw cycle needs rectSequence
+        if (job->info.nFrames == m_options.cycleFrames)
+        {
+            vector<Mat> rectFringeMat;
+            if (!m_processor.rectSequence(job->fringeMat, rectFringeMat))
+            {
+                fail(job, "cycle does not match the codebook");
+                return;
+            }
+            job->fringeMat.swap(rectFringeMat);
+            job->storage.clear();
+            job->storage.shrink_to_fit();
+        }
+        submitStage(job, &CDatasetReprocessor::phaseStage);
+    }
+
+    void phaseStage(shared_ptr<SetJob> job)
+    {
+        int phaseSteps = m_options.phaseSteps;
+        int phaseNo = (int)job->fringeMat.size() / phaseSteps;
+        if (phaseNo == 0)
+        {
+            fail(job, "set is shorter than one phase shifting sequence");
+            return;
+        }
+        // frames left over would mean --steps does not describe this set
+        if (job->fringeMat.size() % phaseSteps != 0)
+        {
+            fail(job, to_string(job->fringeMat.size()) + " frames are not a whole number of " + to_string(phaseSteps) + " step sequences");
+            return;
+        }
+        job->phaseMat.resize(phaseNo);
+        job->modulationMat.resize(phaseNo);
+        const CRectifyRemap* rectifier = rectifierFor(job->setDir);
+        for (int p = 0; p < phaseNo; p++)
+        {
+            // with a calibration the rectified frames are never stored
+            bool isComputed = rectifier
+                ? rectifier->RemapPhase(job->fringeMat, p * phaseSteps, phaseSteps, job->phaseMat[p], job->modulationMat[p], job->roiOffset)
+                : m_processor.computeWrappedPhase(job->fringeMat, p * phaseSteps, phaseSteps, job->phaseMat[p], job->modulationMat[p]);
+            if (!isComputed)
+            {
+                fail(job, "phase computation failed");
+                return;
+            }
+        }
+        job->fringeMat.clear();
+        job->storage.clear();
+        job->storage.shrink_to_fit();
+        submitStage(job, &CDatasetReprocessor::maskStage);
+    }
+
+    void maskStage(shared_ptr<SetJob> job)
+    {
+        // a pixel is valid when every phase map has enough modulation; the
+        // threshold is in 8-bit levels, 16-bit sets are MSB aligned
+        float modulationThreshold = m_options.modulationThreshold * (job->info.bytesPerPixel == 2 ? 256.0f : 1.0f);
+        for (int p = 0; p < job->modulationMat.size(); p++)
+        {
+            Mat phaseMask;
+            m_processor.computeMask(job->modulationMat[p], modulationThreshold, phaseMask);
+            if (job->mask.empty())
+            {
+                job->mask = phaseMask;
+            }
+            else
+            {
+                bitwise_and(job->mask, phaseMask, job->mask);
+            }
+        }
+        job->modulationMat.clear();
+        submitStage(job, &CDatasetReprocessor::writeStage);
+    }
+
+    void writeStage(shared_ptr<SetJob> job)
+    {
+        createDirectories(job->outputDir);
+        CPngFileIO pngFileIO;
+        for (int p = 0; p < job->phaseMat.size(); p++)
+        {
+            // 16 bits keep the wrapped phase to 1e-4 rad, 8 bits would cost the unwrapping 0.025 rad
+            Mat phase16;
+            job->phaseMat[p].convertTo(phase16, CV_16U, 65535.0 / (2 * CV_PI), 32767.5);
+            string fileName = job->outputDir + "/phase" + to_string(p) + ".png";
+            if (!pngFileIO.WritePngFile(fileName.c_str(), (unsigned short*)phase16.data, phase16.cols, phase16.rows, 1))
+            {
+                fail(job, "cannot write " + fileName);
+                return;
+            }
+        }
+        string maskName = job->outputDir + "/mask.png";
+        if (!pngFileIO.WritePngFile(maskName.c_str(), job->mask.data, job->mask.cols, job->mask.rows, 1))
+        {
+            fail(job, "cannot write " + maskName);
+            return;
+        }
+
+        FILE* doneFile = fopen((job->outputDir + "/done").c_str(), "wb");
+        if (doneFile) fclose(doneFile);
+        m_completedSets++;
+    }
+
+    const CRectifyRemap* rectifierFor(const string& setDir) const
+    {
+        auto it = m_rectifiers.find(serialFor(setDir));
+        return it == m_rectifiers.end() ? NULL : it->second.get();
+    }
+
+    ReprocessOptions m_options;
+    CFringeProcessor m_processor;
+    map<string, shared_ptr<CRectifyRemap>> m_rectifiers;
+    CWorkStealingPool m_pool;
+    atomic<int> m_completedSets;
+    atomic<int> m_failedSets;
+};
+
+struct BenchOptions
+{
+    int width = 1920;
+    int height = 1200;
+    int repeat = 5;
+};
+
+// best of repeat runs, in ms
+static double timePhase(const function<void()>& run, int repeat)
+{
+    double best = 0;
+    for (int r = 0; r < repeat; r++)
+    {
+        auto start = chrono::steady_clock::now();
+        run();
+        double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        best = r == 0 ? elapsed : (std::min)(best, elapsed);
+    }
+    return best;
+}
+
+static int runBench(const BenchOptions& options)
+{
+    CFringeProcessor processor;
+    RNG rng(1);
+    const int stepCounts[] = { 4, 8, 64 };
+    for (int phaseSteps : stepCounts)
+    {
+        // vertical fringes of period 64 pixels with a little noise
+        vector<Mat> fringeMat(phaseSteps);
+        for (int k = 0; k < phaseSteps; k++)
+        {
+            fringeMat[k].create(options.height, options.width, CV_8UC1);
+            for (int y = 0; y < options.height; y++)
+            {
+                unsigned char* row = fringeMat[k].ptr<unsigned char>(y);
+                for (int x = 0; x < options.width; x++)
+                {
+                    double value = 128 + 100 * cos(2 * CV_PI * x / 64 + 2 * CV_PI * k / phaseSteps) + rng.uniform(-2, 3);
+                    row[x] = saturate_cast<unsigned char>(value);
+                }
+            }
+        }
+
+        Mat genericPhase, genericModulation, typedPhase, typedModulation;
+        double genericTime = timePhase([&]() { processor.computeWrappedPhaseGeneric(fringeMat, 0, phaseSteps, genericPhase, genericModulation); }, options.repeat);
+        double typedTime = timePhase([&]() { processor.computeWrappedPhase(fringeMat, 0, phaseSteps, typedPhase, typedModulation); }, options.repeat);
+
+        // phase difference across the wrap counts the short way round
+        double maxDifference = 0;
+        for (int y = 0; y < options.height; y++)
+        {
+            const float* generic = genericPhase.ptr<float>(y);
+            const float* typed = typedPhase.ptr<float>(y);
+            for (int x = 0; x < options.width; x++)
+            {
+                double difference = fabs((double)generic[x] - typed[x]);
+                maxDifference = (std::max)(maxDifference, (std::min)(difference, 2 * CV_PI - difference));
+            }
+        }
+
+        cout << phaseSteps << " steps " << options.width << "x" << options.height
+            << ": generic " << genericTime << " ms, typed " << typedTime << " ms, speedup "
+            << genericTime / (std::max)(typedTime, 1e-3) << ", max phase difference " << maxDifference << endl;
+
+        // one PNG per frame against one fringe set for the whole sequence
+        size_t pngBytes = 0;
+        vector<vector<uchar>> pngData(phaseSteps);
+        double pngEncodeTime = timePhase([&]()
+        {
+            pngBytes = 0;
+            for (int k = 0; k < phaseSteps; k++)
+            {
+                imencode(".png", fringeMat[k], pngData[k]);
+                pngBytes += pngData[k].size();
+            }
+        }, options.repeat);
+        double pngDecodeTime = timePhase([&]()
+        {
+            for (int k = 0; k < phaseSteps; k++)
+            {
+                imdecode(pngData[k], IMREAD_UNCHANGED);
+            }
+        }, options.repeat);
+
+        CFringeCodec codec;
+        vector<uchar> fringeSetData;
+        vector<Mat> decodedMat;
+        double codecEncodeTime = timePhase([&]() { codec.EncodeSet(fringeMat, fringeSetData); }, options.repeat);
+        double codecDecodeTime = timePhase([&]() { codec.DecodeSet(fringeSetData, decodedMat); }, options.repeat);
+        bool isLossless = decodedMat.size() == fringeMat.size();
+        for (int k = 0; isLossless && k < phaseSteps; k++)
+        {
+            isLossless = norm(decodedMat[k], fringeMat[k], NORM_INF) == 0;
+        }
+
+        double rawBytes = (double)options.width * options.height * phaseSteps;
+        cout << phaseSteps << " steps storage: png " << rawBytes / (std::max)(pngBytes, (size_t)1) << ":1, "
+            << pngEncodeTime << " ms encode, " << pngDecodeTime << " ms decode; fsc "
+            << rawBytes / (std::max)(fringeSetData.size(), (size_t)1) << ":1, " << codecEncodeTime << " ms encode, "
+            << codecDecodeTime << " ms decode, " << (isLossless ? "lossless" : "NOT LOSSLESS") << endl;
+    }
+    return 0;
+}
+
+struct VerifyOptions
+{
+    string datasetRoot;
+    int threads = 0;            // 0: one per core
+    bool isDecoded = false;     // also decode every frame and check its pixels
+};
+
+// find every directory with a manifest below the dataset root, rect sets included
+static vector<string> scanManifests(const string& datasetRoot)
+{
+    vector<String> manifestFiles;
+    glob(datasetRoot + "/manifest.crc", manifestFiles, true);
+
+    vector<string> setDirs;
+    for (const String& manifestFile : manifestFiles)
+    {
+        setDirs.push_back(string(manifestFile).substr(0, string(manifestFile).find_last_of("/\\")));
+    }
+    sort(setDirs.begin(), setDirs.end());
+    return setDirs;
+}
+
+// one set per task; the files are only read and checksummed, so the check
+// runs at disk speed unless --decode is given
+static int runVerify(const VerifyOptions& options)
+{
+    vector<string> setDirs = scanManifests(options.datasetRoot);
+    int uncheckedSets = 0;
+    for (const string& setDir : scanDataset(options.datasetRoot))
+    {
+        if (!fileExists(setDir + "/manifest.crc")) uncheckedSets++;
+    }
+
+    CWorkStealingPool pool(options.threads);
+    cout << setDirs.size() << " sets with a manifest, " << uncheckedSets << " without, checking on "
+        << pool.threadCount() << " threads" << endl;
+
+    atomic<int> checkedSets(0);
+    atomic<int> failedSets(0);
+    atomic<unsigned long long> bytesRead(0);
+    mutex errorMtx;
+    vector<string> errors;
+    auto startTime = chrono::steady_clock::now();
+    for (const string& setDir : setDirs)
+    {
+        pool.submit([&, setDir]()
+        {
+            CSetManifest manifest;
+            vector<string> setErrors;
+            unsigned long long setBytes = 0;
+            // a set that throws is reported like any other failed set
+            try
+            {
+                if (!manifest.Read(setDir))
+                {
+                    setErrors.push_back(setDir + "/manifest.crc: cannot be read");
+                }
+                else
+                {
+                    manifest.Verify(setDir, options.isDecoded, setErrors, setBytes);
+                }
+            }
+            catch (const exception& e)
+            {
+                setErrors.push_back(setDir + ": " + e.what());
+            }
+            catch (...)
+            {
+                setErrors.push_back(setDir + ": verification failed");
+            }
+            bytesRead += setBytes;
+            if (!setErrors.empty())
+            {
+                lock_guard<mutex> lock(errorMtx);
+                errors.insert(errors.end(), setErrors.begin(), setErrors.end());
+                failedSets++;
+            }
+            checkedSets++;
+        });
+    }
+
+    // the pool decides when the run is over, the progress report only watches
+    int totalSets = (int)setDirs.size();
+    atomic<bool> isDone(false);
+    thread progress([&]()
+    {
+        while (!isDone)
+        {
+            this_thread::sleep_for(chrono::milliseconds(500));
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+            printf("\r[%d/%d] %.0f MB/s, %d failed   ", (int)checkedSets, totalSets, seconds > 0 ? bytesRead / seconds / 1e6 : 0.0, (int)failedSets);
+            fflush(stdout);
+        }
+    });
+    pool.wait();
+    isDone = true;
+    progress.join();
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+    printf("\n%d sets checked, %d failed, %.1f GB in %.1f s (%.0f MB/s)\n", totalSets, (int)failedSets,
+        bytesRead / 1e9, seconds, seconds > 0 ? bytesRead / seconds / 1e6 : 0.0);
+    sort(errors.begin(), errors.end());
+    for (const string& error : errors)
+    {
+        cout << error << endl;
+    }
+    return failedSets > 0 ? 1 : 0;
+}
+
+struct WatchOptions
+{
+    string host;
+    unsigned short port = c_defaultStreamPort;
+    int frames = 0;             // 0: until the capture run ends
+    bool isShown = false;       // open a preview window per camera
+};
+
+// print one status line per camera and second while the stream runs
+static int runWatch(const WatchOptions& options)
+{
+    CFrameStreamClient client;
+    if (!client.Connect(options.host, options.port))
+    {
+        return 1;
+    }
+    cout << "watching " << options.host << ":" << options.port << endl;
+
+    map<unsigned int, chrono::steady_clock::time_point> lastReport;
+    map<unsigned int, int> framesSinceReport;
+    StreamFrameHeader header;
+    Mat image;
+    int receivedFrames = 0;
+    while (options.frames == 0 || receivedFrames < options.frames)
+    {
+        if (!client.Receive(header, image))
+        {
+            break;
+        }
+        receivedFrames++;
+        framesSinceReport[header.cameraSerial]++;
+
+        auto now = chrono::steady_clock::now();
+        auto report = lastReport.find(header.cameraSerial);
+        if (report == lastReport.end() || now - report->second >= chrono::seconds(1))
+        {
+            double seconds = report == lastReport.end() ? 0 : chrono::duration<double>(now - report->second).count();
+            printf("camera %u pos %d frame %u: %dx%d of %dx%d, camera %.1f fps, stream %.1f fps, exposure %.2f ms, %u dropped\n",
+                header.cameraSerial, header.positionNo, header.frameCounter, header.width, header.height,
+                header.sourceWidth, header.sourceHeight, header.frameRate,
+                seconds > 0 ? framesSinceReport[header.cameraSerial] / seconds : 0.0, header.exposureTime_ms, header.droppedFrames);
+            lastReport[header.cameraSerial] = now;
+            framesSinceReport[header.cameraSerial] = 0;
+        }
+
+        if (options.isShown)
+        {
+            imshow(to_string(header.cameraSerial), image);
+            int c = waitKey(1);
+            if (c == 27 || c == 'q')
+            {
+                break;
+            }
+        }
+    }
+    client.Close();
+    cout << receivedFrames << " frames received" << endl;
+    return receivedFrames > 0 ? 0 : 1;
+}
+
+static void printUsage()
+{
+    cout << "usage:" << endl
+        << "  datasetTool reprocess <datasetRoot> --steps n [--out dir] [--threads n]" << endl
+        << "                        [--cycle n] [--threshold t] [--calib dir] [--codebook file] [--force]" << endl
+        << "  datasetTool bench [--width w] [--height h] [--repeat r]" << endl
+        << "  datasetTool verify <datasetRoot> [--threads n] [--decode]" << endl
+        << "  datasetTool watch <host> [--port p] [--frames n] [--show]" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        printUsage();
+        return 1;
+    }
+
+    string command = argv[1];
+    if (command == "reprocess" && argc >= 3)
+    {
+        ReprocessOptions options;
+        options.datasetRoot = argv[2];
+        for (int i = 3; i < argc; i++)
+        {
+            string option = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (option == "--out" && hasValue) options.outputRoot = argv[++i];
+            else if (option == "--threads" && hasValue) options.threads = atoi(argv[++i]);
+            else if (option == "--steps" && hasValue) options.phaseSteps = atoi(argv[++i]);
+            else if (option == "--cycle" && hasValue) options.cycleFrames = atoi(argv[++i]);
+            else if (option == "--threshold" && hasValue) options.modulationThreshold = (float)atof(argv[++i]);
+            else if (option == "--calib" && hasValue) options.calibrationDir = argv[++i];
+            else if (option == "--codebook" && hasValue) options.codebookFile = argv[++i];
+            else if (option == "--force") options.isForced = true;
+            else
+            {
+                printUsage();
+                return 1;
+            }
+        }
+        // a saved set may hold several sequences, so their length is not known from the set
+        if (options.phaseSteps < 3)
+        {
+            cout << "reprocess needs --steps, at least 3 phase shifts per sequence" << endl;
+            printUsage();
+            return 1;
+        }
+        CDatasetReprocessor reprocessor(options);
+        return reprocessor.run();
+    }
+    if (command == "bench")
+    {
+        BenchOptions options;
+        for (int i = 2; i < argc; i++)
+        {
+            string option = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (option == "--width" && hasValue) options.width = atoi(argv[++i]);
+            else if (option == "--height" && hasValue) options.height = atoi(argv[++i]);
+            else if (option == "--repeat" && hasValue) options.repeat = (std::max)(1, atoi(argv[++i]));
+            else
+            {
+                printUsage();
+                return 1;
+            }
+        }
+        return runBench(options);
+    }
+    if (command == "verify" && argc >= 3)
+    {
+        VerifyOptions options;
+        options.datasetRoot = argv[2];
+        for (int i = 3; i < argc; i++)
+        {
+            string option = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (option == "--threads" && hasValue) options.threads = atoi(argv[++i]);
+            else if (option == "--decode") options.isDecoded = true;
+            else
+            {
+                printUsage();
+                return 1;
+            }
+        }
+        return runVerify(options);
+    }
+    if (command == "watch" && argc >= 3)
+    {
+        WatchOptions options;
+        options.host = argv[2];
+        for (int i = 3; i < argc; i++)
+        {
+            string option = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (option == "--port" && hasValue) options.port = (unsigned short)atoi(argv[++i]);
+            else if (option == "--frames" && hasValue) options.frames = atoi(argv[++i]);
+            else if (option == "--show") options.isShown = true;
+            else
+            {
+                printUsage();
+                return 1;
+            }
+        }
+        return runWatch(options);
+    }
+
+    printUsage();
+    return 1;
+}